@@ -0,0 +1,185 @@
+/**
+ * @file
+ * @brief       Adaptive advertising schedule
+ */
+
+#include <stdio.h>
+
+#include "host/ble_hs.h"
+#include "nimble/nimble_npl.h"
+#include "nimble/nimble_port.h"
+#include "nimble_autoadv.h"
+#include "nimble_riot.h"
+#include "ztimer.h"
+
+#include "adv_sched.h"
+#include "bond.h"
+#include "broadcast.h"
+
+/* ----------------------  Variables --------------------- */
+
+static const uint16_t _itvl_ms[ADV_SCHED_NUMOF] = {
+    [ADV_SCHED_FAST] = ADV_FAST_ITVL_MS,
+    [ADV_SCHED_SLOW] = ADV_SLOW_ITVL_MS,
+    [ADV_SCHED_DIRECTED] = 0,               // Fixed by the controller (<= 3.75 ms)
+};
+
+static const char *_phase_name[ADV_SCHED_NUMOF] = {
+    [ADV_SCHED_FAST] = "fast",
+    [ADV_SCHED_SLOW] = "slow",
+    [ADV_SCHED_DIRECTED] = "directed",
+};
+
+static adv_sched_phase_t _phase;
+static uint8_t _advertising;        // autoadv is running (no central connected)
+static uint32_t _adv_start_ms;      // When the current advertising round started
+
+static adv_sched_stats_t _stats[ADV_SCHED_NUMOF];
+static ble_gap_event_fn *_gap_cb;
+
+// Fast -> slow phase switch and load edges, run in the NimBLE host thread like
+// the GAP events, so they can't restart the advertising of a connection
+static struct ble_npl_callout _slow_callout;
+static struct ble_npl_event _load_evt;
+
+/* ----------------------  Private  --------------------- */
+
+static void _apply(adv_sched_phase_t phase) {
+    nimble_autoadv_cfg_t cfg = {
+        .adv_duration_ms = BLE_HS_FOREVER,
+        .adv_itvl_ms = BLE_GAP_ADV_ITVL_MS(_itvl_ms[phase]),
+        .flags = NIMBLE_AUTOADV_FLAG_CONNECTABLE | NIMBLE_AUTOADV_FLAG_LEGACY |
+                 NIMBLE_AUTOADV_FLAG_SCANNABLE,
+        .channel_map = 0,
+        .filter_policy = 0,
+        .own_addr_type = nimble_riot_own_addr_type,
+        .phy = NIMBLE_PHY_1M,
+        .tx_power = 0,
+    };
+
+    _phase = phase;
+
+    /* the interval only takes effect on a restart of the advertising */
+    nimble_autoadv_stop();
+    nimble_autoadv_cfg_update(&cfg);
+    nimble_autoadv_start(NULL);
+    broadcast_adv_restarted();
+
+    printf("[ADV] %s advertising, interval %u ms\n", _phase_name[phase],
+           (unsigned)_itvl_ms[phase]);
+}
+
+static int _start_directed(const ble_addr_t *peer) {
+#if MYNEWT_VAL(BLE_EXT_ADV)
+    /* the legacy high duty directed PDU is not available through the extended API */
+    (void)peer;
+    return BLE_HS_ENOTSUP;
+#else
+    struct ble_gap_adv_params params = { 0 };
+    params.conn_mode = BLE_GAP_CONN_MODE_DIR;
+    params.disc_mode = BLE_GAP_DISC_MODE_NON;
+    params.high_duty_cycle = 1;
+
+    int rc = ble_gap_adv_start(nimble_riot_own_addr_type, peer, ADV_DIRECTED_DURATION_MS,
+                               &params, _gap_cb, NULL);
+    if (rc == 0) {
+        _phase = ADV_SCHED_DIRECTED;
+        puts("[ADV] directed advertising to the last bonded central");
+    }
+    return rc;
+#endif
+}
+
+static void _fast_for_a_while(void) {
+    ble_npl_callout_reset(&_slow_callout, ble_npl_time_ms_to_ticks32(ADV_FAST_DURATION_MS));
+}
+
+static void _start_undirected(void) {
+    _apply(ADV_SCHED_FAST);
+    _fast_for_a_while();
+}
+
+static void _go_slow(struct ble_npl_event *ev) {
+    (void)ev;
+
+    if (_advertising) {
+        _apply(ADV_SCHED_SLOW);
+    }
+}
+
+static void _load(struct ble_npl_event *ev) {
+    (void)ev;
+
+    if (!_advertising || _phase == ADV_SCHED_DIRECTED) {
+        return;
+    }
+
+    /* a climber is at the board: whoever wants to connect should do it now. The
+     * time-to-connect still counts from the start of the advertising round */
+    if (_phase != ADV_SCHED_FAST) {
+        _apply(ADV_SCHED_FAST);
+    }
+    _fast_for_a_while();
+}
+
+/* ----------------------  Public  --------------------- */
+
+void adv_sched_init(ble_gap_event_fn *cb) {
+    _gap_cb = cb;
+    nimble_autoadv_set_gap_cb(cb, NULL);
+
+    ble_npl_callout_init(&_slow_callout, nimble_port_get_dflt_eventq(), _go_slow, NULL);
+    ble_npl_event_init(&_load_evt, _load, NULL);
+
+    for (unsigned i = 0; i < ADV_SCHED_NUMOF; i++) {
+        _stats[i].min_ms = UINT32_MAX;
+    }
+}
+
+void adv_sched_start(void) {
+    _advertising = 1;
+    _adv_start_ms = ztimer_now(ZTIMER_MSEC);
+
+    const ble_addr_t *peer = bond_last_peer();
+    if (peer != NULL && _start_directed(peer) == 0) {
+        return;
+    }
+    _start_undirected();
+}
+
+void adv_sched_adv_complete(void) {
+    /* the bonded central isn't around, let anybody connect */
+    if (_advertising && _phase == ADV_SCHED_DIRECTED) {
+        _start_undirected();
+    }
+}
+
+void adv_sched_connected(void) {
+    uint32_t elapsed = ztimer_now(ZTIMER_MSEC) - _adv_start_ms;
+    adv_sched_stats_t *stats = &_stats[_phase];
+
+    _advertising = 0;
+    ble_npl_callout_stop(&_slow_callout);
+
+    stats->count++;
+    stats->last_ms = elapsed;
+    stats->total_ms += elapsed;
+    if (elapsed < stats->min_ms) {
+        stats->min_ms = elapsed;
+    }
+    if (elapsed > stats->max_ms) {
+        stats->max_ms = elapsed;
+    }
+
+    printf("[ADV] connected after %lu ms (%s advertising)\n",
+           (unsigned long)elapsed, _phase_name[_phase]);
+}
+
+void adv_sched_load_detected(void) {
+    /* the phase belongs to the host thread, a pending edge isn't queued twice */
+    ble_npl_eventq_put(nimble_port_get_dflt_eventq(), &_load_evt);
+}
+
+const adv_sched_stats_t *adv_sched_stats(adv_sched_phase_t phase) {
+    return &_stats[phase];
+}
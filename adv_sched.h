@@ -0,0 +1,73 @@
+/**
+ * @file
+ * @brief       Adaptive advertising schedule
+ *
+ * Advertise fast for a while after boot, after a disconnect and whenever
+ * weight shows up on the board, so a central connects quickly. Fall back to a
+ * slow interval afterwards, to save power when nobody is around.
+ *
+ * After a disconnect from a bonded central, advertising starts with a short
+ * high duty cycle directed burst to that central, which reconnects a lot faster
+ * than undirected advertising.
+ */
+
+#ifndef ADV_SCHED_H
+#define ADV_SCHED_H
+
+#include <stdint.h>
+
+#include "host/ble_gap.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef ADV_FAST_ITVL_MS
+#define ADV_FAST_ITVL_MS        (30U)       // Interval of the fast advertising burst
+#endif
+#ifndef ADV_SLOW_ITVL_MS
+#define ADV_SLOW_ITVL_MS        (1000U)     // Background interval when nobody connects
+#endif
+#ifndef ADV_FAST_DURATION_MS
+#define ADV_FAST_DURATION_MS    (30000U)    // How long the fast burst lasts
+#endif
+#define ADV_DIRECTED_DURATION_MS (1280U)    // Spec limit of high duty directed advertising
+
+typedef enum {
+    ADV_SCHED_FAST = 0,
+    ADV_SCHED_SLOW = 1,
+    ADV_SCHED_DIRECTED = 2,     // Reconnect to the last bonded central
+    ADV_SCHED_NUMOF,
+} adv_sched_phase_t;
+
+/* Time-to-connect metrics, kept separately for connections made in each phase */
+typedef struct {
+    uint32_t count;         // Number of connections
+    uint32_t last_ms;       // Time from advertising start to the last connection
+    uint32_t min_ms;
+    uint32_t max_ms;
+    uint32_t total_ms;      // Sum, for the average
+} adv_sched_stats_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Configure autoadv. cb receives the GAP events of every advertising phase.
+ * The schedule runs in the NimBLE host thread, like the GAP events */
+void adv_sched_init(ble_gap_event_fn *cb);
+
+/* Start (or restart) advertising: directed to the last bonded central if
+ * there is one, with a fast undirected burst otherwise. From the NimBLE host
+ * thread, or before any connection */
+void adv_sched_start(void);
+
+/* Advertising stopped without a connection (the directed burst timed out) */
+void adv_sched_adv_complete(void);
+
+/* A central connected, stop the schedule and record the time-to-connect */
+void adv_sched_connected(void);
+
+/* Weight was detected on the board, go back to fast advertising if idle. Any
+ * thread, the switch happens in the host thread */
+void adv_sched_load_detected(void);
+
+/* Time-to-connect metrics of the given phase */
+const adv_sched_stats_t *adv_sched_stats(adv_sched_phase_t phase);
+
+#endif /* ADV_SCHED_H */
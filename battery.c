@@ -0,0 +1,104 @@
+/**
+ * @file
+ * @brief       Battery level from the supply voltage
+ *
+ * The table has one entry every BATTERY_LUT_STEP mV, expanded from the curve
+ * macro by the preprocessor, so the conversion is an index at run time.
+ */
+
+#include "sensor.h"
+
+#include "battery.h"
+
+/* ----------------------  Defines --------------------- */
+#define BATTERY_MV_MIN      (2000)      // Empty, and start of the table
+#define BATTERY_LUT_SHIFT   (5U)
+#define BATTERY_LUT_STEP    (1 << BATTERY_LUT_SHIFT)    // 32 mV
+#define BATTERY_LUT_NUMOF   (33U)       // Up to 3024 mV
+
+/* Discharge curve of a CR2032 at a low drain, piecewise linear: percent at mv */
+#define _SEG(mv, mv0, mv1, p0, p1)  ((p0) + ((mv) - (mv0)) * ((p1) - (p0)) / ((mv1) - (mv0)))
+#define _CURVE(mv) \
+    ((mv) >= 3000 ? 100 : \
+     (mv) >= 2900 ? _SEG(mv, 2900, 3000, 80, 100) : \
+     (mv) >= 2800 ? _SEG(mv, 2800, 2900, 60, 80) : \
+     (mv) >= 2700 ? _SEG(mv, 2700, 2800, 40, 60) : \
+     (mv) >= 2600 ? _SEG(mv, 2600, 2700, 25, 40) : \
+     (mv) >= 2500 ? _SEG(mv, 2500, 2600, 15, 25) : \
+     (mv) >= 2400 ? _SEG(mv, 2400, 2500, 8, 15) : \
+     (mv) >= 2200 ? _SEG(mv, 2200, 2400, 2, 8) : \
+     (mv) >= 2000 ? _SEG(mv, 2000, 2200, 0, 2) : 0)
+
+#define _LUT(i)     _CURVE(BATTERY_MV_MIN + (i) * BATTERY_LUT_STEP)
+#define _LUT4(i)    _LUT(i), _LUT(i + 1), _LUT(i + 2), _LUT(i + 3)
+
+/* ----------------------  Variables --------------------- */
+
+static const uint8_t _lut[BATTERY_LUT_NUMOF] = {
+    _LUT4(0), _LUT4(4), _LUT4(8), _LUT4(12), _LUT4(16), _LUT4(20), _LUT4(24), _LUT4(28),
+    _LUT(32),
+};
+
+static battery_cb_t _cb;
+static int32_t _sum;
+static unsigned _cnt;
+static uint16_t _mv;
+static uint8_t _level;
+static uint8_t _valid;
+
+/* ----------------------  Private  --------------------- */
+
+static uint8_t _percent(uint16_t mv) {
+    if (mv < BATTERY_MV_MIN) {
+        return 0;
+    }
+    unsigned i = (mv - BATTERY_MV_MIN) >> BATTERY_LUT_SHIFT;
+    return (i < BATTERY_LUT_NUMOF) ? _lut[i] : 100;
+}
+
+static void _update(uint16_t mv) {
+    uint8_t level = _percent(mv);
+
+    _mv = mv;
+    /* down at once, up only for a new battery */
+    if (_valid && level < _level + BATTERY_HYST_PCT && level >= _level) {
+        return;
+    }
+    _valid = 1;
+    if (level != _level) {
+        _level = level;
+        if (_cb) {
+            _cb(level);
+        }
+    }
+}
+
+/* ----------------------  Public  --------------------- */
+
+void battery_init(battery_cb_t cb) {
+    _cb = cb;
+}
+
+void battery_push(int16_t raw) {
+    /* the first conversion gives a level at once, the average follows */
+    if (!_valid) {
+        _update(SENSOR_VDD_MV(raw));
+    }
+
+    _sum += raw;
+    if (++_cnt < BATTERY_AVG_NUMOF) {
+        return;
+    }
+    int32_t avg = _sum / (int32_t)BATTERY_AVG_NUMOF;
+    _sum = 0;
+    _cnt = 0;
+    _update(SENSOR_VDD_MV(avg));
+}
+
+uint8_t battery_level(void) {
+    return _level;
+}
+
+uint16_t battery_mv(void) {
+    return _mv;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file
+ * @brief       Battery level from the supply voltage
+ *
+ * The SAADC converts VDD along with the load cells, as one more channel of
+ * the same scan, so the battery costs no extra wake-up. Only one conversion
+ * per block is used, averaged over BATTERY_AVG_NUMOF blocks, and mapped to a
+ * percentage with a table built at compile time from the discharge curve.
+ *
+ * The level only goes up again by BATTERY_HYST_PCT or more (new battery),
+ * so it doesn't flicker with the load on the cell.
+ */
+
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+#ifndef BATTERY_AVG_NUMOF
+#define BATTERY_AVG_NUMOF   (64U)   // Blocks averaged per level update
+#endif
+#define BATTERY_HYST_PCT    (3U)    // Rise needed to report a higher level
+
+/* Called from the sampling event queue when the level changed */
+typedef void (*battery_cb_t)(uint8_t level);
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Level changes go to cb */
+void battery_init(battery_cb_t cb);
+
+/* Add a VDD conversion (raw SAADC counts), one per block */
+void battery_push(int16_t raw);
+
+/* Latest level [%] */
+uint8_t battery_level(void);
+
+/* Latest averaged voltage [mV] */
+uint16_t battery_mv(void);
+
+#endif /* BATTERY_H */
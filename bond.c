@@ -0,0 +1,329 @@
+/**
+ * @file
+ * @brief       Persistent bond and CCCD storage for NimBLE
+ *
+ * The NimBLE host calls the store callbacks from its own thread. They work on
+ * a RAM copy of the store, and every change schedules one flash write in the
+ * application event queue. Posting an event that is already queued is a no-op,
+ * so a pairing that writes several objects ends up in a single page erase.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host/ble_hs.h"
+#include "host/ble_store.h"
+#include "mutex.h"
+
+/* ble_hs_misc_restore_irks() has no public declaration: it comes from the
+ * private header of the NimBLE host (nimble/host/src, see the Makefile), as in
+ * the NimBLE 1.x releases packaged by RIOT. Check it on a package update */
+#include "ble_hs_priv.h"
+
+#include "bond.h"
+#include "prof.h"
+#include "storage.h"
+
+/* ----------------------  Defines --------------------- */
+
+/* Mirror of the flash record */
+typedef struct {
+    ble_addr_t last_peer;       // Identity address of the last bonded central
+    uint8_t last_peer_valid;
+    uint8_t our_sec_num;
+    uint8_t peer_sec_num;
+    uint8_t cccd_num;
+    struct ble_store_value_sec our_sec[BOND_MAX_PEERS];
+    struct ble_store_value_sec peer_sec[BOND_MAX_PEERS];
+    struct ble_store_value_cccd cccd[BOND_MAX_CCCDS];
+} bond_store_t;
+
+/* ----------------------  Variables --------------------- */
+
+static bond_store_t _store;
+static mutex_t _lock = MUTEX_INIT;
+
+static event_queue_t *_eq;
+static event_t _save_evt;
+
+/* ----------------------  Private  --------------------- */
+
+static int _addr_match(const ble_addr_t *key, const ble_addr_t *addr) {
+    return (ble_addr_cmp(key, BLE_ADDR_ANY) == 0) || (ble_addr_cmp(key, addr) == 0);
+}
+
+static int _sec_find(const struct ble_store_value_sec *list, unsigned num,
+                     const struct ble_store_key_sec *key) {
+    unsigned skipped = 0;
+
+    for (unsigned i = 0; i < num; i++) {
+        if (!_addr_match(&key->peer_addr, &list[i].peer_addr)) {
+            continue;
+        }
+        /* legacy pairing: the LTK is looked up by its EDIV and Rand */
+        if (key->ediv_rand_present &&
+            (list[i].ediv != key->ediv || list[i].rand_num != key->rand_num)) {
+            continue;
+        }
+        if (skipped < key->idx) {
+            skipped++;
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
+static int _cccd_find(const struct ble_store_key_cccd *key) {
+    unsigned skipped = 0;
+
+    for (unsigned i = 0; i < _store.cccd_num; i++) {
+        if (!_addr_match(&key->peer_addr, &_store.cccd[i].peer_addr)) {
+            continue;
+        }
+        if (key->chr_val_handle != 0 && key->chr_val_handle != _store.cccd[i].chr_val_handle) {
+            continue;
+        }
+        if (skipped < key->idx) {
+            skipped++;
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
+static int _sec_write(struct ble_store_value_sec *list, uint8_t *num,
+                      const struct ble_store_value_sec *val) {
+    struct ble_store_key_sec key;
+
+    ble_store_key_from_value_sec(&key, val);
+    int i = _sec_find(list, *num, &key);
+    if (i < 0) {
+        if (*num >= BOND_MAX_PEERS) {
+            return BLE_HS_ESTORE_CAP;
+        }
+        i = (*num)++;
+    }
+    list[i] = *val;
+    return 0;
+}
+
+static int _cccd_write(const struct ble_store_value_cccd *val) {
+    struct ble_store_key_cccd key;
+
+    ble_store_key_from_value_cccd(&key, val);
+    int i = _cccd_find(&key);
+    if (i < 0) {
+        if (_store.cccd_num >= BOND_MAX_CCCDS) {
+            return BLE_HS_ESTORE_CAP;
+        }
+        i = _store.cccd_num++;
+    }
+    _store.cccd[i] = *val;
+    return 0;
+}
+
+static int _store_read(int obj_type, const union ble_store_key *key,
+                       union ble_store_value *dst) {
+    int i;
+    int rc = 0;
+
+    mutex_lock(&_lock);
+    switch (obj_type) {
+    case BLE_STORE_OBJ_TYPE_OUR_SEC:
+        i = _sec_find(_store.our_sec, _store.our_sec_num, &key->sec);
+        if (i >= 0) {
+            dst->sec = _store.our_sec[i];
+        }
+        break;
+    case BLE_STORE_OBJ_TYPE_PEER_SEC:
+        i = _sec_find(_store.peer_sec, _store.peer_sec_num, &key->sec);
+        if (i >= 0) {
+            dst->sec = _store.peer_sec[i];
+        }
+        break;
+    case BLE_STORE_OBJ_TYPE_CCCD:
+        i = _cccd_find(&key->cccd);
+        if (i >= 0) {
+            dst->cccd = _store.cccd[i];
+        }
+        break;
+    default:
+        i = 0;
+        rc = BLE_HS_ENOTSUP;
+        break;
+    }
+    mutex_unlock(&_lock);
+
+    return (i < 0) ? BLE_HS_ENOENT : rc;
+}
+
+static int _store_write(int obj_type, const union ble_store_value *val) {
+    int rc;
+
+    mutex_lock(&_lock);
+    switch (obj_type) {
+    case BLE_STORE_OBJ_TYPE_OUR_SEC:
+        rc = _sec_write(_store.our_sec, &_store.our_sec_num, &val->sec);
+        break;
+    case BLE_STORE_OBJ_TYPE_PEER_SEC:
+        rc = _sec_write(_store.peer_sec, &_store.peer_sec_num, &val->sec);
+        break;
+    case BLE_STORE_OBJ_TYPE_CCCD:
+        rc = _cccd_write(&val->cccd);
+        break;
+    default:
+        rc = BLE_HS_ENOTSUP;
+        break;
+    }
+    mutex_unlock(&_lock);
+
+    if (rc == 0) {
+        event_post(_eq, &_save_evt);
+    }
+    return rc;
+}
+
+static int _store_delete(int obj_type, const union ble_store_key *key) {
+    void *list;
+    uint8_t *num;
+    size_t size;
+    int i;
+
+    mutex_lock(&_lock);
+    switch (obj_type) {
+    case BLE_STORE_OBJ_TYPE_OUR_SEC:
+        list = _store.our_sec;
+        num = &_store.our_sec_num;
+        size = sizeof(_store.our_sec[0]);
+        i = _sec_find(_store.our_sec, *num, &key->sec);
+        break;
+    case BLE_STORE_OBJ_TYPE_PEER_SEC:
+        list = _store.peer_sec;
+        num = &_store.peer_sec_num;
+        size = sizeof(_store.peer_sec[0]);
+        i = _sec_find(_store.peer_sec, *num, &key->sec);
+        if (i >= 0 && _store.last_peer_valid &&
+            ble_addr_cmp(&_store.last_peer, &_store.peer_sec[i].peer_addr) == 0) {
+            _store.last_peer_valid = 0;
+        }
+        break;
+    case BLE_STORE_OBJ_TYPE_CCCD:
+        list = _store.cccd;
+        num = &_store.cccd_num;
+        size = sizeof(_store.cccd[0]);
+        i = _cccd_find(&key->cccd);
+        break;
+    default:
+        mutex_unlock(&_lock);
+        return BLE_HS_ENOTSUP;
+    }
+
+    if (i >= 0) {
+        /* keep the list packed, order doesn't matter */
+        (*num)--;
+        memmove((uint8_t *)list + i * size, (uint8_t *)list + *num * size, size);
+    }
+    mutex_unlock(&_lock);
+
+    if (i < 0) {
+        return BLE_HS_ENOENT;
+    }
+    event_post(_eq, &_save_evt);
+    return 0;
+}
+
+static void _save(event_t *e) {
+    (void)e;
+    static bond_store_t store;
+
+    /* the flash write takes tens of ms: the host thread only waits for the
+     * copy, not for the write */
+    mutex_lock(&_lock);
+    memcpy(&store, &_store, sizeof(store));
+    mutex_unlock(&_lock);
+
+    int res = storage_save(STORAGE_SLOT_BOND, &store, sizeof(store));
+    printf("[BOND] store saved (%d), %u bonds, %u subscriptions\n", res,
+           (unsigned)store.peer_sec_num, (unsigned)store.cccd_num);
+}
+
+/* ----------------------  Public  --------------------- */
+
+void bond_init(event_queue_t *eq) {
+    _eq = eq;
+    _save_evt.handler = _save;
+    PROF_EVENT_NAME(&_save_evt, "bond save");
+
+    if (storage_load(STORAGE_SLOT_BOND, &_store, sizeof(_store)) != 0) {
+        memset(&_store, 0, sizeof(_store));
+    }
+    printf("[BOND] %u bonds restored\n", (unsigned)_store.peer_sec_num);
+
+    /* pair once, bond, and reuse the keys on every reconnect */
+    ble_hs_cfg.store_read_cb = _store_read;
+    ble_hs_cfg.store_write_cb = _store_write;
+    ble_hs_cfg.store_delete_cb = _store_delete;
+    ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
+    ble_hs_cfg.sm_io_cap = BLE_SM_IO_CAP_NO_IO;
+    ble_hs_cfg.sm_bonding = 1;
+    ble_hs_cfg.sm_sc = 1;
+    ble_hs_cfg.sm_our_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+
+    /* the host only restores the IRKs of the bonded peers into the resolving
+     * list on sync, which may have happened before our store was hooked in */
+    ble_hs_misc_restore_irks();
+}
+
+const ble_addr_t *bond_last_peer(void) {
+    return _store.last_peer_valid ? &_store.last_peer : NULL;
+}
+
+void bond_connected(uint16_t conn_handle) {
+    struct ble_gap_conn_desc desc;
+    struct ble_store_key_sec key = { .idx = 0 };
+
+    if (ble_gap_conn_find(conn_handle, &desc) != 0) {
+        return;
+    }
+
+    key.peer_addr = desc.peer_id_addr;
+    mutex_lock(&_lock);
+    int known = _sec_find(_store.peer_sec, _store.peer_sec_num, &key) >= 0;
+    mutex_unlock(&_lock);
+
+    /* the stored subscriptions are restored once the link is encrypted */
+    if (known) {
+        ble_gap_security_initiate(conn_handle);
+    }
+}
+
+void bond_encrypted(uint16_t conn_handle) {
+    struct ble_gap_conn_desc desc;
+
+    if (ble_gap_conn_find(conn_handle, &desc) != 0 || !desc.sec_state.bonded) {
+        return;
+    }
+
+    mutex_lock(&_lock);
+    int changed = !_store.last_peer_valid ||
+                  ble_addr_cmp(&_store.last_peer, &desc.peer_id_addr) != 0;
+    _store.last_peer = desc.peer_id_addr;
+    _store.last_peer_valid = 1;
+    mutex_unlock(&_lock);
+
+    if (changed) {
+        event_post(_eq, &_save_evt);
+    }
+}
+
+void bond_clear(void) {
+    mutex_lock(&_lock);
+    memset(&_store, 0, sizeof(_store));
+    mutex_unlock(&_lock);
+
+    event_post(_eq, &_save_evt);
+    puts("[BOND] every bond and subscription deleted");
+}
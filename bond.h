@@ -0,0 +1,45 @@
+/**
+ * @file
+ * @brief       Persistent bond and CCCD storage for NimBLE
+ *
+ * Replaces the RAM store of the NimBLE host with one that is mirrored to
+ * flash. Keys and client subscriptions survive reboots and reconnects, so a
+ * known central doesn't have to pair or rewrite the CCCD again. The identity
+ * address of the last bonded central is kept too, to reconnect to it with
+ * directed advertising.
+ */
+
+#ifndef BOND_H
+#define BOND_H
+
+#include "event.h"
+#include "host/ble_hs.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef BOND_MAX_PEERS
+#define BOND_MAX_PEERS      (2U)    // Bonded centrals remembered
+#endif
+#ifndef BOND_MAX_CCCDS
+#define BOND_MAX_CCCDS      (8U)    // Subscriptions remembered, over all centrals
+#endif
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Load the bonds from flash and hook the store into the NimBLE host.
+ * Flash writes are deferred to the given event queue */
+void bond_init(event_queue_t *eq);
+
+/* Identity address of the last bonded central, NULL if there is none */
+const ble_addr_t *bond_last_peer(void);
+
+/* A central connected: if it's bonded, ask it to restore encryption right away */
+void bond_connected(uint16_t conn_handle);
+
+/* Encryption came up on a connection: remember its central as the last peer */
+void bond_encrypted(uint16_t conn_handle);
+
+/* Delete every bond and subscription, the "bond clear" shell command. The
+ * centrals have to pair again */
+void bond_clear(void);
+
+#endif /* BOND_H */
@@ -0,0 +1,44 @@
+/**
+ * @file
+ * @brief       Boot timeline recorder
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ztimer.h"
+
+#include "boot.h"
+
+/* ----------------------  Variables --------------------- */
+
+static struct {
+    const char *name;
+    uint32_t us;
+} _marks[BOOT_PHASES_MAX];
+
+static unsigned _numof;
+
+/* ----------------------  Public  --------------------- */
+
+void boot_mark(const char *name) {
+    /* ZTIMER_USEC counts from its init in auto_init, right before main() */
+    uint32_t now = ztimer_now(ZTIMER_USEC);
+
+    if (_numof < BOOT_PHASES_MAX) {
+        _marks[_numof].name = name;
+        _marks[_numof].us = now;
+        _numof++;
+    }
+}
+
+void boot_print(void) {
+    uint32_t prev = 0;
+
+    puts("   time [us]   phase [us]  phase");
+    for (unsigned i = 0; i < _numof; i++) {
+        printf("%12lu %12lu  %s\n", (unsigned long)_marks[i].us,
+               (unsigned long)(_marks[i].us - prev), _marks[i].name);
+        prev = _marks[i].us;
+    }
+}
@@ -0,0 +1,25 @@
+/**
+ * @file
+ * @brief       Boot timeline recorder
+ *
+ * Timestamps the init phases from the start of main() on, to see where the
+ * time goes between power-on and the first advertising packet.
+ */
+
+#ifndef BOOT_H
+#define BOOT_H
+
+/* ----------------------  Defines --------------------- */
+#ifndef BOOT_PHASES_MAX
+#define BOOT_PHASES_MAX     (16U)   // Marks kept, later ones are dropped
+#endif
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Record the end of an init phase. name must be a string literal */
+void boot_mark(const char *name);
+
+/* Print the timeline, with the time of every phase */
+void boot_print(void);
+
+#endif /* BOOT_H */
@@ -0,0 +1,181 @@
+/**
+ * @file
+ * @brief       Connectionless weight broadcast through the advertising data
+ *
+ * nimble_autoadv owns the connectable advertising. Every time it (re)starts,
+ * it loads its own AD buffer (flags + name + service UUID). broadcast_update()
+ * then overwrites the advertising data on the fly, moving the device name to
+ * the scan response to make room for the manufacturer specific field.
+ * Updating the data doesn't restart advertising, so scanners see the new
+ * value on the next advertising event.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "host/ble_gap.h"
+#include "host/ble_hs.h"
+#include "net/bluetil/ad.h"
+#include "nimble_riot.h"
+
+#include "broadcast.h"
+#include "gatt_svcs.h"
+
+/* ----------------------  Defines --------------------- */
+#define BROADCAST_AD_BUF_SIZE   (31U)       // Maximum legacy advertising payload
+
+#if MYNEWT_VAL(BLE_PERIODIC_ADV) && (MYNEWT_VAL(BLE_MULTI_ADV_INSTANCES) > 0)
+#define BROADCAST_PERIODIC      (1)
+#define BROADCAST_INSTANCE      (1U)        // autoadv uses instance 0
+#define BROADCAST_SID           (1U)
+#endif
+
+/* ----------------------  Variables --------------------- */
+
+static broadcast_payload_t _payload = {
+    .company_id = BROADCAST_COMPANY_ID,
+    .version = BROADCAST_VERSION,
+};
+
+static uint8_t _ad_buf[BROADCAST_AD_BUF_SIZE];
+static uint8_t _rsp_buf[BROADCAST_AD_BUF_SIZE];
+static bluetil_ad_t _ad;
+static bluetil_ad_t _rsp;
+
+static uint8_t _rsp_pending;    // The scan response has to be loaded after every advertising restart
+static uint8_t _connected;      // Non-connectable advertising is running
+
+/* ----------------------  Private  --------------------- */
+
+static void _build_ad(void) {
+    uint16_t uuid = BLE_GATT_SVC_WSS;
+
+    bluetil_ad_init_with_flags(&_ad, _ad_buf, sizeof(_ad_buf), BLUETIL_AD_FLAGS_DEFAULT);
+    bluetil_ad_add(&_ad, BLE_GAP_AD_UUID16_INCOMP, &uuid, sizeof(uuid));
+    bluetil_ad_add(&_ad, BLE_GAP_AD_VENDOR, &_payload, sizeof(_payload));
+}
+
+#if MYNEWT_VAL(BLE_EXT_ADV)
+static int _set_ext_data(uint8_t instance, const uint8_t *data, size_t len, int rsp) {
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, len);
+    if (om == NULL) {
+        return BLE_HS_ENOMEM;
+    }
+    return rsp ? ble_gap_ext_adv_rsp_set_data(instance, om)
+               : ble_gap_ext_adv_set_data(instance, om);
+}
+#endif
+
+static void _set_adv_data(void) {
+#if MYNEWT_VAL(BLE_EXT_ADV)
+    if (_rsp_pending && _set_ext_data(0, _rsp.buf, _rsp.pos, 1) == 0) {
+        _rsp_pending = 0;
+    }
+    _set_ext_data(0, _ad.buf, _ad.pos, 0);
+#else
+    if (_rsp_pending && ble_gap_adv_rsp_set_data(_rsp.buf, _rsp.pos) == 0) {
+        _rsp_pending = 0;
+    }
+    ble_gap_adv_set_data(_ad.buf, _ad.pos);
+#endif
+
+#ifdef BROADCAST_PERIODIC
+    /* periodic advertising has no flags field, only the manufacturer data */
+    uint8_t buf[sizeof(_payload) + 2];
+    buf[0] = sizeof(_payload) + 1;
+    buf[1] = BLE_GAP_AD_VENDOR;
+    memcpy(&buf[2], &_payload, sizeof(_payload));
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(buf, sizeof(buf));
+    if (om != NULL) {
+        ble_gap_periodic_adv_set_data(BROADCAST_INSTANCE, om);
+    }
+#endif
+}
+
+#ifdef BROADCAST_PERIODIC
+static void _periodic_start(void) {
+    struct ble_gap_ext_adv_params params = { 0 };
+    struct ble_gap_periodic_adv_params pparams = { 0 };
+
+    /* periodic advertising requires a non-connectable, non-scannable set */
+    params.own_addr_type = nimble_riot_own_addr_type;
+    params.primary_phy = BLE_HCI_LE_PHY_1M;
+    params.secondary_phy = BLE_HCI_LE_PHY_1M;
+    params.sid = BROADCAST_SID;
+    params.itvl_min = BLE_GAP_ADV_ITVL_MS(BROADCAST_ITVL_MS * 4);
+    params.itvl_max = BLE_GAP_ADV_ITVL_MS(BROADCAST_ITVL_MS * 4);
+
+    pparams.itvl_min = BLE_GAP_PERIODIC_ITVL_MS(BROADCAST_ITVL_MS);
+    pparams.itvl_max = BLE_GAP_PERIODIC_ITVL_MS(BROADCAST_ITVL_MS);
+
+    int rc = ble_gap_ext_adv_configure(BROADCAST_INSTANCE, &params, NULL, NULL, NULL);
+    if (rc == 0) {
+        rc = ble_gap_periodic_adv_configure(BROADCAST_INSTANCE, &pparams);
+    }
+    if (rc == 0) {
+        rc = ble_gap_periodic_adv_start(BROADCAST_INSTANCE);
+    }
+    if (rc == 0) {
+        rc = ble_gap_ext_adv_start(BROADCAST_INSTANCE, 0, 0);
+    }
+    if (rc != 0) {
+        printf("[BROADCAST] periodic advertising not started (%d)\n", rc);
+    }
+}
+#endif
+
+/* ----------------------  Public  --------------------- */
+
+void broadcast_init(void) {
+    bluetil_ad_init(&_rsp, _rsp_buf, sizeof(_rsp_buf));
+    bluetil_ad_add_name(&_rsp, CONFIG_NIMBLE_AUTOADV_DEVICE_NAME);
+    _rsp_pending = 1;
+
+    _build_ad();
+
+#ifdef BROADCAST_PERIODIC
+    _periodic_start();
+#endif
+}
+
+void broadcast_update(int32_t weight, broadcast_state_t state) {
+    _payload.seq++;
+    _payload.state = (uint8_t)state;
+    /* both hands together may not fit the int16 field */
+    _payload.weight = (weight > INT16_MAX) ? INT16_MAX
+                    : (weight < INT16_MIN) ? INT16_MIN : (int16_t)weight;
+
+    /* only the payload bytes change, the AD structure keeps its layout */
+    _build_ad();
+    _set_adv_data();
+}
+
+void broadcast_connected(void) {
+#if !MYNEWT_VAL(BLE_EXT_ADV)
+    /* autoadv stops advertising on connection, keep the scanners fed */
+    struct ble_gap_adv_params params = { 0 };
+    params.conn_mode = BLE_GAP_CONN_MODE_NON;
+    params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    params.itvl_min = BLE_GAP_ADV_ITVL_MS(BROADCAST_ITVL_MS);
+    params.itvl_max = BLE_GAP_ADV_ITVL_MS(BROADCAST_ITVL_MS);
+
+    _rsp_pending = 1;
+    _set_adv_data();
+    if (ble_gap_adv_start(nimble_riot_own_addr_type, NULL, BLE_HS_FOREVER,
+                          &params, NULL, NULL) == 0) {
+        _connected = 1;
+    }
+#endif
+}
+
+void broadcast_disconnected(void) {
+    if (_connected) {
+        ble_gap_adv_stop();
+        _connected = 0;
+    }
+    broadcast_adv_restarted();
+}
+
+void broadcast_adv_restarted(void) {
+    _rsp_pending = 1;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file
+ * @brief       Connectionless weight broadcast through the advertising data
+ *
+ * The latest weight, a sequence counter and the session state are packed into
+ * a manufacturer specific AD field. Any number of scanners can follow the
+ * board without opening a connection. When the controller supports BLE 5
+ * periodic advertising the same payload is also sent on a periodic train, so
+ * synchronized scanners don't have to keep scanning.
+ */
+
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+#define BROADCAST_COMPANY_ID    (0xFFFF)    // Bluetooth SIG ID reserved for testing
+#define BROADCAST_VERSION       (1U)        // Layout version of broadcast_payload_t
+
+#ifndef BROADCAST_ITVL_MS
+#define BROADCAST_ITVL_MS       (100U)      // Interval of the non-connectable advertising
+#endif
+
+/* Session state reported in the broadcast */
+typedef enum {
+    BROADCAST_STATE_IDLE = 0,   // Nobody is hanging from the board
+    BROADCAST_STATE_HANG = 1,   // Load above the hang threshold
+} broadcast_state_t;
+
+/* Manufacturer specific data, as it goes on air (little endian) */
+typedef struct __attribute__((packed)) {
+    uint16_t company_id;
+    uint8_t version;
+    uint8_t seq;        // Incremented on every update, lets scanners drop duplicates
+    uint8_t state;      // One of broadcast_state_t
+    int16_t weight;     // Same unit as the notified value
+} broadcast_payload_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Prepare the scan response and start the periodic advertising train (if available) */
+void broadcast_init(void);
+
+/* Push a new weight [0.01 kg] into the advertising data, without restarting
+ * advertising. Saturated to the int16 of the payload */
+void broadcast_update(int32_t weight, broadcast_state_t state);
+
+/* Keep broadcasting with non-connectable advertising while a central is connected */
+void broadcast_connected(void);
+
+/* Stop the non-connectable advertising, so autoadv can advertise connectable again */
+void broadcast_disconnected(void);
+
+/* autoadv reloaded its own advertising data, the scan response has to be set again */
+void broadcast_adv_restarted(void);
+
+#endif /* BROADCAST_H */
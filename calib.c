@@ -0,0 +1,262 @@
+/**
+ * @file
+ * @brief       Tare and multi-point calibration of the load cell
+ *
+ * The control characteristic and the shell run in other threads than the
+ * sampling. They only queue a command, which is handled in the sampling event
+ * queue, so the table never changes in the middle of a sample. The flash
+ * write is left to the housekeeping queue, on a copy of the tables.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "irq.h"
+#include "prof.h"
+#include "storage.h"
+
+#include "calib.h"
+
+/* ----------------------  Defines --------------------- */
+#define CALIB_AVG_SHIFT     (3U)    // Raw average over ~8 samples, for tare and points
+#define CALIB_AVG_FRAC      (4U)    // Fractional bits of the raw average
+
+/* Flash record */
+typedef struct {
+    uint16_t segments;
+    uint16_t tared;             // tare_raw holds a tare
+    int32_t tare_raw;           // Raw level of the tare
+    int32_t tare;               // tare_raw through the table, fine units
+    calib_segment_t seg[CALIB_POINTS_MAX - 1];
+} calib_table_t;
+
+/* ----------------------  Variables --------------------- */
+
+static calib_table_t _tables[SENSOR_CHANNELS];
+static int32_t _raw_avg[SENSOR_CHANNELS];   // Smoothed raw, CALIB_AVG_FRAC fractional bits
+
+// Running calibration
+static struct {
+    int32_t raw;
+    int32_t weight;
+} _points[CALIB_POINTS_MAX];
+static unsigned _points_numof;
+static uint8_t _calibrating;
+static uint8_t _channel;        // Channel being calibrated
+
+// Pending command
+static event_queue_t *_eq;
+static event_queue_t *_io_eq;
+static event_t _cmd_evt;
+static event_t _save_evt;
+static volatile uint8_t _cmd_busy;
+static calib_op_t _cmd_op;
+static int32_t _cmd_arg;
+static int8_t _cmd_result;
+
+/* ----------------------  Private  --------------------- */
+
+static int32_t _map(const calib_table_t *table, int32_t raw) {
+    const calib_segment_t *seg = &table->seg[0];
+
+    /* few segments, a linear scan is the fastest. The ends extrapolate */
+    for (unsigned i = 1; i < table->segments && raw >= table->seg[i].raw; i++) {
+        seg = &table->seg[i];
+    }
+    return seg->weight * (1L << CALIB_FRAC_BITS) +
+           (int32_t)(((int64_t)(raw - seg->raw) * seg->slope) >> (CALIB_SHIFT - CALIB_FRAC_BITS));
+}
+
+static int32_t _raw_now(unsigned channel) {
+    return _raw_avg[channel] >> CALIB_AVG_FRAC;
+}
+
+static void _identity(calib_table_t *table) {
+    /* identity until the board is calibrated */
+    memset(table, 0, sizeof(*table));
+    table->segments = 1;
+    table->seg[0].slope = 1L << CALIB_SHIFT;
+}
+
+static int _build(void) {
+    if (_points_numof < 2) {
+        return -EINVAL;
+    }
+
+    /* sort the points by raw value, insertion sort on a handful of points */
+    for (unsigned i = 1; i < _points_numof; i++) {
+        for (unsigned j = i; j > 0 && _points[j].raw < _points[j - 1].raw; j--) {
+            int32_t raw = _points[j].raw, weight = _points[j].weight;
+            _points[j] = _points[j - 1];
+            _points[j - 1].raw = raw;
+            _points[j - 1].weight = weight;
+        }
+    }
+
+    /* the tare stays at the same raw level, through the new table */
+    const calib_table_t *old = &_tables[_channel];
+    calib_table_t table = {
+        .segments = _points_numof - 1,
+        .tared = old->tared,
+        .tare_raw = old->tare_raw,
+    };
+    for (unsigned i = 0; i < table.segments; i++) {
+        int32_t draw = _points[i + 1].raw - _points[i].raw;
+        if (draw == 0) {
+            return -EINVAL;     // two points at the same load
+        }
+        table.seg[i].raw = _points[i].raw;
+        table.seg[i].weight = _points[i].weight;
+        table.seg[i].slope = (int32_t)(((int64_t)(_points[i + 1].weight - _points[i].weight)
+                                        << CALIB_SHIFT) / draw);
+    }
+    if (table.tared) {
+        table.tare = _map(&table, table.tare_raw);
+    }
+
+    _tables[_channel] = table;
+    return 0;
+}
+
+static void _save(event_t *e) {
+    (void)e;
+    static calib_table_t tables[SENSOR_CHANNELS];
+
+    /* the sampling thread has the higher priority, it can't change the
+     * tables in the middle of the copy with the interrupts off */
+    unsigned state = irq_disable();
+    memcpy(tables, _tables, sizeof(tables));
+    irq_restore(state);
+
+    int res = storage_save(STORAGE_SLOT_CALIB, tables, sizeof(tables));
+    printf("[CALIB] table saved (%d)\n", res);
+}
+
+static void _handle_cmd(event_t *e) {
+    (void)e;
+    int res = 0;
+
+    switch (_cmd_op) {
+    case CALIB_OP_TARE:
+        for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            _tables[ch].tared = 1;
+            _tables[ch].tare_raw = _raw_now(ch);
+            _tables[ch].tare = _map(&_tables[ch], _tables[ch].tare_raw);
+            printf("[CALIB] channel %u: tare %ld\n", ch,
+                   (long)(_tables[ch].tare >> CALIB_FRAC_BITS));
+        }
+        break;
+    case CALIB_OP_BEGIN:
+        _calibrating = 1;
+        _channel = _cmd_arg;
+        _points_numof = 0;
+        printf("[CALIB] calibration of channel %u started\n", _channel);
+        break;
+    case CALIB_OP_POINT:
+        if (!_calibrating || _points_numof >= CALIB_POINTS_MAX) {
+            res = -EINVAL;
+            break;
+        }
+        _points[_points_numof].raw = _raw_now(_channel);
+        _points[_points_numof].weight = _cmd_arg;
+        printf("[CALIB] point %u: raw %ld = %ld\n", _points_numof,
+               (long)_points[_points_numof].raw, (long)_cmd_arg);
+        _points_numof++;
+        break;
+    case CALIB_OP_COMMIT:
+        res = _calibrating ? _build() : -EINVAL;
+        if (res == 0) {
+            printf("[CALIB] channel %u: %u segments\n", _channel,
+                   (unsigned)_tables[_channel].segments);
+        }
+        _calibrating = 0;
+        break;
+    case CALIB_OP_ABORT:
+        _calibrating = 0;
+        break;
+    }
+
+    if (res != 0) {
+        printf("[CALIB] command 0x%02x failed (%d)\n", _cmd_op, res);
+    }
+    else if (_cmd_op == CALIB_OP_TARE || _cmd_op == CALIB_OP_COMMIT) {
+        event_post(_io_eq, &_save_evt);
+    }
+    _cmd_result = res;
+    _cmd_busy = 0;
+}
+
+/* ----------------------  Public  --------------------- */
+
+void calib_init(event_queue_t *eq, event_queue_t *io_eq) {
+    _eq = eq;
+    _io_eq = io_eq;
+    _cmd_evt.handler = _handle_cmd;
+    _save_evt.handler = _save;
+    PROF_EVENT_NAME(&_cmd_evt, "calib command");
+    PROF_EVENT_NAME(&_save_evt, "calib save");
+
+    if (storage_load(STORAGE_SLOT_CALIB, _tables, sizeof(_tables)) != 0) {
+        memset(_tables, 0, sizeof(_tables));
+    }
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        if (_tables[ch].segments == 0 || _tables[ch].segments >= CALIB_POINTS_MAX) {
+            _identity(&_tables[ch]);
+        }
+    }
+}
+
+int32_t calib_apply(unsigned channel, int32_t raw) {
+    _raw_avg[channel] += (raw * (1L << CALIB_AVG_FRAC) - _raw_avg[channel]) >> CALIB_AVG_SHIFT;
+
+    return _map(&_tables[channel], raw) - _tables[channel].tare;
+}
+
+int calib_command(calib_op_t op, int32_t arg) {
+    /* refused right away, the client gets an ATT error */
+    if (op < CALIB_OP_TARE || op > CALIB_OP_ABORT ||
+        (op == CALIB_OP_BEGIN && (arg < 0 || arg >= (int32_t)SENSOR_CHANNELS))) {
+        return -EINVAL;
+    }
+    if (_eq == NULL) {
+        return -EAGAIN;     // the tables are loaded by the deferred init
+    }
+
+    /* called from the NimBLE host and from the shell thread */
+    unsigned state = irq_disable();
+    if (_cmd_busy) {
+        irq_restore(state);
+        return -EBUSY;
+    }
+    _cmd_busy = 1;
+    irq_restore(state);
+
+    _cmd_op = op;
+    _cmd_arg = arg;
+    event_post(_eq, &_cmd_evt);
+    return 0;
+}
+
+void calib_status(calib_status_t *status) {
+    status->channel = _channel;
+    status->segments = _tables[_channel].segments;
+    status->points = _points_numof;
+    status->busy = _cmd_busy;
+    status->tare = _tables[_channel].tare >> CALIB_FRAC_BITS;
+    status->result = _cmd_result;
+}
+
+void calib_print(void) {
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        const calib_table_t *table = &_tables[ch];
+
+        printf("channel %u: tare %ld/%u, raw %ld\n", ch, (long)table->tare,
+               1U << CALIB_FRAC_BITS, (long)_raw_now(ch));
+        puts("segment        raw     weight  slope [1/65536]");
+        for (unsigned i = 0; i < table->segments; i++) {
+            printf("%7u %10ld %10ld  %ld\n", i, (long)table->seg[i].raw,
+                   (long)table->seg[i].weight, (long)table->seg[i].slope);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/**
+ * @file
+ * @brief       Tare and multi-point calibration of the load cell
+ *
+ * The raw counts of the sensor are mapped to weight with a piecewise-linear
+ * table built from 2 to CALIB_POINTS_MAX reference points. All divisions
+ * happen when the table is built: every segment keeps its start point and a
+ * fixed-point slope, so a sample costs one multiply and one shift.
+ *
+ * Every channel (load cell) has its own table and tare. A calibration works on
+ * one channel, picked when it begins; the tare zeroes all of them. The tare is
+ * kept as the raw level it was taken at, so a new table still reads it as zero.
+ *
+ * Reference weights are in 0.01 kg. The mapped samples carry CALIB_FRAC_BITS
+ * more bits of resolution ("fine" units), for the clients that want the full
+ * precision of the sensor.
+ */
+
+#ifndef CALIB_H
+#define CALIB_H
+
+#include <stdint.h>
+
+#include "event.h"
+#include "sensor.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef CALIB_POINTS_MAX
+#define CALIB_POINTS_MAX    (4U)    // Reference points of the piecewise-linear table
+#endif
+#define CALIB_SHIFT         (16U)   // Fractional bits of the segment slopes
+#define CALIB_FRAC_BITS     (8U)    // Fractional bits of the mapped samples, below 0.01 kg
+
+/* Mapped sample back to 0.01 kg, saturated to int16 */
+static inline int16_t calib_coarse(int32_t sample) {
+    sample >>= CALIB_FRAC_BITS;
+    if (sample > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (sample < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return (int16_t)sample;
+}
+
+/* Commands of the control characteristic and of the shell. The argument is
+ * the channel to calibrate for CALIB_OP_BEGIN, and the reference weight on
+ * that channel for CALIB_OP_POINT */
+typedef enum {
+    CALIB_OP_TARE = 0x01,       // Current load reads as zero
+    CALIB_OP_BEGIN = 0x02,      // Start collecting reference points for a channel
+    CALIB_OP_POINT = 0x03,      // Current load is the given weight
+    CALIB_OP_COMMIT = 0x04,     // Build the table from the points and store it
+    CALIB_OP_ABORT = 0x05,      // Drop the points, keep the current table
+} calib_op_t;
+
+/* One segment of the table: weight = weight + ((raw - raw) * slope) >> CALIB_SHIFT */
+typedef struct {
+    int32_t raw;
+    int32_t weight;
+    int32_t slope;
+} calib_segment_t;
+
+/* Status, as read from the control characteristic */
+typedef struct __attribute__((packed)) {
+    uint8_t channel;        // Channel of the last calibration
+    uint8_t segments;       // Segments of the table of that channel
+    uint8_t points;         // Points collected by a running calibration
+    uint8_t busy;           // A command is waiting to be handled
+    int32_t tare;           // Weight subtracted by the tare on that channel [0.01 kg]
+    int8_t result;          // Of the last command handled: 0, or a negative errno
+} calib_status_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Load the table from flash (identity if there is none). Commands are handled
+ * in eq, the one running the sampling, flash writes in io_eq. Call before the
+ * sampling starts */
+void calib_init(event_queue_t *eq, event_queue_t *io_eq);
+
+/* Map a raw sample to weight, in 0.01 kg with CALIB_FRAC_BITS fractional bits.
+ * Only call from the sampling event queue */
+int32_t calib_apply(unsigned channel, int32_t raw);
+
+/* Queue a command. Returns 0, -EINVAL for an unknown command or channel,
+ * -EBUSY while the previous one is pending, -EAGAIN before calib_init(). The
+ * outcome of a queued command is the result of the status */
+int calib_command(calib_op_t op, int32_t arg);
+
+/* Current status */
+void calib_status(calib_status_t *status);
+
+/* Print the tables */
+void calib_print(void);
+
+#endif /* CALIB_H */
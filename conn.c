@@ -0,0 +1,106 @@
+/**
+ * @file
+ * @brief       State of the connection served by the notifications
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "irq.h"
+
+#include "pool.h"
+#include "power.h"
+#include "prof.h"
+#include "stream.h"
+
+#include "conn.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef MEM_CONN_NUMOF
+#define MEM_CONN_NUMOF      (1U)     // Connections with a state
+#endif
+
+/* _conn tracks one connection: a second block would only hold a state that
+ * no notification ever reads */
+static_assert(MEM_CONN_NUMOF == 1, "a single connection is served");
+
+/* ----------------------  Variables --------------------- */
+
+POOL_DEFINE(_conn_pool, "conn", sizeof(conn_t), MEM_CONN_NUMOF);
+static conn_t _no_conn;
+static conn_t *_conn = &_no_conn;
+
+// Blocks of the closed connections, freed by the sampling thread once it is
+// done with them
+static event_queue_t *_conn_eq;
+static event_t _conn_free_evt;
+static conn_t *_conn_retired[MEM_CONN_NUMOF];
+static unsigned _conn_retired_numof;
+
+/* ----------------------  Private  --------------------- */
+
+/* In the sampling thread: no frame in progress holds a retired connection */
+static void _free_conns(event_t *e) {
+    (void)e;
+
+    unsigned state = irq_disable();
+    while (_conn_retired_numof > 0) {
+        pool_free(&_conn_pool, _conn_retired[--_conn_retired_numof]);
+    }
+    irq_restore(state);
+}
+
+/* ----------------------  Public  --------------------- */
+
+void conn_init(event_queue_t *eq) {
+    _conn_eq = eq;
+    _conn_free_evt.handler = _free_conns;
+    PROF_EVENT_NAME(&_conn_free_evt, "conn free");
+    pool_init(&_conn_pool);
+}
+
+conn_t *conn_open(uint16_t handle) {
+    conn_t *conn = pool_alloc(&_conn_pool);
+
+    if (conn == NULL) {
+        /* no room for its state, better refused than half served */
+        printf("[CONN] connection %u refused, no state left\n", handle);
+        return NULL;
+    }
+    memset(conn, 0, sizeof(*conn));
+    conn->handle = handle;
+    _conn = conn;
+    power_hold(POWER_HOLD_CONNECTED);
+    return conn;
+}
+
+int conn_close(uint16_t handle) {
+    conn_t *conn = _conn;
+
+    if (conn == &_no_conn || conn->handle != handle) {
+        return 0;
+    }
+    /* the sampling sees no subscription from here on, but may still be in a
+     * frame with the old pointer: the block is freed after it */
+    _conn = &_no_conn;
+    unsigned state = irq_disable();
+    _conn_retired[_conn_retired_numof++] = conn;
+    irq_restore(state);
+    event_post(_conn_eq, &_conn_free_evt);
+    stream_set_payload(STREAM_PAYLOAD_MIN);
+    power_release(POWER_HOLD_CONNECTED);
+    return 1;
+}
+
+conn_t *conn_current(void) {
+    return _conn;
+}
+
+conn_t *conn_find(uint16_t handle) {
+    return (_conn != &_no_conn && _conn->handle == handle) ? _conn : NULL;
+}
+
+int conn_active(void) {
+    return _conn != &_no_conn;
+}
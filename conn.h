@@ -0,0 +1,55 @@
+/**
+ * @file
+ * @brief       State of the connection served by the notifications
+ *
+ * A single central gets the indications and notifications. Its state comes
+ * from a pool of one block: a connection that finds it taken is refused and
+ * nothing is started for it. Without a connection, conn_current() is a state
+ * where no subscription is ever enabled, so the sampling reads it anytime
+ * without a check.
+ *
+ * The block of a closed connection is retired, not freed: the sampling may
+ * still be in a frame with the old pointer. An event of the sampling queue
+ * frees it, once that frame is done.
+ */
+
+#ifndef CONN_H
+#define CONN_H
+
+#include <stdint.h>
+
+#include "event.h"
+
+typedef struct {
+    uint16_t handle;
+    uint8_t wss_enabled;        // The client subscribed to the Weight Measurement indications
+    uint8_t wss_pending;        // An indication waits for its confirmation
+    uint8_t stream_enabled;     // The client subscribed to the stream notifications
+    uint8_t bas_enabled;        // The client subscribed to the Battery Level notifications
+    uint8_t workout_enabled;    // The client subscribed to the workout events
+} conn_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Link the pool. The retired blocks are freed by events of eq, the queue of
+ * the sampling */
+void conn_init(event_queue_t *eq);
+
+/* A connection came up: its state, with no subscription, and the full rate
+ * held for it. NULL if it is refused, the caller terminates it */
+conn_t *conn_open(uint16_t handle);
+
+/* A connection went down. Returns 1 if it had a state, which is retired and
+ * its hold on the full rate released, 0 if it was refused at conn_open() */
+int conn_close(uint16_t handle);
+
+/* The state of the served connection, or the empty one. Never NULL */
+conn_t *conn_current(void);
+
+/* The state of the connection if it is the served one, NULL otherwise */
+conn_t *conn_find(uint16_t handle);
+
+/* 1 while a connection is served */
+int conn_active(void);
+
+#endif /* CONN_H */
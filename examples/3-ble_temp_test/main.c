@@ -51,6 +51,8 @@
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
 
+#include "gatt_spec.h"
+
 /* ----------------------  Defines --------------------- */
 #define BLE_GATT_SVC_ESS 0x181A         // Environmental Sensing Service
 #define BLE_GATT_CHAR_TEMP 0x2A6E       // Temperature Characteristic
@@ -58,10 +60,6 @@
 // Name that appears on the BLE scanner
 #define BLE_NAME "Nimble Example with RiotOS"
 
-#define GATT_DEVICE_INFO_UUID                   0x180A
-#define GATT_MANUFACTURER_NAME_UUID             0x2A29
-#define GATT_MODEL_NUMBER_UUID                  0x2A24
-
 #define STR_ANSWER_BUFFER_SIZE 100
 
 #define HRS_FLAGS_DEFAULT   (0x01) /* 16-bit BPM value */
@@ -74,21 +72,10 @@
 
 /* ----------------------  Variables --------------------- */
 
-// Names of the Device Info service Characteristics
-static const char *_manufacturer_name = "Corporation Inc.";
-static const char *_model_number = "A4";
-static const char *_serial_number = "15263748-9876-x4";
-static const char *_fw_ver = "0.0.1";
-static const char *_hw_ver = "1.6";
+static const uint8_t _bat_level = BAT_LEVEL;
 
 /* ----------------------  Prototypes --------------------- */
 
-static int _devinfo_handler(uint16_t conn_handle, uint16_t attr_handle,
-                            struct ble_gatt_access_ctxt *ctxt, void *arg);
-
-static int _bas_handler(uint16_t conn_handle, uint16_t attr_handle,
-                        struct ble_gatt_access_ctxt *ctxt, void *arg);
-
 static int _temp_handler(uint16_t conn_handle, uint16_t attr_handle,
                         struct ble_gatt_access_ctxt *ctxt, void *arg);
 
@@ -96,128 +83,29 @@ int16_t read_temperature(void);
 
 /* ----------------------  GATT SERVICE DEFINITION --------------------- */
 
-/* define several bluetooth services for our device */
-static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
-    /*
-     * access_cb defines a callback for read and write access events on
-     * given characteristics
-     */
-    {
-        /* Device Information Service */
-        .type = BLE_GATT_SVC_TYPE_PRIMARY,
-        .uuid = BLE_UUID16_DECLARE(BLE_GATT_SVC_DEVINFO),
-        .characteristics = (struct ble_gatt_chr_def[]){
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_MANUFACTURER_NAME),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_MODEL_NUMBER_STR),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_SERIAL_NUMBER_STR),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_FW_REV_STR),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_HW_REV_STR),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                0, /* no more characteristics in this service */
-            },
-        }},
-    {/* Battery Level Service */
-     .type = BLE_GATT_SVC_TYPE_PRIMARY,
-     .uuid = BLE_UUID16_DECLARE(BLE_GATT_SVC_BAS),
-     .characteristics = (struct ble_gatt_chr_def[]){
-         {
-             .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_BATTERY_LEVEL),
-             .access_cb = _bas_handler,
-             .flags = BLE_GATT_CHR_F_READ,
-         },
-         {
-             0, /* no more characteristics in this service */
-         },
-     }},
-    {/* Environmental Sensing Service */
-     .type = BLE_GATT_SVC_TYPE_PRIMARY,
-     .uuid = BLE_UUID16_DECLARE(BLE_GATT_SVC_ESS),
-     .characteristics = (struct ble_gatt_chr_def[]){
-         {
-             .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_TEMP),
-             .access_cb = _temp_handler,
-             .flags = BLE_GATT_CHR_F_READ,
-         },
-         {
-             0, /* no more characteristics in this service */
-         },
-     }},
-    {
-        0, /* No more services */
-    },
-};
+/* Services of the device, see gatt_spec.h */
+#define EXAMPLE_GATT_SPEC(SVC, CHR, VAL, STR, END) \
+    /* Device Information Service */ \
+    SVC(GATT_UUID16(BLE_GATT_SVC_DEVINFO)) \
+        STR(GATT_UUID16(BLE_GATT_CHAR_MANUFACTURER_NAME), "Corporation Inc.") \
+        STR(GATT_UUID16(BLE_GATT_CHAR_MODEL_NUMBER_STR), "A4") \
+        STR(GATT_UUID16(BLE_GATT_CHAR_SERIAL_NUMBER_STR), "15263748-9876-x4") \
+        STR(GATT_UUID16(BLE_GATT_CHAR_FW_REV_STR), "0.0.1") \
+        STR(GATT_UUID16(BLE_GATT_CHAR_HW_REV_STR), "1.6") \
+    END \
+    /* Battery Level Service, this battery will never drain :-) */ \
+    SVC(GATT_UUID16(BLE_GATT_SVC_BAS)) \
+        VAL(GATT_UUID16(BLE_GATT_CHAR_BATTERY_LEVEL), &_bat_level, sizeof(_bat_level)) \
+    END \
+    /* Environmental Sensing Service */ \
+    SVC(GATT_UUID16(BLE_GATT_SVC_ESS)) \
+        CHR(GATT_UUID16(BLE_GATT_CHAR_TEMP), _temp_handler, NULL, BLE_GATT_CHR_F_READ) \
+    END
+
+static GATT_SPEC_TABLE(gatt_svr_svcs, EXAMPLE_GATT_SPEC);
 
 /* ----------------------  Public  --------------------- */
 
-static int _devinfo_handler(uint16_t conn_handle, uint16_t attr_handle,
-                            struct ble_gatt_access_ctxt *ctxt, void *arg) {
-    (void)conn_handle;
-    (void)attr_handle;
-    (void)arg;
-    const char *str;
-
-    switch (ble_uuid_u16(ctxt->chr->uuid)) {
-    case BLE_GATT_CHAR_MANUFACTURER_NAME:
-        puts("[READ] device information service: manufacturer name value");
-        str = _manufacturer_name;
-        break;
-    case BLE_GATT_CHAR_MODEL_NUMBER_STR:
-        puts("[READ] device information service: model number value");
-        str = _model_number;
-        break;
-    case BLE_GATT_CHAR_SERIAL_NUMBER_STR:
-        puts("[READ] device information service: serial number value");
-        str = _serial_number;
-        break;
-    case BLE_GATT_CHAR_FW_REV_STR:
-        puts("[READ] device information service: firmware revision value");
-        str = _fw_ver;
-        break;
-    case BLE_GATT_CHAR_HW_REV_STR:
-        puts("[READ] device information service: hardware revision value");
-        str = _hw_ver;
-        break;
-    default:
-        return BLE_ATT_ERR_UNLIKELY;
-    }
-
-    int res = os_mbuf_append(ctxt->om, str, strlen(str));
-    return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
-}
-
-static int _bas_handler(uint16_t conn_handle, uint16_t attr_handle,
-                        struct ble_gatt_access_ctxt *ctxt, void *arg) {
-    (void)conn_handle;
-    (void)attr_handle;
-    (void)arg;
-
-    puts("[READ] battery level service: battery level value");
-
-    uint8_t level = BAT_LEVEL; /* this battery will never drain :-) */
-    int res = os_mbuf_append(ctxt->om, &level, sizeof(level));
-    return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
-}
-
 static int _temp_handler(uint16_t conn_handle, uint16_t attr_handle,
                         struct ble_gatt_access_ctxt *ctxt, void *arg) {
     (void)conn_handle;
@@ -0,0 +1,88 @@
+/**
+ * @file
+ * @brief       GATT services declared once, as an X-macro spec
+ *
+ * An application lists its services in one macro taking the entry macros
+ * as arguments, in this order:
+ *
+ * - SVC(uuid): start of a primary service
+ * - CHR(uuid, cb, val_handle, flags): characteristic with an access callback,
+ *   val_handle may be NULL
+ * - VAL(uuid, ptr, len): read only characteristic with a constant value
+ * - STR(uuid, "text"): read only characteristic with a constant string
+ * - END: end of the service
+ *
+ * GATT_SPEC_TABLE() expands it into the NimBLE service table. The tables, the
+ * UUIDs and the constant values are const, they stay in flash. The constant
+ * values are handed to gatt_read_value() through the characteristic arg, with
+ * their length computed at compile time: a read is a single append, without
+ * looking up the UUID nor scanning the string.
+ *
+ * Header only, so the examples can use it too.
+ */
+
+#ifndef GATT_SPEC_H
+#define GATT_SPEC_H
+
+#include <stdint.h>
+
+#include "host/ble_gatt.h"
+#include "host/ble_hs.h"
+
+/* ----------------------  Defines --------------------- */
+
+/* Constant value of a characteristic */
+typedef struct {
+    const void *data;
+    uint16_t len;
+} gatt_value_t;
+
+/* UUIDs in flash, unlike BLE_UUID16_DECLARE() and BLE_UUID128_DECLARE() */
+#define GATT_UUID16(uuid16)     (&((const ble_uuid16_t)BLE_UUID16_INIT(uuid16)).u)
+#define GATT_UUID128(...)       (&((const ble_uuid128_t)BLE_UUID128_INIT(__VA_ARGS__)).u)
+
+#define GATT_SPEC_SVC(uuid_) \
+    { .type = BLE_GATT_SVC_TYPE_PRIMARY, .uuid = (uuid_), \
+      .characteristics = (const struct ble_gatt_chr_def[]){
+#define GATT_SPEC_CHR(uuid_, cb, handle, flags_) \
+    { .uuid = (uuid_), .access_cb = (cb), .val_handle = (handle), .flags = (flags_) },
+#define GATT_SPEC_VAL(uuid_, ptr, len_) \
+    { .uuid = (uuid_), .access_cb = gatt_read_value, \
+      .arg = (void *)&(const gatt_value_t){ .data = (ptr), .len = (len_) }, \
+      .flags = BLE_GATT_CHR_F_READ },
+#define GATT_SPEC_STR(uuid_, str)   GATT_SPEC_VAL(uuid_, str, sizeof(str) - 1)
+#define GATT_SPEC_END \
+    { 0 } } },
+
+/* Service table of a spec */
+#define GATT_SPEC_TABLE(name, spec) \
+    const struct ble_gatt_svc_def name[] = { \
+        spec(GATT_SPEC_SVC, GATT_SPEC_CHR, GATT_SPEC_VAL, GATT_SPEC_STR, GATT_SPEC_END) \
+        { 0 } \
+    }
+
+/* ----------------------  Callbacks --------------------- */
+
+/* Read of a constant value, arg is its gatt_value_t */
+static inline int gatt_read_value(uint16_t conn_handle, uint16_t attr_handle,
+                                  struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    const gatt_value_t *value = arg;
+    (void)conn_handle;
+    (void)attr_handle;
+
+    int res = os_mbuf_append(ctxt->om, value->data, value->len);
+    return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+/* Notify or indicate only characteristics, nothing to read nor write */
+static inline int gatt_no_access(uint16_t conn_handle, uint16_t attr_handle,
+                                 struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    (void)conn_handle;
+    (void)attr_handle;
+    (void)ctxt;
+    (void)arg;
+
+    return BLE_ATT_ERR_UNLIKELY;
+}
+
+#endif /* GATT_SPEC_H */
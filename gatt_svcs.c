@@ -0,0 +1,71 @@
+/**
+ * @file
+ * @brief       GATT services of the hangboard, the spec
+ *
+ * Services, characteristics and constant values are listed once, here. Add a
+ * characteristic with a line in HANGBOARD_GATT_SPEC, nothing else to keep in
+ * sync.
+ */
+
+#include "gatt_spec.h"
+#include "prof.h"
+
+#include "gatt_svcs.h"
+
+/* ----------------------  Variables --------------------- */
+
+uint16_t gatt_bas_val_handle;
+uint16_t gatt_wss_val_handle;
+uint16_t gatt_stream_val_handle;
+uint16_t gatt_workout_val_handle;
+
+static const uint8_t _wss_feature[4] = { WSS_FEATURE & 0xff, 0, 0, 0 };   // uint32, little endian
+
+/* Profiled callbacks, nothing without PROF_ENABLE */
+PROF_GATT_WRAP(gatt_bas_handler)
+PROF_GATT_WRAP(gatt_control_handler)
+PROF_GATT_WRAP(gatt_format_handler)
+PROF_GATT_WRAP(gatt_timesync_handler)
+PROF_GATT_WRAP(gatt_workout_handler)
+
+/* ----------------------  GATT SERVICE DEFINITION --------------------- */
+
+#define RD      BLE_GATT_CHR_F_READ
+#define WR      BLE_GATT_CHR_F_WRITE
+#define NTF     BLE_GATT_CHR_F_NOTIFY
+#define IND     BLE_GATT_CHR_F_INDICATE
+
+#define HANGBOARD_GATT_SPEC(SVC, CHR, VAL, STR, END) \
+    /* Device Information Service */ \
+    SVC(GATT_UUID16(BLE_GATT_SVC_DEVINFO)) \
+        STR(GATT_UUID16(BLE_GATT_CHAR_MANUFACTURER_NAME), "Personal Project") \
+        STR(GATT_UUID16(BLE_GATT_CHAR_MODEL_NUMBER_STR), "1") \
+        STR(GATT_UUID16(BLE_GATT_CHAR_SERIAL_NUMBER_STR), "1") \
+        STR(GATT_UUID16(BLE_GATT_CHAR_FW_REV_STR), "0.1") \
+        STR(GATT_UUID16(BLE_GATT_CHAR_HW_REV_STR), "0.1") \
+    END \
+    /* Battery Service */ \
+    SVC(GATT_UUID16(BLE_GATT_SVC_BAS)) \
+        CHR(GATT_UUID16(BLE_GATT_CHAR_BATTERY_LEVEL), PROF_GATT(gatt_bas_handler), \
+            &gatt_bas_val_handle, RD | NTF) \
+    END \
+    /* Weight Scale Service */ \
+    SVC(GATT_UUID16(BLE_GATT_SVC_WSS)) \
+        VAL(GATT_UUID16(BLE_GATT_CHAR_WEIGHT_FEAT), _wss_feature, sizeof(_wss_feature)) \
+        CHR(GATT_UUID16(BLE_GATT_CHAR_WEIGHT_MEAS), gatt_no_access, &gatt_wss_val_handle, IND) \
+    END \
+    /* Hangboard vendor service */ \
+    SVC(HANGBOARD_UUID(HANGBOARD_SVC_UUID)) \
+        CHR(HANGBOARD_UUID(HANGBOARD_CHAR_CONTROL_UUID), PROF_GATT(gatt_control_handler), \
+            NULL, RD | WR) \
+        CHR(HANGBOARD_UUID(HANGBOARD_CHAR_STREAM_UUID), gatt_no_access, \
+            &gatt_stream_val_handle, NTF) \
+        CHR(HANGBOARD_UUID(HANGBOARD_CHAR_FORMAT_UUID), PROF_GATT(gatt_format_handler), \
+            NULL, RD | WR) \
+        CHR(HANGBOARD_UUID(HANGBOARD_CHAR_TIMESYNC_UUID), PROF_GATT(gatt_timesync_handler), \
+            NULL, RD | WR) \
+        CHR(HANGBOARD_UUID(HANGBOARD_CHAR_WORKOUT_UUID), PROF_GATT(gatt_workout_handler), \
+            &gatt_workout_val_handle, RD | WR | NTF) \
+    END
+
+GATT_SPEC_TABLE(gatt_svcs, HANGBOARD_GATT_SPEC);
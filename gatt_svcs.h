@@ -0,0 +1,66 @@
+/**
+ * @file
+ * @brief       GATT services of the hangboard
+ *
+ * The table is generated from the spec in gatt_svcs.c, in its own object file
+ * so "make gatt-size" reports what it takes. The access callbacks of the
+ * dynamic characteristics live in main.c, next to the state they serve.
+ */
+
+#ifndef GATT_SVCS_H
+#define GATT_SVCS_H
+
+#include <stdint.h>
+
+#include "host/ble_gatt.h"
+
+#include "gatt_spec.h"
+
+/* ----------------------  Defines --------------------- */
+#define BLE_GATT_SVC_WSS            0x181D  // Weight Scale Service
+#define BLE_GATT_CHAR_WEIGHT_MEAS   0x2A9D  // Weight Measurement Characteristic
+#define BLE_GATT_CHAR_WEIGHT_FEAT   0x2A9E  // Weight Scale Feature Characteristic
+
+#define WSS_FEATURE         (6U << 3)   // Weight resolution 0.01 kg, nothing else supported
+#define WSS_FLAGS_SI        (0x00)      // Weight in kg, no timestamp, user ID or BMI
+
+/* Hangboard vendor service, 4a1e0001-7c52-4f0b-9b1e-5f6a3c2d8e10. The characteristics
+ * only change the 16 bits of the service id */
+#define HANGBOARD_UUID(id)  GATT_UUID128(0x10, 0x8e, 0x2d, 0x3c, 0x6a, 0x5f, 0x1e, 0x9b, \
+                                         0x0b, 0x4f, 0x52, 0x7c, (id) & 0xff, (id) >> 8, \
+                                         0x1e, 0x4a)
+#define HANGBOARD_SVC_UUID              0x0001
+#define HANGBOARD_CHAR_CONTROL_UUID     0x0002      // Tare and calibration commands
+#define HANGBOARD_CHAR_STREAM_UUID      0x0003      // Batched samples at the full rate
+#define HANGBOARD_CHAR_FORMAT_UUID      0x0004      // Sample format and rate of the stream
+#define HANGBOARD_CHAR_TIMESYNC_UUID    0x0005      // Client clock in, device to client clock mapping out
+#define HANGBOARD_CHAR_WORKOUT_UUID     0x0006      // Interval protocol in, cues and results out
+
+/* ----------------------  Variables --------------------- */
+
+extern const struct ble_gatt_svc_def gatt_svcs[];
+
+// Value handles, to notify and to match the subscriptions
+extern uint16_t gatt_bas_val_handle;
+extern uint16_t gatt_wss_val_handle;
+extern uint16_t gatt_stream_val_handle;
+extern uint16_t gatt_workout_val_handle;
+
+/* ----------------------  Prototypes --------------------- */
+
+int gatt_bas_handler(uint16_t conn_handle, uint16_t attr_handle,
+                     struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int gatt_control_handler(uint16_t conn_handle, uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int gatt_format_handler(uint16_t conn_handle, uint16_t attr_handle,
+                        struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int gatt_timesync_handler(uint16_t conn_handle, uint16_t attr_handle,
+                          struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int gatt_workout_handler(uint16_t conn_handle, uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+#endif /* GATT_SVCS_H */
@@ -0,0 +1,318 @@
+/**
+ * @file
+ * @brief       Aggregation of many hangboard streams
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gateway.h"
+
+/* ----------------------  Defines --------------------- */
+#define GW_POLL_BATCH       (4096U) // Messages per poll, the caller gets to publish under load
+#define GW_E2E_NONE         (UINT32_MAX)
+
+typedef enum {
+    GW_MSG_PACKET,
+    GW_MSG_SESSION,
+    GW_MSG_ERROR,
+} gw_msg_type_t;
+
+/* What a reader sends to the consumer, kept within a cache line */
+typedef struct {
+    uint8_t type;           // gw_msg_type_t
+    uint8_t seq;
+    uint16_t board;
+    uint16_t frames;
+    uint32_t t_us;          // Device time, of the first frame or of the session start
+    uint32_t duration_ms;   // Session only
+    int32_t weight;         // Last frame, or mean of the session [0.01 kg]
+    int32_t peak;           // [0.01 kg]
+    uint32_t e2e_us;        // Acquisition of the last frame to reception, GW_E2E_NONE unknown
+    uint64_t rx_ns;
+} gw_msg_t;
+
+/* ----------------------  Private  --------------------- */
+
+static void _push(gw_t *gw, const gw_msg_t *msg) {
+    /* a reader can wait, unlike the boards: the socket or the pipe buffers */
+    while (mpsc_push(&gw->queue, msg) != 0) {
+        atomic_fetch_add_explicit(&gw->stalls, 1, memory_order_relaxed);
+        sched_yield();
+    }
+}
+
+static void _session_end(gw_reader_t *rd, uint32_t t_us, uint64_t rx_ns) {
+    gw_msg_t msg = {
+        .type = GW_MSG_SESSION,
+        .board = rd->board,
+        .t_us = rd->start_us,
+        .duration_ms = (t_us - rd->start_us) / 1000,
+        .weight = rd->frames ? rd->sum / rd->frames : 0,
+        .peak = rd->peak,
+        .rx_ns = rx_ns,
+    };
+    _push(rd->gw, &msg);
+    rd->hanging = 0;
+}
+
+static void _handle(gw_t *gw, const gw_msg_t *msg, uint64_t now_ns) {
+    gw_board_t *board = &gw->boards[msg->board];
+
+    switch (msg->type) {
+    case GW_MSG_PACKET: {
+        if (board->packets != 0) {
+            board->lost += (uint8_t)(msg->seq - board->seq - 1);
+        }
+        board->packets++;
+        board->frames += msg->frames;
+        board->seq = msg->seq;
+        board->weight = msg->weight;
+        board->hanging = msg->weight > gw->threshold;
+        if (msg->peak > board->peak) {
+            board->peak = msg->peak;
+        }
+        board->rx_ns = msg->rx_ns;
+
+        uint64_t lat = (now_ns - msg->rx_ns) / 1000;
+        gw->latency[(lat <= GW_LATENCY_MAX_US) ? lat : GW_LATENCY_OVER]++;
+        gw->latency_numof++;
+        if (lat > gw->latency_max) {
+            gw->latency_max = lat;
+        }
+
+        if (msg->e2e_us != GW_E2E_NONE) {
+            uint32_t ms = msg->e2e_us / 1000;
+            gw->e2e[(ms <= GW_E2E_MAX_MS) ? ms : GW_E2E_OVER]++;
+            gw->e2e_numof++;
+            if (msg->e2e_us > gw->e2e_max) {
+                gw->e2e_max = msg->e2e_us;
+            }
+        }
+        break;
+    }
+    case GW_MSG_SESSION:
+        board->sessions++;
+        board->last = (gw_session_t){
+            .board = msg->board,
+            .start_us = msg->t_us,
+            .duration_ms = msg->duration_ms,
+            .peak = msg->peak,
+            .mean = msg->weight,
+        };
+        if (gw->on_session) {
+            gw->on_session(&board->last, gw->arg);
+        }
+        break;
+    case GW_MSG_ERROR:
+        board->errors++;
+        break;
+    }
+}
+
+/* ----------------------  Public  --------------------- */
+
+uint64_t gw_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int gw_init(gw_t *gw, unsigned boards_max, unsigned queue_len) {
+    memset(gw, 0, sizeof(*gw));
+    gw->period_us = GW_PERIOD_US;
+    gw->threshold = GW_THRESHOLD;
+    gw->boards_max = boards_max;
+    gw->boards = calloc(boards_max, sizeof(gw_board_t));
+    gw->latency = calloc(GW_LATENCY_OVER + 1, sizeof(uint32_t));
+    gw->e2e = calloc(GW_E2E_OVER + 1, sizeof(uint32_t));
+    if (gw->boards == NULL || gw->latency == NULL || gw->e2e == NULL) {
+        gw_free(gw);
+        return -ENOMEM;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    gw->realtime_ns = ts.tv_sec * 1000000000LL + ts.tv_nsec - (int64_t)gw_now_ns();
+
+    int res = mpsc_init(&gw->queue, sizeof(gw_msg_t), queue_len);
+    if (res != 0) {
+        gw_free(gw);
+    }
+    return res;
+}
+
+void gw_free(gw_t *gw) {
+    if (gw->queue.cells) {
+        mpsc_free(&gw->queue);
+    }
+    free(gw->boards);
+    free(gw->latency);
+    free(gw->e2e);
+    gw->boards = NULL;
+    gw->latency = NULL;
+    gw->e2e = NULL;
+}
+
+int gw_add_board(gw_t *gw, const char *name) {
+    unsigned id = atomic_fetch_add(&gw->boards_numof, 1);
+    if (id >= gw->boards_max) {
+        atomic_fetch_sub(&gw->boards_numof, 1);
+        return -ENOSPC;
+    }
+    /* the consumer only looks at it once the reader queued something */
+    strncpy(gw->boards[id].name, name, GW_NAME_LEN - 1);
+    return id;
+}
+
+unsigned gw_boards_numof(gw_t *gw) {
+    unsigned numof = atomic_load(&gw->boards_numof);
+    return (numof > gw->boards_max) ? gw->boards_max : numof;
+}
+
+const gw_board_t *gw_board(const gw_t *gw, unsigned board) {
+    return &gw->boards[board];
+}
+
+void gw_clear_peaks(gw_t *gw) {
+    unsigned numof = gw_boards_numof(gw);
+    for (unsigned i = 0; i < numof; i++) {
+        gw->boards[i].peak = gw->boards[i].weight;
+    }
+}
+
+void gw_reader_init(gw_reader_t *rd, gw_t *gw, unsigned board) {
+    memset(rd, 0, sizeof(*rd));
+    rd->gw = gw;
+    rd->board = board;
+}
+
+int gw_reader_feed(gw_reader_t *rd, const uint8_t *payload, size_t len, uint64_t rx_ns) {
+    gw_t *gw = rd->gw;
+    hb_packet_t *pkt = &rd->pkt;
+
+    if (hb_decode(payload, len, pkt) != 0) {
+        gw_msg_t msg = { .type = GW_MSG_ERROR, .board = rd->board, .rx_ns = rx_ns };
+        _push(gw, &msg);
+        return -EINVAL;
+    }
+
+    gw_msg_t msg = {
+        .type = GW_MSG_PACKET,
+        .seq = pkt->seq,
+        .board = rd->board,
+        .frames = pkt->count,
+        .t_us = pkt->t_us,
+        .peak = INT32_MIN,
+        .e2e_us = GW_E2E_NONE,
+        .rx_ns = rx_ns,
+    };
+
+    /* the frames of a packet are divider sample periods apart */
+    uint32_t spacing_us = gw->period_us * pkt->divider;
+
+    if (rd->synced) {
+        /* a negative delay is the error of the estimate, counted as 0 us */
+        uint32_t last_us = pkt->t_us + (pkt->count - 1) * spacing_us;
+        int64_t rx_us = ((int64_t)rx_ns + gw->realtime_ns) / 1000;
+        int64_t e2e_us = rx_us - hb_client_us(&rd->ts, last_us);
+        msg.e2e_us = (e2e_us < 0) ? 0 : (e2e_us < GW_E2E_NONE) ? e2e_us : GW_E2E_NONE - 1;
+    }
+
+    const int32_t *frame = pkt->samples;
+    for (unsigned i = 0; i < pkt->count; i++, frame += pkt->channels) {
+        int32_t total = 0;
+        for (unsigned ch = 0; ch < pkt->channels; ch++) {
+            total += frame[ch];
+        }
+        total /= 1 << HB_FRAC_BITS;
+
+        uint32_t t_us = pkt->t_us + i * spacing_us;
+        if (total > gw->threshold) {
+            if (!rd->hanging) {
+                rd->hanging = 1;
+                rd->start_us = t_us;
+                rd->frames = 0;
+                rd->sum = 0;
+                rd->peak = total;
+            }
+            rd->frames++;
+            rd->sum += total;
+            if (total > rd->peak) {
+                rd->peak = total;
+            }
+        }
+        else if (rd->hanging) {
+            _session_end(rd, t_us, rx_ns);
+        }
+
+        if (total > msg.peak) {
+            msg.peak = total;
+        }
+        msg.weight = total;
+    }
+
+    _push(gw, &msg);
+    return 0;
+}
+
+void gw_reader_timesync(gw_reader_t *rd, const hb_timesync_t *ts) {
+    if (ts->count != 0) {
+        rd->ts = *ts;
+        rd->synced = 1;
+    }
+}
+
+unsigned gw_poll(gw_t *gw, unsigned timeout_ms) {
+    gw_msg_t msg;
+    unsigned numof = 0;
+
+    if (mpsc_pop(&gw->queue, &msg) != 0) {
+        mpsc_wait(&gw->queue, timeout_ms);
+        if (mpsc_pop(&gw->queue, &msg) != 0) {
+            return 0;
+        }
+    }
+
+    do {
+        _handle(gw, &msg, gw_now_ns());     // vDSO, a few tens of ns
+        numof++;
+    } while (numof < GW_POLL_BATCH && mpsc_pop(&gw->queue, &msg) == 0);
+
+    return numof;
+}
+
+uint32_t gw_latency(const gw_t *gw, double pct) {
+    uint64_t rank = (uint64_t)(gw->latency_numof * pct / 100.0);
+    uint64_t seen = 0;
+
+    if (gw->latency_numof == 0) {
+        return 0;
+    }
+    for (uint32_t us = 0; us <= GW_LATENCY_OVER; us++) {
+        seen += gw->latency[us];
+        if (seen > rank) {
+            return us;
+        }
+    }
+    return gw->latency_max;
+}
+
+uint32_t gw_e2e_latency(const gw_t *gw, double pct) {
+    uint64_t rank = (uint64_t)(gw->e2e_numof * pct / 100.0);
+    uint64_t seen = 0;
+
+    if (gw->e2e_numof == 0) {
+        return 0;
+    }
+    for (uint32_t ms = 0; ms <= GW_E2E_OVER; ms++) {
+        seen += gw->e2e[ms];
+        if (seen > rank) {
+            return ms;
+        }
+    }
+    return gw->e2e_max / 1000;
+}
@@ -0,0 +1,146 @@
+/**
+ * @file
+ * @brief       Aggregation of many hangboard streams
+ *
+ * Every stream has its own reader thread, which decodes the packets and
+ * reduces them to a few numbers (latest weight, peak, end of a hang). Only
+ * these go through the lock-free queue, to the single consumer that owns the
+ * per-board state: the readers share nothing but the queue, and the consumer
+ * takes no lock to update or to publish the state.
+ *
+ * Weights are the total of all the load cells of a board, in 0.01 kg. A board
+ * is hanging above GW_THRESHOLD, like the session state of the firmware.
+ *
+ * Once the bridge passed a time-sync estimate of the board, every packet also
+ * gives the latency from the acquisition of its newest frame to its reception
+ * here, on the client clock: CLOCK_REALTIME, which the bridge writes to the
+ * time-sync characteristic.
+ */
+
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "hbproto.h"
+#include "mpsc.h"
+
+/* ----------------------  Defines --------------------- */
+#define GW_NAME_LEN         (32U)
+#define GW_PERIOD_US        (20000U)    // Sample period, 50 Hz firmware
+#define GW_THRESHOLD        (500)       // Somebody hangs above this weight [0.01 kg]
+#define GW_LATENCY_MAX_US   (100000U)   // Range of the latency histogram, 1 us bins
+#define GW_E2E_MAX_MS       (2000U)     // Range of the acquisition to client histogram, 1 ms bins
+
+/* Histograms have an overflow bin past their range, a percentile that falls
+ * in it is reported as this value */
+#define GW_LATENCY_OVER     (GW_LATENCY_MAX_US + 1)
+#define GW_E2E_OVER         (GW_E2E_MAX_MS + 1)
+
+/* Hang, from the first frame above the threshold to the first one below */
+typedef struct {
+    unsigned board;
+    uint32_t start_us;      // Device time of the first frame
+    uint32_t duration_ms;
+    int32_t peak;           // [0.01 kg]
+    int32_t mean;           // [0.01 kg]
+} gw_session_t;
+
+/* Live state of a board, owned by the consumer */
+typedef struct {
+    char name[GW_NAME_LEN];
+    uint32_t packets;
+    uint32_t frames;
+    uint32_t lost;          // Packets missing from the sequence
+    uint32_t errors;        // Malformed packets
+    uint32_t sessions;
+    uint8_t seq;            // Of the last packet
+    uint8_t hanging;
+    int32_t weight;         // Last frame [0.01 kg]
+    int32_t peak;           // Since the last publication [0.01 kg]
+    uint64_t rx_ns;         // Reception of the last packet (CLOCK_MONOTONIC)
+    gw_session_t last;      // Last complete session
+} gw_board_t;
+
+typedef void (*gw_session_cb_t)(const gw_session_t *session, void *arg);
+
+typedef struct {
+    mpsc_t queue;
+    gw_board_t *boards;
+    unsigned boards_max;
+    atomic_uint boards_numof;
+    uint32_t period_us;     // Sample period of the boards, the packets have the divider
+    int32_t threshold;      // Hang threshold [0.01 kg]
+    gw_session_cb_t on_session;
+    void *arg;
+    atomic_ulong stalls;    // Pushes retried on a full queue
+    uint32_t *latency;      // Histogram of the reception to consumption delay [us]
+    uint64_t latency_numof;
+    uint64_t latency_max;
+    int64_t realtime_ns;    // CLOCK_REALTIME - CLOCK_MONOTONIC, at init
+    uint32_t *e2e;          // Histogram of the acquisition to reception delay [ms]
+    uint64_t e2e_numof;
+    uint32_t e2e_max;       // [us]
+} gw_t;
+
+/* Decoding state of a stream, owned by its reader */
+typedef struct {
+    gw_t *gw;
+    unsigned board;
+    uint8_t hanging;
+    uint32_t start_us;
+    uint32_t frames;        // Of the current session
+    int64_t sum;
+    int32_t peak;
+    uint8_t synced;         // ts holds an estimate
+    hb_timesync_t ts;
+    hb_packet_t pkt;
+} gw_reader_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Room for boards_max boards and queue_len messages (a power of 2). Returns 0,
+ * or a negative errno */
+int gw_init(gw_t *gw, unsigned boards_max, unsigned queue_len);
+
+void gw_free(gw_t *gw);
+
+/* New board, from any thread. Returns its id, or -ENOSPC */
+int gw_add_board(gw_t *gw, const char *name);
+
+unsigned gw_boards_numof(gw_t *gw);
+
+/* State of a board, consumer only */
+const gw_board_t *gw_board(const gw_t *gw, unsigned board);
+
+/* Clear the peaks, once the state is published. Consumer only */
+void gw_clear_peaks(gw_t *gw);
+
+void gw_reader_init(gw_reader_t *rd, gw_t *gw, unsigned board);
+
+/* Decode a notification received at rx_ns (CLOCK_MONOTONIC) and queue what
+ * the consumer needs. Returns 0, or -EINVAL if it was malformed */
+int gw_reader_feed(gw_reader_t *rd, const uint8_t *payload, size_t len, uint64_t rx_ns);
+
+/* Time-sync estimate of the board, from a control record. An estimate without
+ * any client write yet is ignored */
+void gw_reader_timesync(gw_reader_t *rd, const hb_timesync_t *ts);
+
+/* Consume the queue, for up to timeout_ms if it is empty. Returns the number
+ * of messages handled */
+unsigned gw_poll(gw_t *gw, unsigned timeout_ms);
+
+/* Percentile (0 to 100) of the latency from reception to consumption [us].
+ * GW_LATENCY_OVER beyond GW_LATENCY_MAX_US */
+uint32_t gw_latency(const gw_t *gw, double pct);
+
+/* Percentile (0 to 100) of the latency from acquisition to reception, on the
+ * client clock [ms]. GW_E2E_OVER beyond GW_E2E_MAX_MS, 0 without any
+ * time-synced packet */
+uint32_t gw_e2e_latency(const gw_t *gw, double pct);
+
+/* CLOCK_MONOTONIC in ns */
+uint64_t gw_now_ns(void);
+
+#endif /* GATEWAY_H */
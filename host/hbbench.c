@@ -0,0 +1,170 @@
+/**
+ * @file
+ * @brief       Benchmark of the decoder, scalar against SIMD
+ *
+ * Decodes captures with every instruction set of the CPU and reports the
+ * samples per second. Without a file, it builds a capture in memory for every
+ * sample format, full notifications of random walks. All the instruction sets
+ * must give the same samples, a mismatch fails the run.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "gateway.h"
+#include "hbcapture.h"
+#include "hbproto.h"
+
+/* ----------------------  Defines --------------------- */
+#define BENCH_MIN_NS        (300000000ULL)  // Minimum run time of a measure
+#define BENCH_STEP          (150)           // Largest step of the random walk [0.01 kg]
+
+typedef struct {
+    double rate;            // Samples per second
+    double bytes;           // Capture bytes per second
+    uint64_t checksum;
+} bench_result_t;
+
+/* ----------------------  Private  --------------------- */
+
+static uint32_t _xorshift(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Framed records of one format, about len bytes */
+static uint8_t *_synth(hb_fmt_t format, unsigned channels, size_t len, size_t *out_len) {
+    uint8_t *buf = malloc(len + HB_RECORD_MAX);
+    hb_packet_t pkt = {
+        .format = format,
+        .channels = channels,
+        .count = hb_capacity(format, channels, HB_PAYLOAD_MAX),
+        .divider = 1,
+    };
+    int32_t level[HB_CHANNELS_MAX] = { 0 };
+    uint32_t rng = 0x12345678;
+    size_t pos = 0;
+
+    while (buf != NULL && pos < len) {
+        for (unsigned i = 0; i < pkt.count * channels; i++) {
+            int32_t *l = &level[i % channels];
+            *l += (int32_t)(_xorshift(&rng) % (2 * BENCH_STEP + 1)) - BENCH_STEP;
+            *l = (*l > 20000) ? 20000 : (*l < -20000) ? -20000 : *l;
+            pkt.samples[i] = *l * (1L << HB_FRAC_BITS) + (int32_t)(_xorshift(&rng) & 0xff);
+        }
+        uint8_t payload[HB_PAYLOAD_MAX];
+        size_t plen = hb_encode(payload, sizeof(payload), &pkt);
+        pos += hb_frame(buf + pos, payload, plen);
+        pkt.seq++;
+        pkt.t_us += pkt.count * GW_PERIOD_US;
+    }
+    *out_len = pos;
+    return buf;
+}
+
+static bench_result_t _run(hb_capture_t *cap) {
+    static hb_packet_t pkt;
+    bench_result_t res = { 0 };
+    uint64_t samples = 0, bytes = 0, elapsed_ns;
+    uint64_t start_ns = gw_now_ns();
+
+    do {
+        hb_capture_rewind(cap);
+        res.checksum = 0;
+        while (hb_capture_next(cap, &pkt)) {
+            unsigned numof = pkt.count * pkt.channels;
+            uint64_t sum = 0;
+            /* uses every sample, and vectorizes so it doesn't hide the decoder */
+            for (unsigned i = 0; i < numof; i++) {
+                sum += (uint32_t)pkt.samples[i] ^ i;
+            }
+            res.checksum = res.checksum * 31 + sum;
+            samples += numof;
+        }
+        bytes += cap->len;
+        elapsed_ns = gw_now_ns() - start_ns;
+    } while (elapsed_ns < BENCH_MIN_NS);
+
+    res.rate = samples * 1e9 / elapsed_ns;
+    res.bytes = bytes * 1e9 / elapsed_ns;
+    return res;
+}
+
+/* Every instruction set on one capture. Returns the number of mismatches */
+static int _bench(const char *label, hb_capture_t *cap) {
+    bench_result_t ref = { 0 };
+    int mismatches = 0;
+
+    for (int isa = 0; isa < HB_ISA_NUMOF; isa++) {
+        if (hb_set_isa(isa) != 0) {
+            printf("%-10s %-8s  not supported\n", label, hb_isa_name(isa));
+            continue;
+        }
+        bench_result_t res = _run(cap);
+        if (isa == HB_ISA_SCALAR) {
+            ref = res;
+        }
+        int ok = res.checksum == ref.checksum;
+        mismatches += !ok;
+        printf("%-10s %-8s %11.1f %9.1f %8.2f  %s\n", label, hb_isa_name(isa), res.rate / 1e6,
+               res.bytes / 1e6, res.rate / ref.rate, ok ? "ok" : "MISMATCH");
+    }
+    hb_set_isa(hb_isa_best());
+    return mismatches;
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(int argc, char **argv) {
+    static const char *formats[HB_FMT_NUMOF] = { "delta8", "int16", "fixed24" };
+    unsigned channels = 2;
+    size_t len = 16U << 20;
+    int mismatches = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:m:h")) != -1) {
+        switch (opt) {
+        case 'c': channels = strtoul(optarg, NULL, 0); break;
+        case 'm': len = strtoul(optarg, NULL, 0) << 20; break;
+        default:
+            fprintf(stderr, "usage: %s [-c channels] [-m MB] [capture...]\n", argv[0]);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+    if (channels == 0 || channels > HB_CHANNELS_MAX) {
+        fprintf(stderr, "[BENCH] 1 to %u channels\n", HB_CHANNELS_MAX);
+        return 1;
+    }
+
+    puts("capture    isa       Msamples/s      MB/s  speedup");
+
+    if (optind == argc) {
+        for (int format = 0; format < HB_FMT_NUMOF; format++) {
+            size_t synth_len;
+            uint8_t *buf = _synth(format, channels, len, &synth_len);
+            if (buf == NULL) {
+                return 1;
+            }
+            hb_capture_t cap;
+            hb_capture_mem(&cap, buf, synth_len);
+            mismatches += _bench(formats[format], &cap);
+            free(buf);
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        hb_capture_t cap;
+        int res = hb_capture_open(&cap, argv[i]);
+        if (res != 0) {
+            fprintf(stderr, "[BENCH] %s: can't open (%d)\n", argv[i], res);
+            return 1;
+        }
+        mismatches += _bench(argv[i], &cap);
+        hb_capture_close(&cap);
+    }
+
+    return mismatches ? 1 : 0;
+}
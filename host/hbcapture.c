@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @brief       Streaming decoder of capture files
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hbcapture.h"
+
+/* ----------------------  Public  --------------------- */
+
+int hb_capture_open(hb_capture_t *cap, const char *path) {
+    struct stat st;
+
+    hb_capture_mem(cap, NULL, 0);
+    cap->fd = open(path, O_RDONLY);
+    if (cap->fd < 0) {
+        return -errno;
+    }
+    if (fstat(cap->fd, &st) != 0) {
+        int res = -errno;
+        hb_capture_close(cap);
+        return res;
+    }
+    if (st.st_size == 0) {
+        return 0;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, cap->fd, 0);
+    if (data == MAP_FAILED) {
+        int res = -errno;
+        hb_capture_close(cap);
+        return res;
+    }
+    posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+    cap->data = data;
+    cap->len = st.st_size;
+    return 0;
+}
+
+void hb_capture_mem(hb_capture_t *cap, const void *data, size_t len) {
+    cap->data = data;
+    cap->len = len;
+    cap->fd = -1;
+    hb_capture_rewind(cap);
+}
+
+void hb_capture_close(hb_capture_t *cap) {
+    if (cap->fd >= 0) {
+        if (cap->data != NULL) {
+            munmap((void *)cap->data, cap->len);
+        }
+        close(cap->fd);
+    }
+    hb_capture_mem(cap, NULL, 0);
+}
+
+void hb_capture_rewind(hb_capture_t *cap) {
+    cap->pos = 0;
+    cap->records = 0;
+    cap->errors = 0;
+}
+
+hb_rec_t hb_capture_record(hb_capture_t *cap, const uint8_t **payload, size_t *plen) {
+    while (cap->pos < cap->len) {
+        size_t used;
+        hb_rec_t rec = hb_unframe(cap->data + cap->pos, cap->len - cap->pos, &used,
+                                  payload, plen);
+        cap->pos += used;
+        if (rec != HB_REC_NONE) {
+            return rec;
+        }
+
+        /* no more bytes will come: a sync byte whose record runs past the end
+         * is a false one (or a truncated last record), resync after it */
+        if (cap->pos < cap->len) {
+            cap->errors++;
+            cap->pos++;
+        }
+    }
+    return HB_REC_NONE;
+}
+
+void hb_capture_resync(hb_capture_t *cap, const uint8_t *payload) {
+    cap->errors++;
+    cap->pos = (payload - cap->data) - 1;
+}
+
+int hb_capture_next(hb_capture_t *cap, hb_packet_t *pkt) {
+    const uint8_t *payload;
+    size_t plen;
+    hb_rec_t rec;
+
+    while ((rec = hb_capture_record(cap, &payload, &plen)) != HB_REC_NONE) {
+        if (rec == HB_REC_CTRL) {
+            continue;
+        }
+        if (hb_decode(payload, plen, pkt) == 0) {
+            cap->records++;
+            return 1;
+        }
+        hb_capture_resync(cap, payload);
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * @brief       Streaming decoder of capture files
+ *
+ * A capture is a byte stream of framed notifications (see hbproto.h), as
+ * recorded from a serial bridge, control records included. The file is memory mapped and walked in
+ * place: no read() copies, and the kernel reads ahead since the access is
+ * sequential. Months of sessions decode at the speed of the sample kernels.
+ */
+
+#ifndef HBCAPTURE_H
+#define HBCAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hbproto.h"
+
+/* ----------------------  Defines --------------------- */
+
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;             // Next byte to look at
+    int fd;                 // -1 for a capture in memory
+    uint64_t records;       // Packets decoded
+    uint64_t errors;        // Malformed records, skipped
+} hb_capture_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Map a capture file. Returns 0, or a negative errno */
+int hb_capture_open(hb_capture_t *cap, const char *path);
+
+/* Walk a capture already in memory */
+void hb_capture_mem(hb_capture_t *cap, const void *data, size_t len);
+
+/* Unmap the file */
+void hb_capture_close(hb_capture_t *cap);
+
+/* Back to the first record, counters cleared */
+void hb_capture_rewind(hb_capture_t *cap);
+
+/* Next record, not decoded. Returns its hb_rec_t, HB_REC_NONE at the end of
+ * the capture */
+hb_rec_t hb_capture_record(hb_capture_t *cap, const uint8_t **payload, size_t *plen);
+
+/* The record at payload was malformed: count it, and look for the next one
+ * right after its sync byte */
+void hb_capture_resync(hb_capture_t *cap, const uint8_t *payload);
+
+/* Next well formed packet, decoded, past the control records. Returns 1, 0 at
+ * the end of the capture */
+int hb_capture_next(hb_capture_t *cap, hb_packet_t *pkt);
+
+#endif /* HBCAPTURE_H */
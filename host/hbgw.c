@@ -0,0 +1,626 @@
+/**
+ * @file
+ * @brief       Gateway daemon: many hangboard streams to one display
+ *
+ * Every input gets its own reader thread:
+ *
+ * - a character device (serial port or pty of a BLE central bridge),
+ * - a capture file, memory mapped, replayed as fast as possible or in real
+ *   time (-r),
+ * - unix:<path>, a listening socket standing in for BLE: every connection is
+ *   a board.
+ *
+ * All of them carry framed notifications, see hbproto.h. The main thread
+ * consumes the merge queue, prints the live state of every board each -i ms
+ * and the summary of every hang. The time-sync records of a live input give
+ * the latency from acquisition to reception, printed on exit.
+ *
+ * With -L, simulated boards replace the inputs: each one encodes packets the
+ * way the firmware does, at the real rate or flat out (-F), and the report
+ * gives the decode throughput and the latency from reception to consumption,
+ * and at the real rate from acquisition to reception.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gateway.h"
+#include "hbcapture.h"
+#include "hbproto.h"
+
+/* ----------------------  Defines --------------------- */
+#define HBGW_BOARDS_MAX     (4096U)
+#define HBGW_QUEUE_LEN      (1U << 16)
+#define HBGW_READ_LEN       (4096U)
+#define HBGW_POLL_MS        (100U)
+#define HBGW_REBASE_US      (10000000UL)    // Replay jumps over longer gaps (reboots)
+
+#define SIM_CHANNELS        (2U)
+#define SIM_CYCLE_US        (10000000UL)    // Rest then hang
+#define SIM_REST_US         (3000000UL)
+#define SIM_HANG            (3500)          // Per channel [0.01 kg]
+#define SIM_NOISE           (20)            // [0.01 kg]
+#define SIM_DECODE_NS       (500000000ULL)  // Run time of the decoder benchmark
+
+typedef enum {
+    INPUT_SERIAL,
+    INPUT_FILE,
+    INPUT_CONN,
+    INPUT_SIM,
+} input_kind_t;
+
+typedef struct {
+    gw_reader_t rd;
+    input_kind_t kind;
+    int fd;
+    hb_capture_t cap;
+    pthread_t thread;
+    uint64_t packets;       // Simulation counters
+    uint64_t frames;
+} input_t;
+
+/* ----------------------  Variables --------------------- */
+
+static gw_t _gw;
+static atomic_int _stop;
+static atomic_int _active;          // Readers still running
+static int _listening;
+static const char *_sock_path;
+
+// Options
+static int _realtime;               // Replay the captures at their pace
+static unsigned _interval_ms = 1000;
+static unsigned _sim_boards;
+static unsigned _sim_secs = 10;
+static int _sim_flat_out;
+static unsigned _sim_payload = HB_PAYLOAD_MAX;
+static hb_fmt_t _sim_format = HB_FMT_INT16;
+
+/* ----------------------  Private  --------------------- */
+
+/* A percentile of a histogram, ">max" when it falls in the overflow bin: that
+ * bin holds no value */
+static const char *_pct(char *buf, size_t len, uint32_t val, uint32_t max) {
+    snprintf(buf, len, (val > max) ? ">%u" : "%u", (unsigned)((val > max) ? max : val));
+    return buf;
+}
+
+static void _on_signal(int sig) {
+    (void)sig;
+    atomic_store(&_stop, 1);
+}
+
+static void _sleep_until(uint64_t ns) {
+    struct timespec ts = { .tv_sec = ns / 1000000000ULL, .tv_nsec = ns % 1000000000ULL };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+static void _on_session(const gw_session_t *s, void *arg) {
+    (void)arg;
+    printf("[SESSION] %s: %u.%02u s, peak %.2f kg, mean %.2f kg\n",
+           gw_board(&_gw, s->board)->name, (unsigned)(s->duration_ms / 1000),
+           (unsigned)(s->duration_ms % 1000) / 10, s->peak / 100.0, s->mean / 100.0);
+}
+
+static void _print_state(void) {
+    unsigned numof = gw_boards_numof(&_gw);
+    uint64_t now_ns = gw_now_ns();
+
+    puts("board                 weight    peak  state  packets   lost  errors  sessions  age [ms]");
+    for (unsigned i = 0; i < numof; i++) {
+        const gw_board_t *b = gw_board(&_gw, i);
+        if (b->packets == 0 && b->errors == 0) {
+            continue;
+        }
+        printf("%-20s %7.2f %7.2f  %-5s %8u %6u %7u %9u %9llu\n", b->name,
+               b->weight / 100.0, b->peak / 100.0, b->hanging ? "hang" : "idle",
+               (unsigned)b->packets, (unsigned)b->lost, (unsigned)b->errors,
+               (unsigned)b->sessions,
+               (unsigned long long)((now_ns - b->rx_ns) / 1000000));
+    }
+    fflush(stdout);
+}
+
+static void _print_e2e(void) {
+    if (_gw.e2e_numof == 0) {
+        return;
+    }
+    char p50[16], p90[16], p99[16];
+    printf("e2e       p50 %s ms, p90 %s ms, p99 %s ms, max %.1f ms, %llu packets\n",
+           _pct(p50, sizeof(p50), gw_e2e_latency(&_gw, 50), GW_E2E_MAX_MS),
+           _pct(p90, sizeof(p90), gw_e2e_latency(&_gw, 90), GW_E2E_MAX_MS),
+           _pct(p99, sizeof(p99), gw_e2e_latency(&_gw, 99), GW_E2E_MAX_MS),
+           _gw.e2e_max / 1000.0, (unsigned long long)_gw.e2e_numof);
+}
+
+/* Replayed records wait for their device time, relative to the first one */
+static void _pace(const uint8_t *payload, size_t plen, uint64_t *base_ns, uint32_t *base_us) {
+    if (plen < HB_HDR_LEN) {
+        return;
+    }
+    uint32_t t_us = payload[4] | (payload[5] << 8) | (payload[6] << 16) |
+                    ((uint32_t)payload[7] << 24);
+    uint32_t dt_us = t_us - *base_us;
+
+    if (*base_ns == 0 || dt_us > HBGW_REBASE_US ||
+        *base_ns + dt_us * 1000ULL + HBGW_REBASE_US * 1000ULL < gw_now_ns()) {
+        *base_ns = gw_now_ns();
+        *base_us = t_us;
+        return;
+    }
+    *base_ns += dt_us * 1000ULL;
+    *base_us = t_us;
+    _sleep_until(*base_ns);
+}
+
+static void *_reader(void *arg) {
+    input_t *in = arg;
+    uint8_t buf[HBGW_READ_LEN];
+    size_t len = 0;
+
+    while (!atomic_load(&_stop)) {
+        /* wake up now and then to see the stop request */
+        struct pollfd pfd = { .fd = in->fd, .events = POLLIN };
+        if (poll(&pfd, 1, HBGW_POLL_MS) <= 0) {
+            continue;
+        }
+
+        ssize_t n = read(in->fd, buf + len, sizeof(buf) - len);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n <= 0) {
+            break;      // hang up
+        }
+        len += n;
+
+        size_t pos = 0, used;
+        const uint8_t *payload;
+        size_t plen;
+        hb_rec_t rec;
+        while ((rec = hb_unframe(buf + pos, len - pos, &used, &payload, &plen)) != HB_REC_NONE) {
+            hb_timesync_t ts;
+            if (rec == HB_REC_CTRL) {
+                /* unknown control records are for newer gateways */
+                if (hb_parse_timesync(payload, plen, &ts) == 0) {
+                    gw_reader_timesync(&in->rd, &ts);
+                }
+            }
+            else if (gw_reader_feed(&in->rd, payload, plen, gw_now_ns()) != 0) {
+                /* not a record after all, resync after its sync byte */
+                used = (size_t)(payload - buf) - pos - 1;
+            }
+            pos += used;
+        }
+        pos += used;
+        memmove(buf, buf + pos, len - pos);
+        len -= pos;
+    }
+
+    close(in->fd);
+    atomic_fetch_sub(&_active, 1);
+    return NULL;
+}
+
+static void *_replay(void *arg) {
+    input_t *in = arg;
+    const uint8_t *payload;
+    size_t plen;
+    uint64_t base_ns = 0;
+    uint32_t base_us = 0;
+    hb_rec_t rec;
+
+    while (!atomic_load(&_stop) &&
+           (rec = hb_capture_record(&in->cap, &payload, &plen)) != HB_REC_NONE) {
+        /* no latency in a replay, the reception time isn't the recorded one */
+        if (rec == HB_REC_CTRL) {
+            continue;
+        }
+        if (_realtime) {
+            _pace(payload, plen, &base_ns, &base_us);
+        }
+        if (gw_reader_feed(&in->rd, payload, plen, gw_now_ns()) != 0) {
+            hb_capture_resync(&in->cap, payload);
+        }
+    }
+
+    hb_capture_close(&in->cap);
+    atomic_fetch_sub(&_active, 1);
+    return NULL;
+}
+
+static void *_listener(void *arg) {
+    int sock = *(int *)arg;
+    unsigned conn = 0;
+
+    while (!atomic_load(&_stop)) {
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        if (poll(&pfd, 1, HBGW_POLL_MS) <= 0) {
+            continue;
+        }
+        int fd = accept(sock, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+
+        char name[GW_NAME_LEN];
+        snprintf(name, sizeof(name), "unix:%u", conn++);
+        int board = gw_add_board(&_gw, name);
+        input_t *in = malloc(sizeof(*in));
+        if (board < 0 || in == NULL) {
+            fprintf(stderr, "[HBGW] %s refused, out of boards\n", name);
+            free(in);
+            close(fd);
+            continue;
+        }
+
+        in->kind = INPUT_CONN;
+        in->fd = fd;
+        gw_reader_init(&in->rd, &_gw, board);
+        atomic_fetch_add(&_active, 1);
+        if (pthread_create(&in->thread, NULL, _reader, in) != 0) {
+            atomic_fetch_sub(&_active, 1);
+            close(fd);
+            free(in);
+            continue;
+        }
+        pthread_detach(in->thread);     // the input leaks with the process, on exit
+    }
+
+    close(sock);
+    unlink(_sock_path);
+    return NULL;
+}
+
+static int _listen(const char *path, pthread_t *thread) {
+    static int sock;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return -ENAMETOOLONG;
+    }
+    strcpy(addr.sun_path, path);
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -errno;
+    }
+    unlink(path);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, 16) != 0) {
+        int res = -errno;
+        close(sock);
+        return res;
+    }
+
+    _sock_path = path;
+    _listening = 1;
+    return -pthread_create(thread, NULL, _listener, &sock);
+}
+
+static int _open(input_t *in, const char *path) {
+    struct stat st;
+
+    if (stat(path, &st) != 0) {
+        return -errno;
+    }
+    if (!S_ISCHR(st.st_mode)) {
+        in->kind = INPUT_FILE;
+        return hb_capture_open(&in->cap, path);
+    }
+
+    struct termios tio;
+    in->kind = INPUT_SERIAL;
+    in->fd = open(path, O_RDONLY | O_NOCTTY);
+    if (in->fd < 0) {
+        return -errno;
+    }
+    /* raw bytes; a USB CDC bridge ignores the baud rate */
+    if (tcgetattr(in->fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(in->fd, TCSANOW, &tio);
+    }
+    return 0;
+}
+
+/* ----------------------  Load test --------------------- */
+
+static uint32_t _xorshift(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Rest, then hang, with the phase of the board */
+static int32_t _sim_sample(uint64_t t_us, unsigned ch, uint32_t *rng) {
+    int32_t load = ((t_us % SIM_CYCLE_US) >= SIM_REST_US) ? SIM_HANG + 100 * (int32_t)ch : 0;
+    int32_t noise = (int32_t)(_xorshift(rng) % (2 * SIM_NOISE + 1)) - SIM_NOISE;
+    return (load + noise) * (1L << HB_FRAC_BITS);
+}
+
+static void *_sim(void *arg) {
+    input_t *in = arg;
+    uint32_t period = _gw.period_us;
+    uint32_t rng = 0x9e3779b9u ^ (in->rd.board * 2654435761u);
+    uint64_t t_us = (uint64_t)in->rd.board * 123457;   // phase of the board
+    uint64_t start_ns = gw_now_ns();
+    /* the bridge writes CLOCK_REALTIME, the estimate of a perfect link */
+    hb_timesync_t ts = {
+        .ref_us = t_us,
+        .offset_us = ((int64_t)start_ns + _gw.realtime_ns) / 1000 - (int64_t)t_us,
+        .count = 1,
+    };
+    hb_packet_t pkt = {
+        .format = _sim_format,
+        .channels = SIM_CHANNELS,
+        .count = hb_capacity(_sim_format, SIM_CHANNELS, _sim_payload),
+        .divider = 1,
+    };
+    uint8_t payload[HB_PAYLOAD_MAX];
+
+    if (!_sim_flat_out) {
+        gw_reader_timesync(&in->rd, &ts);
+    }
+
+    while (!atomic_load(&_stop)) {
+        pkt.t_us = t_us;
+        for (unsigned i = 0; i < pkt.count; i++) {
+            for (unsigned ch = 0; ch < SIM_CHANNELS; ch++) {
+                pkt.samples[i * SIM_CHANNELS + ch] = _sim_sample(t_us + i * period, ch, &rng);
+            }
+        }
+        size_t len = hb_encode(payload, sizeof(payload), &pkt);
+        pkt.seq++;
+        t_us += pkt.count * period;
+
+        if (!_sim_flat_out) {
+            /* the notification arrives once its last frame is sampled */
+            _sleep_until(start_ns + (t_us - (uint64_t)in->rd.board * 123457) * 1000);
+        }
+
+        gw_reader_feed(&in->rd, payload, len, gw_now_ns());
+        in->packets++;
+        in->frames += pkt.count;
+    }
+
+    atomic_fetch_sub(&_active, 1);
+    return NULL;
+}
+
+/* Decoder alone, one thread, on a packet of the load test */
+static double _decode_rate(void) {
+    hb_packet_t pkt = {
+        .format = _sim_format,
+        .channels = SIM_CHANNELS,
+        .count = hb_capacity(_sim_format, SIM_CHANNELS, _sim_payload),
+        .divider = 1,
+    };
+    uint8_t payload[HB_PAYLOAD_MAX];
+    uint32_t rng = 1;
+    uint64_t numof = 0;
+
+    for (unsigned i = 0; i < pkt.count * SIM_CHANNELS; i++) {
+        pkt.samples[i] = _sim_sample(SIM_REST_US + i * _gw.period_us, i % SIM_CHANNELS, &rng);
+    }
+    size_t len = hb_encode(payload, sizeof(payload), &pkt);
+
+    uint64_t start_ns = gw_now_ns(), elapsed_ns;
+    do {
+        for (unsigned i = 0; i < 1000; i++) {
+            hb_decode(payload, len, &pkt);
+        }
+        numof += 1000;
+        elapsed_ns = gw_now_ns() - start_ns;
+    } while (elapsed_ns < SIM_DECODE_NS);
+
+    return numof * pkt.count * SIM_CHANNELS * 1e3 / elapsed_ns;
+}
+
+static int _load_test(void) {
+    input_t *sims = calloc(_sim_boards, sizeof(*sims));
+    if (sims == NULL) {
+        return -ENOMEM;
+    }
+
+    for (unsigned i = 0; i < _sim_boards; i++) {
+        char name[GW_NAME_LEN];
+        snprintf(name, sizeof(name), "sim%04u", i);
+        int board = gw_add_board(&_gw, name);
+        if (board < 0) {
+            _sim_boards = i;
+            break;
+        }
+        sims[i].kind = INPUT_SIM;
+        gw_reader_init(&sims[i].rd, &_gw, board);
+    }
+    if (hb_capacity(_sim_format, SIM_CHANNELS, _sim_payload) == 0) {
+        free(sims);
+        return -EINVAL;
+    }
+
+    printf("[HBGW] load test: %u boards, %u s, %u frames per packet%s\n", _sim_boards,
+           _sim_secs, hb_capacity(_sim_format, SIM_CHANNELS, _sim_payload),
+           _sim_flat_out ? ", flat out" : "");
+
+    uint64_t start_ns = gw_now_ns();
+    uint64_t end_ns = start_ns + _sim_secs * 1000000000ULL;
+    unsigned started = 0;
+    for (; started < _sim_boards; started++) {
+        atomic_fetch_add(&_active, 1);
+        if (pthread_create(&sims[started].thread, NULL, _sim, &sims[started]) != 0) {
+            atomic_fetch_sub(&_active, 1);
+            break;
+        }
+    }
+
+    while (!atomic_load(&_stop) && gw_now_ns() < end_ns) {
+        gw_poll(&_gw, HBGW_POLL_MS);
+    }
+    atomic_store(&_stop, 1);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(sims[i].thread, NULL);
+    }
+    while (gw_poll(&_gw, 0) != 0) {}
+    double secs = (gw_now_ns() - start_ns) / 1e9;
+
+    uint64_t packets = 0, frames = 0;
+    for (unsigned i = 0; i < started; i++) {
+        packets += sims[i].packets;
+        frames += sims[i].frames;
+    }
+    uint64_t samples = frames * SIM_CHANNELS;
+    uint32_t sessions = 0;
+    for (unsigned i = 0; i < started; i++) {
+        sessions += gw_board(&_gw, sims[i].rd.board)->sessions;
+    }
+
+    printf("boards    %u (%u threads), %.1f s\n", started, started, secs);
+    printf("traffic   %llu packets, %llu samples, %u sessions\n",
+           (unsigned long long)packets, (unsigned long long)samples, (unsigned)sessions);
+    printf("decode    %.1f Msamples/s, one thread\n", _decode_rate());
+    printf("overall   %.1f Msamples/s, %.0f packets/s\n", samples / secs / 1e6, packets / secs);
+    char p50[16], p90[16], p99[16], p999[16];
+    printf("latency   p50 %s us, p90 %s us, p99 %s us, p99.9 %s us, max %llu us\n",
+           _pct(p50, sizeof(p50), gw_latency(&_gw, 50), GW_LATENCY_MAX_US),
+           _pct(p90, sizeof(p90), gw_latency(&_gw, 90), GW_LATENCY_MAX_US),
+           _pct(p99, sizeof(p99), gw_latency(&_gw, 99), GW_LATENCY_MAX_US),
+           _pct(p999, sizeof(p999), gw_latency(&_gw, 99.9), GW_LATENCY_MAX_US),
+           (unsigned long long)_gw.latency_max);
+    _print_e2e();
+    printf("queue     %lu stalls on a full queue\n", (unsigned long)atomic_load(&_gw.stalls));
+
+    free(sims);
+    return 0;
+}
+
+static void _usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [options] input...\n"
+            "       %s -L boards [-d s] [-F] [-P bytes] [-f format]\n"
+            "inputs: serial port or pty, capture file, unix:<path> (listening socket)\n"
+            "  -p us      sample period of the boards (%u)\n"
+            "  -t cg      hang threshold, 0.01 kg (%d)\n"
+            "  -i ms      live state interval, 0 for sessions only (1000)\n"
+            "  -r         replay the captures in real time\n"
+            "  -L boards  load test with simulated boards, no inputs\n"
+            "  -d s       load test duration (10)\n"
+            "  -F         load test flat out, instead of the real rate\n"
+            "  -P bytes   load test notification payload (%u)\n"
+            "  -f format  load test sample format, 0 delta8, 1 int16, 2 fixed24 (1)\n",
+            name, name, GW_PERIOD_US, GW_THRESHOLD, HB_PAYLOAD_MAX);
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(int argc, char **argv) {
+    int opt;
+    uint32_t period_us = GW_PERIOD_US;
+    int32_t threshold = GW_THRESHOLD;
+
+    while ((opt = getopt(argc, argv, "p:t:i:rL:d:FP:f:h")) != -1) {
+        switch (opt) {
+        case 'p': period_us = strtoul(optarg, NULL, 0); break;
+        case 't': threshold = strtol(optarg, NULL, 0); break;
+        case 'i': _interval_ms = strtoul(optarg, NULL, 0); break;
+        case 'r': _realtime = 1; break;
+        case 'L': _sim_boards = strtoul(optarg, NULL, 0); break;
+        case 'd': _sim_secs = strtoul(optarg, NULL, 0); break;
+        case 'F': _sim_flat_out = 1; break;
+        case 'P': _sim_payload = strtoul(optarg, NULL, 0); break;
+        case 'f': _sim_format = strtoul(optarg, NULL, 0) % HB_FMT_NUMOF; break;
+        default:
+            _usage(argv[0]);
+            return (opt == 'h') ? 0 : 1;
+        }
+    }
+    if ((_sim_boards == 0) == (optind == argc) || period_us == 0) {
+        _usage(argv[0]);
+        return 1;
+    }
+
+    int res = gw_init(&_gw, HBGW_BOARDS_MAX, HBGW_QUEUE_LEN);
+    if (res != 0) {
+        fprintf(stderr, "[HBGW] init failed (%d)\n", res);
+        return 1;
+    }
+    _gw.period_us = period_us;
+    _gw.threshold = threshold;
+    _gw.on_session = _on_session;
+
+    struct sigaction sa = { .sa_handler = _on_signal };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (_sim_boards != 0) {
+        _gw.on_session = NULL;      // thousands of them, only counted
+        res = _load_test();
+        gw_free(&_gw);
+        return (res == 0) ? 0 : 1;
+    }
+
+    /* the inputs live as long as the process */
+    input_t *inputs = calloc(argc - optind, sizeof(*inputs));
+    pthread_t listener;
+    for (int i = optind; inputs != NULL && i < argc; i++) {
+        input_t *in = &inputs[i - optind];
+
+        if (strncmp(argv[i], "unix:", 5) == 0) {
+            if (_listening || (res = _listen(argv[i] + 5, &listener)) != 0) {
+                fprintf(stderr, "[HBGW] %s: can't listen (%d)\n", argv[i], res);
+                return 1;
+            }
+            continue;
+        }
+
+        int board = gw_add_board(&_gw, argv[i]);
+        if (board < 0 || (res = _open(in, argv[i])) != 0) {
+            fprintf(stderr, "[HBGW] %s: can't open (%d)\n", argv[i], res);
+            return 1;
+        }
+        gw_reader_init(&in->rd, &_gw, board);
+        atomic_fetch_add(&_active, 1);
+        void *(*fn)(void *) = (in->kind == INPUT_FILE) ? _replay : _reader;
+        if (pthread_create(&in->thread, NULL, fn, in) != 0) {
+            fprintf(stderr, "[HBGW] %s: no reader thread\n", argv[i]);
+            return 1;
+        }
+    }
+
+    uint64_t next_ns = gw_now_ns() + _interval_ms * 1000000ULL;
+    while (!atomic_load(&_stop)) {
+        gw_poll(&_gw, HBGW_POLL_MS);
+
+        if (_interval_ms != 0 && gw_now_ns() >= next_ns) {
+            _print_state();
+            gw_clear_peaks(&_gw);
+            next_ns += _interval_ms * 1000000ULL;
+        }
+        /* all the captures replayed, nothing more will come */
+        if (!_listening && atomic_load(&_active) == 0) {
+            while (gw_poll(&_gw, 0) != 0) {}
+            break;
+        }
+    }
+
+    atomic_store(&_stop, 1);
+    if (_listening) {
+        pthread_join(listener, NULL);
+    }
+    _print_state();
+    _print_e2e();
+    return 0;
+}
@@ -0,0 +1,275 @@
+/**
+ * @file
+ * @brief       Sample decoding kernels, scalar and x86 SIMD
+ *
+ * The vector kernels are compiled with per function target attributes and
+ * picked at run time, so one binary runs everywhere.
+ *
+ * - int16: sign extension of 8 (SSE4.1) or 16 (AVX2) samples, then the shift
+ *   to fine units.
+ * - fixed24: a byte shuffle puts every sample in the top 3 bytes of a lane,
+ *   an arithmetic shift sign-extends it.
+ * - delta8: the deltas are widened to int16 and summed per channel with a
+ *   log-step prefix sum (shifts of channels, 2 * channels... lanes), plus the
+ *   last frame of the previous block. Only for 1, 2, 4 or 8 channels, so a
+ *   block holds whole frames; other layouts go scalar.
+ *
+ * The vector loops stop before reading past the samples, the tails are
+ * scalar.
+ */
+
+#include "hbkernel.h"
+
+/* ----------------------  Defines --------------------- */
+#define HB_FINE(v)          ((int32_t)(v) * (1L << HB_FRAC_BITS))
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HB_X86              (1)
+#define HB_TARGET(isa)      __attribute__((target(isa)))
+#include <immintrin.h>
+#else
+#define HB_X86              (0)
+#endif
+
+/* ----------------------  Scalar --------------------- */
+
+static int16_t _get16(const uint8_t *p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+static void _int16_scalar(const uint8_t *in, int32_t *out, unsigned numof) {
+    for (unsigned i = 0; i < numof; i++, in += 2) {
+        out[i] = HB_FINE(_get16(in));
+    }
+}
+
+static void _fixed24_scalar(const uint8_t *in, int32_t *out, unsigned numof) {
+    for (unsigned i = 0; i < numof; i++, in += 3) {
+        uint32_t val = in[0] | (in[1] << 8) | ((uint32_t)in[2] << 16);
+        out[i] = (int32_t)(val << 8) >> 8;      // sign extension
+    }
+}
+
+static void _delta8_scalar(const uint8_t *in, int32_t *out, unsigned numof, unsigned channels,
+                           int16_t *prev) {
+    for (unsigned i = 0, ch = 0; i < numof; i++) {
+        prev[ch] += (int8_t)in[i];
+        out[i] = HB_FINE(prev[ch]);
+        if (++ch == channels) {
+            ch = 0;
+        }
+    }
+}
+
+static const hb_kernels_t _scalar = {
+    .int16 = _int16_scalar,
+    .fixed24 = _fixed24_scalar,
+    .delta8 = _delta8_scalar,
+};
+
+#if HB_X86
+
+/* Carry of delta8: the last `channels` int16 lanes of a block, repeated. One
+ * mask per log2(channels) */
+static const int8_t _carry_mask[4][16] = {
+    { 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15, 14, 15 },
+    { 12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15 },
+    { 8, 9, 10, 11, 12, 13, 14, 15, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+};
+
+/* Lane k gets the 3 bytes of sample k in its top bytes, -1 clears the bottom one */
+static const int8_t _fixed24_mask[16] = {
+    -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+};
+
+static int _vector_channels(unsigned channels) {
+    return channels <= 8 && (channels & (channels - 1)) == 0;
+}
+
+static void _carry_init(int16_t *lanes, unsigned numof, unsigned channels, const int16_t *prev) {
+    for (unsigned j = 0; j < numof; j++) {
+        lanes[j] = prev[j % channels];
+    }
+}
+
+/* ----------------------  SSE4.1 --------------------- */
+
+HB_TARGET("sse4.1")
+static void _int16_sse41(const uint8_t *in, int32_t *out, unsigned numof) {
+    unsigned i = 0;
+
+    for (; i + 8 <= numof; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + 2 * i));
+        __m128i lo = _mm_cvtepi16_epi32(x);
+        __m128i hi = _mm_cvtepi16_epi32(_mm_srli_si128(x, 8));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_slli_epi32(lo, HB_FRAC_BITS));
+        _mm_storeu_si128((__m128i *)(out + i + 4), _mm_slli_epi32(hi, HB_FRAC_BITS));
+    }
+    _int16_scalar(in + 2 * i, out + i, numof - i);
+}
+
+HB_TARGET("sse4.1")
+static void _fixed24_sse41(const uint8_t *in, int32_t *out, unsigned numof) {
+    const __m128i mask = _mm_loadu_si128((const __m128i *)_fixed24_mask);
+    unsigned i = 0;
+
+    /* 4 samples are 12 bytes, the load takes 16 */
+    for (; 3 * i + 16 <= 3 * numof; i += 4) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + 3 * i));
+        x = _mm_srai_epi32(_mm_shuffle_epi8(x, mask), 8);
+        _mm_storeu_si128((__m128i *)(out + i), x);
+    }
+    _fixed24_scalar(in + 3 * i, out + i, numof - i);
+}
+
+HB_TARGET("sse4.1")
+static void _delta8_sse41(const uint8_t *in, int32_t *out, unsigned numof, unsigned channels,
+                          int16_t *prev) {
+    unsigned i = 0;
+
+    if (_vector_channels(channels)) {
+        const __m128i mask = _mm_loadu_si128((const __m128i *)_carry_mask[__builtin_ctz(channels)]);
+        int16_t lanes[8];
+        _carry_init(lanes, 8, channels, prev);
+        __m128i carry = _mm_loadu_si128((const __m128i *)lanes);
+
+        for (; i + 8 <= numof; i += 8) {
+            __m128i x = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i *)(in + i)));
+            if (channels == 1) {
+                x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+            }
+            if (channels <= 2) {
+                x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+            }
+            if (channels <= 4) {
+                x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+            }
+            x = _mm_add_epi16(x, carry);
+
+            __m128i lo = _mm_cvtepi16_epi32(x);
+            __m128i hi = _mm_cvtepi16_epi32(_mm_srli_si128(x, 8));
+            _mm_storeu_si128((__m128i *)(out + i), _mm_slli_epi32(lo, HB_FRAC_BITS));
+            _mm_storeu_si128((__m128i *)(out + i + 4), _mm_slli_epi32(hi, HB_FRAC_BITS));
+            carry = _mm_shuffle_epi8(x, mask);
+        }
+
+        _mm_storeu_si128((__m128i *)lanes, carry);
+        for (unsigned ch = 0; ch < channels; ch++) {
+            prev[ch] = lanes[ch];
+        }
+    }
+    /* whole frames so far, the tail starts on channel 0 */
+    _delta8_scalar(in + i, out + i, numof - i, channels, prev);
+}
+
+static const hb_kernels_t _sse41 = {
+    .int16 = _int16_sse41,
+    .fixed24 = _fixed24_sse41,
+    .delta8 = _delta8_sse41,
+};
+
+/* ----------------------  AVX2 --------------------- */
+
+HB_TARGET("avx2")
+static void _int16_avx2(const uint8_t *in, int32_t *out, unsigned numof) {
+    unsigned i = 0;
+
+    for (; i + 16 <= numof; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i *)(in + 2 * i));
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_slli_epi32(lo, HB_FRAC_BITS));
+        _mm256_storeu_si256((__m256i *)(out + i + 8), _mm256_slli_epi32(hi, HB_FRAC_BITS));
+    }
+    _int16_scalar(in + 2 * i, out + i, numof - i);
+}
+
+HB_TARGET("avx2")
+static void _fixed24_avx2(const uint8_t *in, int32_t *out, unsigned numof) {
+    const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)_fixed24_mask));
+    unsigned i = 0;
+
+    /* 8 samples are 24 bytes, the second load ends at byte 28 */
+    for (; 3 * i + 28 <= 3 * numof; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(in + 3 * i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(in + 3 * i + 12));
+        __m256i x = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        x = _mm256_srai_epi32(_mm256_shuffle_epi8(x, mask), 8);
+        _mm256_storeu_si256((__m256i *)(out + i), x);
+    }
+    _fixed24_scalar(in + 3 * i, out + i, numof - i);
+}
+
+HB_TARGET("avx2")
+static void _delta8_avx2(const uint8_t *in, int32_t *out, unsigned numof, unsigned channels,
+                         int16_t *prev) {
+    unsigned i = 0;
+
+    if (_vector_channels(channels)) {
+        const __m256i mask = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i *)_carry_mask[__builtin_ctz(channels)]));
+        int16_t lanes[16];
+        _carry_init(lanes, 16, channels, prev);
+        __m256i carry = _mm256_loadu_si256((const __m256i *)lanes);
+
+        for (; i + 16 <= numof; i += 16) {
+            __m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i *)(in + i)));
+            /* the shifts stay within each 128 bit half */
+            if (channels == 1) {
+                x = _mm256_add_epi16(x, _mm256_slli_si256(x, 2));
+            }
+            if (channels <= 2) {
+                x = _mm256_add_epi16(x, _mm256_slli_si256(x, 4));
+            }
+            if (channels <= 4) {
+                x = _mm256_add_epi16(x, _mm256_slli_si256(x, 8));
+            }
+            /* the last frame of the low half carries into the high half */
+            __m256i last = _mm256_shuffle_epi8(x, mask);
+            x = _mm256_add_epi16(x, _mm256_permute2x128_si256(last, last, 0x08));
+            x = _mm256_add_epi16(x, carry);
+
+            __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+            __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+            _mm256_storeu_si256((__m256i *)(out + i), _mm256_slli_epi32(lo, HB_FRAC_BITS));
+            _mm256_storeu_si256((__m256i *)(out + i + 8), _mm256_slli_epi32(hi, HB_FRAC_BITS));
+
+            last = _mm256_shuffle_epi8(x, mask);
+            carry = _mm256_permute2x128_si256(last, last, 0x11);
+        }
+
+        _mm256_storeu_si256((__m256i *)lanes, carry);
+        for (unsigned ch = 0; ch < channels; ch++) {
+            prev[ch] = lanes[ch];
+        }
+    }
+    _delta8_scalar(in + i, out + i, numof - i, channels, prev);
+}
+
+static const hb_kernels_t _avx2 = {
+    .int16 = _int16_avx2,
+    .fixed24 = _fixed24_avx2,
+    .delta8 = _delta8_avx2,
+};
+
+#endif /* HB_X86 */
+
+/* ----------------------  Public  --------------------- */
+
+const hb_kernels_t *hb_kernels(hb_isa_t isa) {
+    switch (isa) {
+    case HB_ISA_SCALAR:
+        return &_scalar;
+#if HB_X86
+    case HB_ISA_SSE41:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1") ? &_sse41 : NULL;
+    case HB_ISA_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? &_avx2 : NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
@@ -0,0 +1,35 @@
+/**
+ * @file
+ * @brief       Sample decoding kernels, scalar and x86 SIMD
+ *
+ * Private to the library. A kernel turns the packed samples of a packet into
+ * int32 in fine units (0.01 kg / 2^HB_FRAC_BITS). hb_decode() goes through
+ * the table of the selected instruction set, see hb_set_isa().
+ */
+
+#ifndef HBKERNEL_H
+#define HBKERNEL_H
+
+#include <stdint.h>
+
+#include "hbproto.h"
+
+/* ----------------------  Defines --------------------- */
+
+typedef struct {
+    /* numof int16 samples */
+    void (*int16)(const uint8_t *in, int32_t *out, unsigned numof);
+    /* numof int24 samples */
+    void (*fixed24)(const uint8_t *in, int32_t *out, unsigned numof);
+    /* numof int8 deltas of interleaved channels, the first one of channel 0.
+     * prev holds the last value of every channel, on entry and on return */
+    void (*delta8)(const uint8_t *in, int32_t *out, unsigned numof, unsigned channels,
+                   int16_t *prev);
+} hb_kernels_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Kernels of an instruction set, NULL if this CPU or build doesn't have it */
+const hb_kernels_t *hb_kernels(hb_isa_t isa);
+
+#endif /* HBKERNEL_H */
@@ -0,0 +1,254 @@
+/**
+ * @file
+ * @brief       Wire format of the hangboard stream, host side
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "hbkernel.h"
+#include "hbproto.h"
+
+/* ----------------------  Defines --------------------- */
+
+typedef struct {
+    uint8_t first_size;     // Bytes of a channel in the first frame of a packet
+    uint8_t size;           // Bytes of a channel in the following frames
+} hb_sizes_t;
+
+#define HB_FINE(v)          ((int32_t)(v) * (1L << HB_FRAC_BITS))
+
+/* ----------------------  Variables --------------------- */
+
+static const hb_kernels_t *_kernels;
+
+static const hb_sizes_t _sizes[HB_FMT_NUMOF] = {
+    [HB_FMT_DELTA8] = { 2, 1 },
+    [HB_FMT_INT16] = { 2, 2 },
+    [HB_FMT_FIXED24] = { 3, 3 },
+};
+
+/* ----------------------  Private  --------------------- */
+
+static int16_t _get16(const uint8_t *p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+static uint8_t *_put16(uint8_t *p, int32_t val) {
+    p[0] = (uint32_t)val & 0xff;
+    p[1] = ((uint32_t)val >> 8) & 0xff;
+    return p + 2;
+}
+
+static int32_t _clamp(int32_t val, int32_t min, int32_t max) {
+    return (val < min) ? min : (val > max) ? max : val;
+}
+
+/* Sample in 0.01 kg, like calib_coarse() in the firmware */
+static int16_t _coarse(int32_t sample) {
+    return _clamp(sample >> HB_FRAC_BITS, INT16_MIN, INT16_MAX);
+}
+
+/* Best kernels of the CPU, before main() */
+__attribute__((constructor))
+static void _isa_init(void) {
+    _kernels = hb_kernels(hb_isa_best());
+}
+
+/* ----------------------  Public  --------------------- */
+
+unsigned hb_capacity(hb_fmt_t format, unsigned channels, size_t len) {
+    const hb_sizes_t *sz = &_sizes[format];
+    size_t first = HB_HDR_LEN + sz->first_size * channels;
+
+    if (len > HB_PAYLOAD_MAX) {
+        len = HB_PAYLOAD_MAX;
+    }
+    if (len < first) {
+        return 0;
+    }
+    unsigned capacity = 1 + (len - first) / (sz->size * channels);
+    return (capacity > UINT8_MAX) ? UINT8_MAX : capacity;
+}
+
+hb_isa_t hb_isa_best(void) {
+    for (int isa = HB_ISA_NUMOF - 1; isa > HB_ISA_SCALAR; isa--) {
+        if (hb_kernels(isa) != NULL) {
+            return isa;
+        }
+    }
+    return HB_ISA_SCALAR;
+}
+
+int hb_set_isa(hb_isa_t isa) {
+    const hb_kernels_t *kernels = (isa < HB_ISA_NUMOF) ? hb_kernels(isa) : NULL;
+
+    if (kernels == NULL) {
+        return -ENOTSUP;
+    }
+    _kernels = kernels;
+    return 0;
+}
+
+hb_isa_t hb_get_isa(void) {
+    for (int isa = 0; isa < HB_ISA_NUMOF; isa++) {
+        if (hb_kernels(isa) == _kernels) {
+            return isa;
+        }
+    }
+    return HB_ISA_SCALAR;
+}
+
+const char *hb_isa_name(hb_isa_t isa) {
+    static const char *names[HB_ISA_NUMOF] = { "scalar", "sse4.1", "avx2" };
+    return (isa < HB_ISA_NUMOF) ? names[isa] : "?";
+}
+
+int hb_decode(const uint8_t *buf, size_t len, hb_packet_t *pkt) {
+    if (len < HB_HDR_LEN || len > HB_PAYLOAD_MAX) {
+        return -EINVAL;
+    }
+
+    unsigned divider = buf[8];
+    unsigned format = buf[1] & HB_FMT_MASK;
+    unsigned channels = buf[2];
+    unsigned count = buf[3];
+    if (!(buf[1] & HB_FLAG_TIMESTAMP) || format >= HB_FMT_NUMOF ||
+        channels == 0 || channels > HB_CHANNELS_MAX || count == 0 || divider == 0) {
+        return -EINVAL;
+    }
+
+    /* the length must match exactly, it is the only integrity check */
+    const hb_sizes_t *sz = &_sizes[format];
+    if (len != HB_HDR_LEN + (sz->first_size + (count - 1) * sz->size) * channels) {
+        return -EINVAL;
+    }
+
+    pkt->seq = buf[0];
+    pkt->format = format;
+    pkt->channels = channels;
+    pkt->count = count;
+    pkt->t_us = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((uint32_t)buf[7] << 24);
+    pkt->divider = divider;
+
+    const uint8_t *p = buf + HB_HDR_LEN;
+    unsigned numof = count * channels;
+
+    switch (format) {
+    case HB_FMT_DELTA8: {
+        int16_t prev[HB_CHANNELS_MAX];
+        for (unsigned ch = 0; ch < channels; ch++, p += 2) {
+            prev[ch] = _get16(p);
+            pkt->samples[ch] = HB_FINE(prev[ch]);
+        }
+        _kernels->delta8(p, pkt->samples + channels, numof - channels, channels, prev);
+        break;
+    }
+    case HB_FMT_INT16:
+        _kernels->int16(p, pkt->samples, numof);
+        break;
+    case HB_FMT_FIXED24:
+        _kernels->fixed24(p, pkt->samples, numof);
+        break;
+    }
+    return 0;
+}
+
+size_t hb_encode(uint8_t *buf, size_t len, const hb_packet_t *pkt) {
+    unsigned channels = pkt->channels;
+    if (pkt->format >= HB_FMT_NUMOF || channels == 0 || channels > HB_CHANNELS_MAX ||
+        pkt->count == 0 || pkt->count > hb_capacity(pkt->format, channels, len)) {
+        return 0;
+    }
+
+    buf[0] = pkt->seq;
+    buf[1] = pkt->format | HB_FLAG_TIMESTAMP;
+    buf[2] = channels;
+    buf[3] = pkt->count;
+    memcpy(&buf[4], &pkt->t_us, sizeof(pkt->t_us));     // hosts are little endian
+    buf[8] = (pkt->divider != 0) ? pkt->divider : 1;
+
+    uint8_t *p = buf + HB_HDR_LEN;
+    const int32_t *in = pkt->samples;
+    unsigned numof = pkt->count * channels;
+
+    switch (pkt->format) {
+    case HB_FMT_DELTA8: {
+        int16_t prev[HB_CHANNELS_MAX];
+        for (unsigned ch = 0; ch < channels; ch++) {
+            prev[ch] = _coarse(*in++);
+            p = _put16(p, prev[ch]);
+        }
+        for (unsigned i = channels; i < numof; i++) {
+            unsigned ch = i % channels;
+            /* a saturated delta is caught up by the next samples */
+            int32_t delta = _clamp(_coarse(*in++) - prev[ch], INT8_MIN, INT8_MAX);
+            prev[ch] += delta;
+            *p++ = (uint8_t)(int8_t)delta;
+        }
+        break;
+    }
+    case HB_FMT_INT16:
+        for (unsigned i = 0; i < numof; i++) {
+            p = _put16(p, _coarse(*in++));
+        }
+        break;
+    case HB_FMT_FIXED24:
+        for (unsigned i = 0; i < numof; i++) {
+            int32_t sample = _clamp(*in++, -0x800000, 0x7fffff);
+            p = _put16(p, sample);
+            *p++ = ((uint32_t)sample >> 16) & 0xff;
+        }
+        break;
+    }
+    return p - buf;
+}
+
+hb_rec_t hb_unframe(const uint8_t *data, size_t len, size_t *used,
+                    const uint8_t **payload, size_t *plen) {
+    size_t pos = 0;
+
+    /* skip the garbage up to the next sync byte */
+    while (pos < len && data[pos] != HB_SYNC && data[pos] != HB_SYNC_CTRL) {
+        pos++;
+    }
+    if (len - pos < 2 || len - pos < 2U + data[pos + 1]) {
+        *used = pos;
+        return HB_REC_NONE;
+    }
+
+    *payload = &data[pos + 2];
+    *plen = data[pos + 1];
+    *used = pos + 2 + data[pos + 1];
+    return (data[pos] == HB_SYNC) ? HB_REC_PACKET : HB_REC_CTRL;
+}
+
+size_t hb_frame(uint8_t *dst, const uint8_t *payload, size_t plen) {
+    dst[0] = HB_SYNC;
+    dst[1] = plen;
+    memcpy(&dst[2], payload, plen);
+    return plen + 2;
+}
+
+size_t hb_frame_timesync(uint8_t *dst, const hb_timesync_t *ts) {
+    dst[0] = HB_SYNC_CTRL;
+    dst[1] = 1 + sizeof(*ts);
+    dst[2] = HB_CTRL_TIMESYNC;
+    memcpy(&dst[3], ts, sizeof(*ts));   // hosts are little endian
+    return 3 + sizeof(*ts);
+}
+
+int hb_parse_timesync(const uint8_t *payload, size_t plen, hb_timesync_t *ts) {
+    if (plen != 1 + sizeof(*ts) || payload[0] != HB_CTRL_TIMESYNC) {
+        return -EINVAL;
+    }
+    memcpy(ts, &payload[1], sizeof(*ts));
+    return 0;
+}
+
+int64_t hb_client_us(const hb_timesync_t *ts, uint32_t t_us) {
+    /* from ref_us, the device time wraps every 71 min */
+    int32_t dt_us = (int32_t)(t_us - ts->ref_us);
+    return (int64_t)ts->ref_us + ts->offset_us + dt_us +
+           (int64_t)dt_us * ts->drift_ppb / 1000000000;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @brief       Wire format of the hangboard stream, host side
+ *
+ * Mirror of stream.h in the firmware: a packet is the payload of one stream
+ * notification. The header (seq, format | flags, channels, count) is followed
+ * by the uint32 device time of the first frame in us, then by the frames, one
+ * sample per channel, little endian.
+ *
+ * Over a byte stream (a serial port of a BLE central bridge, a capture file,
+ * a socket) every packet is framed as HB_SYNC, the payload length (uint8),
+ * then the payload. A corrupted record is caught by the length check of the
+ * decoder, the reader then resyncs on the next HB_SYNC.
+ *
+ * The bridge also passes what it reads from the time-sync characteristic, as
+ * control records: HB_SYNC_CTRL, the length, HB_CTRL_TIMESYNC and the 18 bytes
+ * of the estimate. With it, a device time maps to the client clock
+ * (hb_client_us()), and the gateway measures the latency from acquisition to
+ * the client.
+ *
+ * The samples are unpacked by SIMD kernels when the CPU has them (see
+ * hbkernel.c), with the same results as the scalar ones.
+ */
+
+#ifndef HBPROTO_H
+#define HBPROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+#define HB_PAYLOAD_MAX      (244U)  // Largest notification, with the largest ATT MTU
+#define HB_HDR_LEN          (9U)    // Header, timestamp and divider
+#define HB_CHANNELS_MAX     (8U)    // Load cells per board
+#define HB_SAMPLES_MAX      (HB_PAYLOAD_MAX)    // A sample takes at least one byte
+#define HB_FRAC_BITS        (8U)    // Fractional bits of the decoded samples, below 0.01 kg
+
+#define HB_FLAG_TIMESTAMP   (0x80)  // Always set by the firmware
+#define HB_FMT_MASK         (0x03)
+
+#define HB_SYNC             (0xA5)  // Start of a record in a byte stream
+#define HB_SYNC_CTRL        (0x5A)  // Start of a control record
+#define HB_RECORD_MAX       (2U + HB_PAYLOAD_MAX)
+
+#define HB_CTRL_TIMESYNC    (0x01)  // Time-sync estimate, hb_timesync_t follows
+
+/* Kind of a framed record */
+typedef enum {
+    HB_REC_NONE = 0,        // Incomplete, more bytes needed
+    HB_REC_PACKET = 1,      // Stream notification
+    HB_REC_CTRL = 2,        // Control record of the bridge
+} hb_rec_t;
+
+typedef enum {
+    HB_FMT_DELTA8 = 0,      // First frame int16, then int8 deltas [0.01 kg]
+    HB_FMT_INT16 = 1,       // int16 [0.01 kg]
+    HB_FMT_FIXED24 = 2,     // int24 [0.01 kg], HB_FRAC_BITS fractional bits
+    HB_FMT_NUMOF,
+} hb_fmt_t;
+
+/* Instruction sets of the decoder */
+typedef enum {
+    HB_ISA_SCALAR = 0,
+    HB_ISA_SSE41 = 1,
+    HB_ISA_AVX2 = 2,
+    HB_ISA_NUMOF,
+} hb_isa_t;
+
+/* Decoded packet */
+typedef struct {
+    uint8_t seq;            // Packet counter
+    uint8_t format;         // hb_fmt_t
+    uint8_t channels;       // Samples per frame
+    uint8_t count;          // Frames
+    uint32_t t_us;          // Device time of the first frame
+    uint8_t divider;        // Frames are divider sample periods apart, 0 is taken as 1 by hb_encode()
+    int32_t samples[HB_SAMPLES_MAX];    // Interleaved frames [0.01 kg / 2^HB_FRAC_BITS]
+} hb_packet_t;
+
+/* Time-sync estimate, mirror of timesync_t in the firmware (little endian) */
+typedef struct __attribute__((packed)) {
+    uint32_t ref_us;        // Device time of the estimate
+    int64_t offset_us;      // Client time - device time, at ref_us
+    int32_t drift_ppb;      // Client clock rate - device clock rate [1e-9]
+    uint16_t count;         // Writes since the connection, 0 before the first
+} hb_timesync_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Decode the payload of a notification. Returns 0, or -EINVAL if it isn't a
+ * well formed packet */
+int hb_decode(const uint8_t *buf, size_t len, hb_packet_t *pkt);
+
+/* Decoder instruction set, for all threads: call it before starting them. The
+ * best one of the CPU is picked at start up. Returns 0, or -ENOTSUP if the CPU
+ * or the build lacks it */
+int hb_set_isa(hb_isa_t isa);
+
+hb_isa_t hb_get_isa(void);
+
+/* Best instruction set of the CPU */
+hb_isa_t hb_isa_best(void);
+
+const char *hb_isa_name(hb_isa_t isa);
+
+/* Encode a packet the way the firmware does (saturation, delta carry over).
+ * Returns the payload length, 0 if it doesn't fit in len bytes */
+size_t hb_encode(uint8_t *buf, size_t len, const hb_packet_t *pkt);
+
+/* Frames that fit in a payload of len bytes */
+unsigned hb_capacity(hb_fmt_t format, unsigned channels, size_t len);
+
+/* Look for a record in a byte stream. Returns its hb_rec_t and sets payload
+ * and plen when one is complete, HB_REC_NONE when more bytes are needed. *used
+ * is the number of bytes consumed, the record included */
+hb_rec_t hb_unframe(const uint8_t *data, size_t len, size_t *used,
+               const uint8_t **payload, size_t *plen);
+
+/* Frame a payload into dst (HB_RECORD_MAX bytes). Returns the record length */
+size_t hb_frame(uint8_t *dst, const uint8_t *payload, size_t plen);
+
+/* Frame a time-sync estimate as a control record, the way the bridge does.
+ * Returns the record length */
+size_t hb_frame_timesync(uint8_t *dst, const hb_timesync_t *ts);
+
+/* Time-sync estimate of a control record. Returns 0, or -EINVAL if it isn't
+ * one */
+int hb_parse_timesync(const uint8_t *payload, size_t plen, hb_timesync_t *ts);
+
+/* Device time t_us on the client clock [us] */
+int64_t hb_client_us(const hb_timesync_t *ts, uint32_t t_us);
+
+#endif /* HBPROTO_H */
@@ -0,0 +1,334 @@
+/**
+ * @file
+ * @brief       Tests of the framing and of the codec, run by make check
+ *
+ * Captures are built in memory with hb_frame(), then damaged the way a
+ * serial bridge or a cut recording damages them: garbage between records, a
+ * false sync byte, a truncated last record. The reader must find every intact
+ * record and count the rest as errors. The codec round trips every format,
+ * with every instruction set of the CPU. The latency percentiles past the
+ * range of their histogram come out as such, not as a measure.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gateway.h"
+#include "hbcapture.h"
+#include "hbproto.h"
+
+/* ----------------------  Defines --------------------- */
+#define CAPTURE_MAX         (8U * HB_RECORD_MAX)
+
+#define CHECK(cond) \
+    do { \
+        _checks++; \
+        if (!(cond)) { \
+            _failures++; \
+            fprintf(stderr, "[TEST] %s:%d: %s failed\n", __func__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+/* ----------------------  Variables --------------------- */
+
+static unsigned _checks;
+static unsigned _failures;
+
+static uint8_t _buf[CAPTURE_MAX];
+static size_t _len;
+
+/* ----------------------  Private  --------------------- */
+
+/* A small packet of the capture, told apart by its seq */
+static void _add_packet(uint8_t seq) {
+    hb_packet_t pkt = {
+        .seq = seq,
+        .format = HB_FMT_INT16,
+        .channels = 2,
+        .count = 3,
+        .t_us = 1000U * seq,
+        .divider = 1,
+    };
+    uint8_t payload[HB_PAYLOAD_MAX];
+
+    for (unsigned i = 0; i < pkt.count * pkt.channels; i++) {
+        pkt.samples[i] = (int32_t)(seq * 100 + i) * (1L << HB_FRAC_BITS);
+    }
+    size_t plen = hb_encode(payload, sizeof(payload), &pkt);
+    _len += hb_frame(&_buf[_len], payload, plen);
+}
+
+static void _add_bytes(const uint8_t *bytes, size_t len) {
+    memcpy(&_buf[_len], bytes, len);
+    _len += len;
+}
+
+/* Decode the capture: the seq of the packets found, in order */
+static unsigned _walk(hb_capture_t *cap, uint8_t *seqs, unsigned max) {
+    hb_packet_t pkt;
+    unsigned numof = 0;
+
+    hb_capture_mem(cap, _buf, _len);
+    while (numof < max && hb_capture_next(cap, &pkt)) {
+        seqs[numof++] = pkt.seq;
+    }
+    return numof;
+}
+
+static uint32_t _xorshift(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* ----------------------  Tests --------------------- */
+
+static void test_unframe(void) {
+    static const uint8_t garbage[] = { 0x00, 0x13, 0xff };
+    const uint8_t *payload;
+    size_t used, plen;
+
+    /* the garbage before the sync is consumed with the record */
+    _len = 0;
+    _add_bytes(garbage, sizeof(garbage));
+    _add_packet(1);
+    CHECK(hb_unframe(_buf, _len, &used, &payload, &plen) == HB_REC_PACKET);
+    CHECK(used == _len);
+    CHECK(payload == &_buf[sizeof(garbage) + 2]);
+    CHECK(plen == _len - sizeof(garbage) - 2);
+
+    /* one byte short: nothing but the garbage is consumed, more is needed */
+    CHECK(hb_unframe(_buf, _len - 1, &used, &payload, &plen) == HB_REC_NONE);
+    CHECK(used == sizeof(garbage));
+    CHECK(hb_unframe(_buf, sizeof(garbage) + 1, &used, &payload, &plen) == HB_REC_NONE);
+    CHECK(used == sizeof(garbage));
+
+    /* only garbage: all of it */
+    CHECK(hb_unframe(garbage, sizeof(garbage), &used, &payload, &plen) == HB_REC_NONE);
+    CHECK(used == sizeof(garbage));
+}
+
+static void test_capture_false_sync_eof(void) {
+    /* a sync byte whose length runs past the end of the capture, with
+     * intact records after it */
+    static const uint8_t false_sync[] = { HB_SYNC, 200 };
+    uint8_t seqs[8];
+    hb_capture_t cap;
+
+    _len = 0;
+    _add_packet(1);
+    _add_bytes(false_sync, sizeof(false_sync));
+    _add_packet(2);
+    _add_packet(3);
+
+    CHECK(_walk(&cap, seqs, 8) == 3);
+    CHECK(seqs[0] == 1 && seqs[1] == 2 && seqs[2] == 3);
+    CHECK(cap.records == 3);
+    CHECK(cap.errors == 1);
+    CHECK(cap.pos == cap.len);
+}
+
+static void test_capture_truncated(void) {
+    uint8_t seqs[8];
+    hb_capture_t cap;
+
+    /* the recording stopped in the middle of the last record */
+    _len = 0;
+    _add_packet(1);
+    _add_packet(2);
+    _add_packet(3);
+    _len -= 4;
+
+    CHECK(_walk(&cap, seqs, 8) == 2);
+    CHECK(seqs[0] == 1 && seqs[1] == 2);
+    CHECK(cap.errors == 1);
+    CHECK(cap.pos == cap.len);
+
+    /* and again from the start */
+    hb_packet_t pkt;
+    hb_capture_rewind(&cap);
+    CHECK(cap.records == 0 && cap.errors == 0);
+    CHECK(hb_capture_next(&cap, &pkt) == 1 && pkt.seq == 1);
+}
+
+static void test_capture_garbage(void) {
+    /* without a sync byte, skipped silently */
+    static const uint8_t noise[] = { 0x00, 0x01, 0xfe, 0x42 };
+    /* with one: a record of 3 bytes, not a packet, resynced after its sync */
+    static const uint8_t fake[] = { 0x00, HB_SYNC, 3, 0x11, 0x22, 0x33, 0x44 };
+    uint8_t seqs[8];
+    hb_capture_t cap;
+
+    _len = 0;
+    _add_bytes(noise, sizeof(noise));
+    _add_packet(1);
+    _add_bytes(noise, sizeof(noise));
+    _add_packet(2);
+    _add_bytes(fake, sizeof(fake));
+    _add_packet(3);
+
+    CHECK(_walk(&cap, seqs, 8) == 3);
+    CHECK(seqs[0] == 1 && seqs[1] == 2 && seqs[2] == 3);
+    CHECK(cap.errors == 1);
+
+    /* a sync byte inside a record isn't one: the length check throws the
+     * false record away and the real one is found from the next byte */
+    static const uint8_t swallow[] = { HB_SYNC, 4 };
+    _len = 0;
+    _add_bytes(swallow, sizeof(swallow));
+    _add_packet(4);
+    CHECK(_walk(&cap, seqs, 8) == 1);
+    CHECK(seqs[0] == 4);
+    CHECK(cap.errors == 1);
+}
+
+static void test_capture_ctrl(void) {
+    hb_timesync_t ts = {
+        .ref_us = 123456,
+        .offset_us = -987654321012LL,
+        .drift_ppb = -1500,
+        .count = 7,
+    }, parsed;
+    uint8_t seqs[8];
+    hb_capture_t cap;
+    const uint8_t *payload;
+    size_t plen;
+
+    _len = 0;
+    _add_packet(1);
+    _len += hb_frame_timesync(&_buf[_len], &ts);
+    _add_packet(2);
+
+    /* the packets skip it, without an error */
+    CHECK(_walk(&cap, seqs, 8) == 2);
+    CHECK(seqs[0] == 1 && seqs[1] == 2);
+    CHECK(cap.errors == 0);
+
+    /* record by record, it comes out as it went in */
+    hb_capture_rewind(&cap);
+    CHECK(hb_capture_record(&cap, &payload, &plen) == HB_REC_PACKET);
+    CHECK(hb_capture_record(&cap, &payload, &plen) == HB_REC_CTRL);
+    CHECK(hb_parse_timesync(payload, plen, &parsed) == 0);
+    CHECK(memcmp(&ts, &parsed, sizeof(ts)) == 0);
+    CHECK(hb_parse_timesync(payload, plen - 1, &parsed) != 0);
+    CHECK(hb_capture_record(&cap, &payload, &plen) == HB_REC_PACKET);
+    CHECK(hb_capture_record(&cap, &payload, &plen) == HB_REC_NONE);
+
+    /* a stream payload isn't a time-sync estimate */
+    hb_capture_rewind(&cap);
+    CHECK(hb_capture_record(&cap, &payload, &plen) == HB_REC_PACKET);
+    CHECK(hb_parse_timesync(payload, plen, &parsed) != 0);
+}
+
+static void test_latency_saturated(void) {
+    gw_t gw;
+
+    CHECK(gw_init(&gw, 1, 16) == 0);
+    CHECK(gw_latency(&gw, 50) == 0);
+
+    /* half the packets in range, half far beyond it */
+    gw.latency[250] = 50;
+    gw.latency[GW_LATENCY_MAX_US] = 10;
+    gw.latency[GW_LATENCY_OVER] = 40;
+    gw.latency_numof = 100;
+    gw.latency_max = 10 * GW_LATENCY_MAX_US;
+    CHECK(gw_latency(&gw, 10) == 250);
+    CHECK(gw_latency(&gw, 55) == GW_LATENCY_MAX_US);
+    CHECK(gw_latency(&gw, 90) == GW_LATENCY_OVER);
+    CHECK(gw_latency(&gw, 99.9) == GW_LATENCY_OVER);
+
+    gw.e2e[GW_E2E_OVER] = 1;
+    gw.e2e_numof = 1;
+    CHECK(gw_e2e_latency(&gw, 50) == GW_E2E_OVER);
+
+    gw_free(&gw);
+}
+
+static void test_codec_roundtrip(hb_isa_t isa) {
+    uint32_t rng = 0x2545f491;
+
+    for (int format = 0; format < HB_FMT_NUMOF; format++) {
+        for (unsigned channels = 1; channels <= HB_CHANNELS_MAX; channels++) {
+            hb_packet_t pkt = {
+                .seq = 200 + format,
+                .format = format,
+                .channels = channels,
+                .count = hb_capacity(format, channels, HB_PAYLOAD_MAX),
+                .t_us = 0xfedcba98,
+                .divider = 3,
+            }, out;
+            uint8_t payload[HB_PAYLOAD_MAX];
+
+            /* steps that fit a delta, whole 0.01 kg but for fixed24 */
+            int32_t level[HB_CHANNELS_MAX];
+            for (unsigned ch = 0; ch < channels; ch++) {
+                level[ch] = -5000 + 1000 * (int32_t)ch;
+            }
+            for (unsigned i = 0; i < pkt.count * channels; i++) {
+                int32_t *l = &level[i % channels];
+                *l += (int32_t)(_xorshift(&rng) % 255) - 127;
+                pkt.samples[i] = *l * (1L << HB_FRAC_BITS);
+                if (format == HB_FMT_FIXED24) {
+                    pkt.samples[i] += _xorshift(&rng) & ((1U << HB_FRAC_BITS) - 1);
+                }
+            }
+
+            size_t plen = hb_encode(payload, sizeof(payload), &pkt);
+            CHECK(plen > 0);
+            CHECK(hb_decode(payload, plen, &out) == 0);
+            CHECK(out.seq == pkt.seq && out.format == pkt.format);
+            CHECK(out.channels == channels && out.count == pkt.count);
+            CHECK(out.t_us == pkt.t_us && out.divider == pkt.divider);
+            CHECK(memcmp(out.samples, pkt.samples,
+                         pkt.count * channels * sizeof(int32_t)) == 0);
+
+            /* the length is the integrity check */
+            CHECK(hb_decode(payload, plen - 1, &out) != 0);
+        }
+    }
+
+    /* saturated, like the firmware: int16 clamps, a delta catches up */
+    hb_packet_t pkt = { .format = HB_FMT_INT16, .channels = 1, .count = 2, .divider = 1 }, out;
+    uint8_t payload[HB_PAYLOAD_MAX];
+    pkt.samples[0] = 40000 * (1L << HB_FRAC_BITS);
+    pkt.samples[1] = -40000 * (1L << HB_FRAC_BITS);
+    CHECK(hb_decode(payload, hb_encode(payload, sizeof(payload), &pkt), &out) == 0);
+    CHECK(out.samples[0] == INT16_MAX * (1L << HB_FRAC_BITS));
+    CHECK(out.samples[1] == INT16_MIN * (1L << HB_FRAC_BITS));
+
+    pkt.format = HB_FMT_DELTA8;
+    pkt.count = 3;
+    pkt.samples[0] = 0;
+    pkt.samples[1] = 200 * (1L << HB_FRAC_BITS);
+    pkt.samples[2] = 200 * (1L << HB_FRAC_BITS);
+    CHECK(hb_decode(payload, hb_encode(payload, sizeof(payload), &pkt), &out) == 0);
+    CHECK(out.samples[1] == INT8_MAX * (1L << HB_FRAC_BITS));
+    CHECK(out.samples[2] == 200 * (1L << HB_FRAC_BITS));
+
+    printf("[TEST] round trip with %s\n", hb_isa_name(isa));
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(void) {
+    test_unframe();
+    test_capture_false_sync_eof();
+    test_capture_truncated();
+    test_capture_garbage();
+    test_capture_ctrl();
+    test_latency_saturated();
+
+    /* every decoder of the CPU */
+    hb_isa_t best = hb_get_isa();
+    for (int isa = 0; isa < HB_ISA_NUMOF; isa++) {
+        if (hb_set_isa(isa) == 0) {
+            test_codec_roundtrip(isa);
+        }
+    }
+    hb_set_isa(best);
+
+    printf("[TEST] %u checks, %u failed\n", _checks, _failures);
+    return (_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file
+ * @brief       Bounded lock-free queue, many producers and one consumer
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mpsc.h"
+
+/* ----------------------  Defines --------------------- */
+#define MPSC_LINE           (64U)
+
+typedef struct {
+    atomic_size_t seq;      // pos when free for pos, pos + 1 once filled
+    uint8_t data[];
+} mpsc_cell_t;
+
+/* ----------------------  Private  --------------------- */
+
+static mpsc_cell_t *_cell(const mpsc_t *q, size_t pos) {
+    return (mpsc_cell_t *)(q->cells + (pos & q->mask) * q->stride);
+}
+
+static int _filled(const mpsc_t *q) {
+    const mpsc_cell_t *cell = _cell(q, q->head);
+    return atomic_load_explicit(&cell->seq, memory_order_acquire) == q->head + 1;
+}
+
+/* ----------------------  Public  --------------------- */
+
+int mpsc_init(mpsc_t *q, size_t elem_size, size_t len) {
+    if (len == 0 || (len & (len - 1)) != 0) {
+        return -EINVAL;
+    }
+
+    q->elem_size = elem_size;
+    q->stride = (sizeof(mpsc_cell_t) + elem_size + MPSC_LINE - 1) & ~(MPSC_LINE - 1);
+    q->mask = len - 1;
+    q->cells = aligned_alloc(MPSC_LINE, len * q->stride);
+    if (q->cells == NULL) {
+        return -ENOMEM;
+    }
+    for (size_t i = 0; i < len; i++) {
+        atomic_init(&_cell(q, i)->seq, i);
+    }
+    atomic_init(&q->tail, 0);
+    q->head = 0;
+    atomic_init(&q->sleeping, 0);
+    sem_init(&q->wake, 0, 0);
+    return 0;
+}
+
+void mpsc_free(mpsc_t *q) {
+    sem_destroy(&q->wake);
+    free(q->cells);
+    q->cells = NULL;
+}
+
+int mpsc_push(mpsc_t *q, const void *elem) {
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    mpsc_cell_t *cell;
+
+    for (;;) {
+        cell = _cell(q, pos);
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            /* free, try to reserve it. On failure pos is the new tail */
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (dif < 0) {
+            return -EAGAIN;     // the consumer didn't free it yet, full
+        }
+        else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(cell->data, elem, q->elem_size);
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+    /* pairs with the fence of mpsc_wait(): either the consumer sees the
+     * element, or this sees the consumer going to sleep */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->sleeping, memory_order_relaxed) &&
+        atomic_exchange(&q->sleeping, 0)) {
+        sem_post(&q->wake);
+    }
+    return 0;
+}
+
+int mpsc_pop(mpsc_t *q, void *elem) {
+    mpsc_cell_t *cell = _cell(q, q->head);
+
+    if (!_filled(q)) {
+        return -EAGAIN;
+    }
+    memcpy(elem, cell->data, q->elem_size);
+    /* free for the producers of the next lap */
+    atomic_store_explicit(&cell->seq, q->head + q->mask + 1, memory_order_release);
+    q->head++;
+    return 0;
+}
+
+void mpsc_wait(mpsc_t *q, unsigned timeout_ms) {
+    atomic_store_explicit(&q->sleeping, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!_filled(q)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += timeout_ms / 1000;
+        ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        while (sem_timedwait(&q->wake, &ts) != 0 && errno == EINTR) {}
+    }
+    atomic_store_explicit(&q->sleeping, 0, memory_order_relaxed);
+}
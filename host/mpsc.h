@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief       Bounded lock-free queue, many producers and one consumer
+ *
+ * A ring of fixed size elements, each with a sequence number telling whether
+ * it is free or filled (D. Vyukov's bounded queue). Producers reserve a slot
+ * with a compare-and-swap on the tail, and publish it by bumping its sequence.
+ * The consumer is the only one to touch the head, it needs no atomic RMW.
+ *
+ * The consumer sleeps on a semaphore when the queue is empty. Producers only
+ * post it when the consumer said it is going to sleep, so a busy queue makes
+ * no system call.
+ */
+
+#ifndef MPSC_H
+#define MPSC_H
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+
+typedef struct {
+    uint8_t *cells;
+    size_t elem_size;
+    size_t stride;          // Cells are cache line aligned, producers don't share lines
+    size_t mask;
+    _Alignas(64) atomic_size_t tail;    // Next slot to reserve, producers
+    _Alignas(64) size_t head;           // Next slot to read, consumer
+    atomic_int sleeping;                // The consumer waits for the semaphore
+    sem_t wake;
+} mpsc_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Room for len elements of elem_size bytes, len a power of 2. Returns 0, or
+ * -EINVAL / -ENOMEM */
+int mpsc_init(mpsc_t *q, size_t elem_size, size_t len);
+
+void mpsc_free(mpsc_t *q);
+
+/* Copy an element in, from any thread. Returns 0, or -EAGAIN when full */
+int mpsc_push(mpsc_t *q, const void *elem);
+
+/* Copy the oldest element out, consumer only. Returns 0, or -EAGAIN when empty */
+int mpsc_pop(mpsc_t *q, void *elem);
+
+/* Wait until the queue isn't empty, or timeout_ms. Consumer only */
+void mpsc_wait(mpsc_t *q, unsigned timeout_ms);
+
+#endif /* MPSC_H */
@@ -0,0 +1,114 @@
+/**
+ * @file
+ * @brief       Latency probe, from acquisition to the air
+ *
+ * One value per probe is in flight at a time: NimBLE reports the NOTIFY_TX of
+ * a notification from within ble_gatts_notify_custom(), and only one Weight
+ * Measurement indication waits for its confirmation. A value sent before the
+ * previous one completed replaces its stamp, and isn't counted twice.
+ */
+
+#if LATENCY_ENABLE
+
+#include <stdio.h>
+#include <string.h>
+
+#include "irq.h"
+#include "ztimer.h"
+
+#include "latency.h"
+
+/* ----------------------  Defines --------------------- */
+
+typedef struct {
+    uint32_t acq_us;            // Stamp of the value in flight
+    uint8_t in_flight;
+    uint32_t count;
+    uint32_t failed;            // NOTIFY_TX with an error
+    uint32_t max_us;
+    uint32_t bins[LATENCY_MAX_MS + 1];
+} latency_hist_t;
+
+/* ----------------------  Variables --------------------- */
+
+static latency_hist_t _hist[LATENCY_NUMOF];
+
+/* ----------------------  Private  --------------------- */
+
+/* Upper bound of the bin holding the given percentile [ms] */
+static unsigned _percentile(const latency_hist_t *hist, unsigned pct) {
+    uint32_t rank = (uint64_t)hist->count * pct / 100;
+    uint32_t seen = 0;
+
+    for (unsigned ms = 0; ms <= LATENCY_MAX_MS; ms++) {
+        seen += hist->bins[ms];
+        if (seen > rank) {
+            return ms + 1;
+        }
+    }
+    return LATENCY_MAX_MS + 1;
+}
+
+/* ----------------------  Public  --------------------- */
+
+void latency_sent(latency_probe_t probe, uint32_t acq_us) {
+    unsigned state = irq_disable();
+    _hist[probe].acq_us = acq_us;
+    _hist[probe].in_flight = 1;
+    irq_restore(state);
+}
+
+void latency_tx(latency_probe_t probe, int ok) {
+    uint32_t now_us = ztimer_now(ZTIMER_USEC);
+    latency_hist_t *hist = &_hist[probe];
+
+    unsigned state = irq_disable();
+    if (hist->in_flight) {
+        hist->in_flight = 0;
+        if (ok) {
+            uint32_t lat_us = now_us - hist->acq_us;
+            uint32_t ms = lat_us / 1000;
+            hist->bins[(ms < LATENCY_MAX_MS) ? ms : LATENCY_MAX_MS]++;
+            hist->count++;
+            if (lat_us > hist->max_us) {
+                hist->max_us = lat_us;
+            }
+        }
+        else {
+            hist->failed++;
+        }
+    }
+    irq_restore(state);
+}
+
+int latency_print(int argc, char **argv) {
+    static const char *names[LATENCY_NUMOF] = { "stream", "wss" };
+
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        unsigned state = irq_disable();
+        for (unsigned i = 0; i < LATENCY_NUMOF; i++) {
+            uint8_t in_flight = _hist[i].in_flight;
+            uint32_t acq_us = _hist[i].acq_us;
+            memset(&_hist[i], 0, sizeof(_hist[i]));
+            _hist[i].in_flight = in_flight;
+            _hist[i].acq_us = acq_us;
+        }
+        irq_restore(state);
+        return 0;
+    }
+
+    puts("probe      count  failed  p50 [ms]  p90 [ms]  p99 [ms]  max [ms]");
+    for (unsigned i = 0; i < LATENCY_NUMOF; i++) {
+        const latency_hist_t *hist = &_hist[i];
+        if (hist->count == 0) {
+            printf("%-7s  %7u  %6lu\n", names[i], 0, (unsigned long)hist->failed);
+            continue;
+        }
+        printf("%-7s  %7lu  %6lu  %8u  %8u  %8u  %8lu\n", names[i], (unsigned long)hist->count,
+               (unsigned long)hist->failed, _percentile(hist, 50), _percentile(hist, 90),
+               _percentile(hist, 99), (unsigned long)(hist->max_us / 1000));
+    }
+    return 0;
+}
+
+#endif /* LATENCY_ENABLE */
@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief       Latency probe, from acquisition to the air
+ *
+ * Opt-in (make LATENCY=1, LATENCY_ENABLE=1): without it the macros below
+ * expand to nothing.
+ *
+ * Every value sent carries the acquisition time of the samples it is made of:
+ * the frame time for the stream (the newest frame of a packet), the frame time
+ * minus the filter delay for the Weight Measurement. The stamp is taken when
+ * the value is handed to the host and the latency is recorded on its
+ * BLE_GAP_EVENT_NOTIFY_TX: for a notification that is when the host passed it
+ * to the controller, it goes on air at the next connection event; for an
+ * indication, when the client confirmed it.
+ *
+ * The "latency" shell command prints the percentiles of every probe. The rest
+ * of the way, to the client, is measured by the host gateway (host/hbgw), from
+ * the stream timestamps and the time-sync estimate.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+#ifndef LATENCY_MAX_MS
+#define LATENCY_MAX_MS      (255U)  // Range of the histograms, 1 ms bins, above goes to the last
+#endif
+
+typedef enum {
+    LATENCY_STREAM = 0,     // Newest frame of a stream packet to its notification
+    LATENCY_WSS = 1,        // Filtered weight to its confirmed indication
+    LATENCY_NUMOF,
+} latency_probe_t;
+
+#if LATENCY_ENABLE
+
+/* A value with samples acquired at acq_us (ZTIMER_USEC) goes to the host */
+#define LATENCY_SENT(probe, acq_us) latency_sent(probe, acq_us)
+
+/* Its NOTIFY_TX event, status 0 or BLE_HS_EDONE when it went out */
+#define LATENCY_TX(probe, ok)       latency_tx(probe, ok)
+
+/* ----------------------  Prototypes --------------------- */
+
+void latency_sent(latency_probe_t probe, uint32_t acq_us);
+void latency_tx(latency_probe_t probe, int ok);
+
+/* Print the percentiles, the shell "latency" command. "latency reset" clears
+ * the histograms */
+int latency_print(int argc, char **argv);
+
+#else
+
+#define LATENCY_SENT(probe, acq_us) (void)(acq_us)
+#define LATENCY_TX(probe, ok)       (void)(ok)
+
+#endif /* LATENCY_ENABLE */
+
+#endif /* LATENCY_H */
@@ -32,13 +32,13 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <nrf.h>
-
-#include "event/timeout.h"
+#include "event.h"
 #include "host/ble_gatt.h"
 #include "host/ble_hs.h"
 #include "host/util/util.h"
@@ -51,303 +51,415 @@
 #include "services/gap/ble_svc_gap.h"
 #include "services/gatt/ble_svc_gatt.h"
 
-/* ----------------------  Defines --------------------- */
-#define BLE_GATT_SVC_ESS 0x181A         // Environmental Sensing Service
-#define BLE_GATT_CHAR_TEMP 0x2A6E       // Temperature Characteristic
-
-#define GATT_DEVICE_INFO_UUID                   0x180A
-#define GATT_MANUFACTURER_NAME_UUID             0x2A29
-#define GATT_MODEL_NUMBER_UUID                  0x2A24
+#include "shell.h"
+#include "thread.h"
+#include "ztimer.h"
+
+#include "adv_sched.h"
+#include "battery.h"
+#include "bond.h"
+#include "boot.h"
+#include "broadcast.h"
+#include "calib.h"
+#include "conn.h"
+#include "gatt_svcs.h"
+#include "latency.h"
+#include "pipeline.h"
+#include "pool.h"
+#include "power.h"
+#include "prof.h"
+#include "sensor.h"
+#include "stream.h"
+#include "tasks.h"
+#include "timesync.h"
+#include "workout.h"
 
-#define UPDATE_INTERVAL     (250U)   // miliseconds between temperature updates
-#define BAT_LEVEL           (42U)
+/* ----------------------  Defines --------------------- */
+#define SAMPLE_INTERVAL     (1000U / SENSOR_RATE_HZ)    // miliseconds between samples
+#define WSS_INTERVAL        (1000U)  // miliseconds between Weight Measurement indications
+#define BROADCAST_DECIMATION (BROADCAST_ITVL_MS / SAMPLE_INTERVAL)  // samples per broadcast update
+#define HANG_THRESHOLD      (500)    // measurements above this count as somebody hanging
 
 /* ----------------------  Variables --------------------- */
 
-// Names of the Device Info service Characteristics
-static const char *_manufacturer_name = "Personal Project";
-static const char *_model_number = "1";
-static const char *_serial_number = "1";
-static const char *_fw_ver = "0.1";
-static const char *_hw_ver = "0.1";
+static int32_t _weight;           // Latest filtered weight, all channels [0.01 kg]
+static unsigned _sample_cnt;      // Samples since boot, for the low rate consumers
+static broadcast_state_t _state;  // Session state, from the last measurement
 
-// Global variable for the temperature notify
-static uint16_t _temp_val_handle;  // THis is not the temperature value, is just a kind of like an UUID for identifying the actual value.
-                                    // It HAS to be a uint16_t, irrespective of what the actual data is.
-static uint16_t _conn_handle;     // Handle for the BLE connection
+static event_t _deferred_init_evt;
 
-// Periodic event callback  variables
-static event_queue_t _eq;
-static event_t _update_evt;
-static event_timeout_t _update_timeout_evt;
+// Shell, in its own thread so the event loop keeps running
+static char _shell_stack[THREAD_STACKSIZE_DEFAULT];
 
 /* ----------------------  Prototypes --------------------- */
 
-static int
-_devinfo_handler(uint16_t conn_handle, uint16_t attr_handle,
-                    struct ble_gatt_access_ctxt *ctxt, void *arg);
-
-static int _bas_handler(uint16_t conn_handle, uint16_t attr_handle,
-                        struct ble_gatt_access_ctxt *ctxt, void *arg);
-
-static int _temp_handler(uint16_t conn_handle, uint16_t attr_handle,
-                        struct ble_gatt_access_ctxt *ctxt, void *arg);
-
-static void _temp_update(event_t *e);
-
-int16_t read_temperature(void);
-
-void init_rng(void);
-uint8_t read_rng(void);
-
-/* ----------------------  GATT SERVICE DEFINITION --------------------- */
-
-/* define several bluetooth services for our device */
-static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
-    /*
-     * access_cb defines a callback for read and write access events on
-     * given characteristics
-     */
-    {
-        /* Device Information Service */
-        .type = BLE_GATT_SVC_TYPE_PRIMARY,
-        .uuid = BLE_UUID16_DECLARE(BLE_GATT_SVC_DEVINFO),
-        .characteristics = (struct ble_gatt_chr_def[]){
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_MANUFACTURER_NAME),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_MODEL_NUMBER_STR),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_SERIAL_NUMBER_STR),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_FW_REV_STR),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_HW_REV_STR),
-                .access_cb = _devinfo_handler,
-                .flags = BLE_GATT_CHR_F_READ,
-            },
-            {
-                0, /* no more characteristics in this service */
-            },
-        }},
-    {/* Battery Level Service */
-     .type = BLE_GATT_SVC_TYPE_PRIMARY,
-     .uuid = BLE_UUID16_DECLARE(BLE_GATT_SVC_BAS),
-     .characteristics = (struct ble_gatt_chr_def[]){
-         {
-             .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_BATTERY_LEVEL),
-             .access_cb = _bas_handler,
-             .flags = BLE_GATT_CHR_F_READ,
-         },
-         {
-             0, /* no more characteristics in this service */
-         },
-     }},
-    {/* Environmental Sensing Service */
-     .type = BLE_GATT_SVC_TYPE_PRIMARY,
-     .uuid = BLE_UUID16_DECLARE(BLE_GATT_SVC_ESS),
-     .characteristics = (struct ble_gatt_chr_def[]){
-         {
-             .uuid = BLE_UUID16_DECLARE(BLE_GATT_CHAR_TEMP),
-             .access_cb = _temp_handler,
-             .val_handle = &_temp_val_handle,
-             .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
-         },
-         {
-             0, /* no more characteristics in this service */
-         },
-     }},
-    {
-        0, /* No more services */
-    },
-};
+static int gap_event_cb(struct ble_gap_event *event, void *arg);
+
+static int _cmd_boot(int argc, char **argv);
+static int _cmd_tare(int argc, char **argv);
+static int _cmd_cal(int argc, char **argv);
+static int _cmd_adv(int argc, char **argv);
+static int _cmd_stream(int argc, char **argv);
+static int _cmd_workout(int argc, char **argv);
+static int _cmd_power(int argc, char **argv);
+static int _cmd_mem(int argc, char **argv);
+static int _cmd_bond(int argc, char **argv);
+
+/* Profiled callbacks, nothing without PROF_ENABLE */
+PROF_GAP_WRAP(gap_event_cb)
 
 /* ----------------------  Public  --------------------- */
 
-static int _devinfo_handler(uint16_t conn_handle, uint16_t attr_handle,
-                            struct ble_gatt_access_ctxt *ctxt, void *arg) {
+int gatt_bas_handler(uint16_t conn_handle, uint16_t attr_handle,
+                     struct ble_gatt_access_ctxt *ctxt, void *arg) {
     (void)conn_handle;
     (void)attr_handle;
     (void)arg;
-    const char *str;
-
-    switch (ble_uuid_u16(ctxt->chr->uuid)) {
-    case BLE_GATT_CHAR_MANUFACTURER_NAME:
-        puts("[READ] device information service: manufacturer name value");
-        str = _manufacturer_name;
-        break;
-    case BLE_GATT_CHAR_MODEL_NUMBER_STR:
-        puts("[READ] device information service: model number value");
-        str = _model_number;
-        break;
-    case BLE_GATT_CHAR_SERIAL_NUMBER_STR:
-        puts("[READ] device information service: serial number value");
-        str = _serial_number;
-        break;
-    case BLE_GATT_CHAR_FW_REV_STR:
-        puts("[READ] device information service: firmware revision value");
-        str = _fw_ver;
-        break;
-    case BLE_GATT_CHAR_HW_REV_STR:
-        puts("[READ] device information service: hardware revision value");
-        str = _hw_ver;
-        break;
-    default:
-        return BLE_ATT_ERR_UNLIKELY;
-    }
 
-    int res = os_mbuf_append(ctxt->om, str, strlen(str));
+    uint8_t level = battery_level();
+    int res = os_mbuf_append(ctxt->om, &level, sizeof(level));
     return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 }
 
-static int _bas_handler(uint16_t conn_handle, uint16_t attr_handle,
+int gatt_format_handler(uint16_t conn_handle, uint16_t attr_handle,
                         struct ble_gatt_access_ctxt *ctxt, void *arg) {
     (void)conn_handle;
     (void)attr_handle;
     (void)arg;
+    stream_cfg_t cfg;
+
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        stream_config(&cfg);
+        int res = os_mbuf_append(ctxt->om, &cfg, sizeof(cfg));
+        return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
 
-    puts("[READ] battery level service: battery level value");
+    /* the deadband is optional, older clients write 3 bytes */
+    uint16_t len;
+    cfg.deadband = 0;
+    if (ble_hs_mbuf_to_flat(ctxt->om, &cfg, sizeof(cfg), &len) != 0 ||
+        len < offsetof(stream_cfg_t, deadband)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
 
-    uint8_t level = BAT_LEVEL; /* this battery will never drain :-) */
-    int res = os_mbuf_append(ctxt->om, &level, sizeof(level));
-    return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+    printf("[WRITE] Hangboard service: format %u, divider %u, flags 0x%02x, deadband %u\n",
+           cfg.format, cfg.divider, cfg.flags, cfg.deadband);
+    return (stream_configure(&cfg) == 0) ? 0 : BLE_ATT_ERR_VALUE_NOT_ALLOWED;
 }
 
-static int _temp_handler(uint16_t conn_handle, uint16_t attr_handle,
-                        struct ble_gatt_access_ctxt *ctxt, void *arg) {
+int gatt_timesync_handler(uint16_t conn_handle, uint16_t attr_handle,
+                          struct ble_gatt_access_ctxt *ctxt, void *arg) {
     (void)conn_handle;
     (void)attr_handle;
     (void)arg;
 
-    puts("[READ] Environmental Sensing service: Temperature value");
+    /* device time of the write, as close to the reception as we get */
+    uint32_t now_us = ztimer_now(ZTIMER_USEC);
 
-    /* Get the current temperature value from the sensor */
-    int16_t temperature = read_temperature();
-    /* Convert the temperature to a 16-bit signed integer in units of 0.01 degrees Celsius */
-    temperature = temperature * 100;
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        timesync_t ts;
+        timesync_get(&ts);
+        int res = os_mbuf_append(ctxt->om, &ts, sizeof(ts));
+        return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
 
-    int res = os_mbuf_append(ctxt->om, &temperature, sizeof(temperature));
-    return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+    /* the client clock in us, little endian int64 */
+    int64_t client_us;
+    uint16_t len;
+    if (ble_hs_mbuf_to_flat(ctxt->om, &client_us, sizeof(client_us), &len) != 0 ||
+        len != sizeof(client_us)) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    timesync_update(client_us, now_us);
+    return 0;
 }
 
-int16_t read_temperature(void) {
-    // Enable the internal temperature sensor
-    NRF_TEMP->TASKS_START = 1;
+int gatt_control_handler(uint16_t conn_handle, uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    (void)conn_handle;
+    (void)attr_handle;
+    (void)arg;
 
-    // Wait for the temperature measurement to complete
-    while (NRF_TEMP->EVENTS_DATARDY == 0)
-        ;
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        calib_status_t status;
+        calib_status(&status);
+        int res = os_mbuf_append(ctxt->om, &status, sizeof(status));
+        return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
 
-    // Read the temperature measurement from the data register
-    int16_t temperature = (int16_t)NRF_TEMP->TEMP / 4; // Data is registered in the register in 0.25 degC steps
+    /* opcode, followed by a little endian int32 argument for the calibration points */
+    uint8_t cmd[1 + sizeof(int32_t)] = { 0 };
+    uint16_t len;
+    if (ble_hs_mbuf_to_flat(ctxt->om, cmd, sizeof(cmd), &len) != 0 || len < 1) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    int32_t arg_val;
+    memcpy(&arg_val, &cmd[1], sizeof(arg_val));
 
-    // Clear the data ready event
-    NRF_TEMP->EVENTS_DATARDY = 0;
+    printf("[WRITE] Hangboard service: control command 0x%02x\n", cmd[0]);
+    int res = calib_command((calib_op_t)cmd[0], arg_val);
+    return (res == 0) ? 0 : (res == -EINVAL) ? BLE_ATT_ERR_VALUE_NOT_ALLOWED : BLE_ATT_ERR_UNLIKELY;
+}
 
-    // Disable the internal temperature sensor
-    NRF_TEMP->TASKS_STOP = 1;
+int gatt_workout_handler(uint16_t conn_handle, uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    (void)conn_handle;
+    (void)attr_handle;
+    (void)arg;
 
-    // Return the temperature measurement
-    return temperature;
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        workout_status_t status;
+        workout_status(&status);
+        int res = os_mbuf_append(ctxt->om, &status, sizeof(status));
+        return (res == 0) ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+
+    /* opcode, followed by the protocol for a load */
+    uint8_t cmd[1 + sizeof(workout_protocol_t)] = { 0 };
+    uint16_t len;
+    if (ble_hs_mbuf_to_flat(ctxt->om, cmd, sizeof(cmd), &len) != 0 || len < 1 ||
+        (cmd[0] == WORKOUT_OP_LOAD && len != sizeof(cmd))) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    workout_protocol_t protocol;
+    memcpy(&protocol, &cmd[1], sizeof(protocol));
+
+    printf("[WRITE] Hangboard service: workout command 0x%02x\n", cmd[0]);
+    int res = workout_command((workout_op_t)cmd[0], &protocol);
+    return (res == 0) ? 0 : (res == -EBUSY) ? BLE_ATT_ERR_UNLIKELY : BLE_ATT_ERR_VALUE_NOT_ALLOWED;
 }
 
-void init_rng(void) {
+/* acq_us: acquisition of the filtered weight, for the latency probe */
+static void _wss_indicate(conn_t *conn, uint32_t acq_us) {
+    struct os_mbuf *om;
+
+    /* Weight Measurement: flags and the weight in 0.005 kg, unsigned */
+    int32_t weight = (_weight < 0) ? 0 : _weight * 2;
+    uint16_t value = (weight > UINT16_MAX) ? UINT16_MAX : (uint16_t)weight;
+    uint8_t meas[3] = { WSS_FLAGS_SI, value & 0xff, value >> 8 };
 
-    // Enable the RNG peripheral
-    NRF_RNG->TASKS_START = 1;
+    printf("[INDICATE] Weight Measurement Characteristic: weight %li\n", (long)_weight);
 
-    // Enable the bias correction
-    NRF_RNG->CONFIG |= RNG_CONFIG_DERCEN_Msk;
+    om = ble_hs_mbuf_from_flat(meas, sizeof(meas));
+    LATENCY_SENT(LATENCY_WSS, acq_us);
+    if (om != NULL && ble_gatts_indicate_custom(conn->handle, gatt_wss_val_handle, om) == 0) {
+        conn->wss_pending = 1;
+    }
+}
 
-    // Wait for the bias correction to take effect
-    while ((NRF_RNG->EVENTS_VALRDY == 0)) {;}
+static void _stream_notify(const conn_t *conn) {
+    const stream_pkt_t *pkt;
 
-    // Clear the value ready and error events
-    NRF_RNG->EVENTS_VALRDY = 0;
+    /* send the staged batches of samples to the GATT client, oldest first. Out
+     * of mbufs, they wait for the next frame */
+    while ((pkt = stream_peek()) != NULL) {
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(pkt->data, pkt->len);
+        if (om == NULL) {
+            return;
+        }
+        /* the host takes the mbuf, sent or not */
+        LATENCY_SENT(LATENCY_STREAM, pkt->last_us);
+        int res = ble_gatts_notify_custom(conn->handle, gatt_stream_val_handle, om);
+        stream_pop(res == 0);
+    }
 }
 
-uint8_t read_rng(void){
+static void _battery_changed(uint8_t level) {
+    const conn_t *conn = conn_current();
+    printf("[BATTERY] %u%% (%u mV)\n", level, battery_mv());
 
-    // Wait for a new random number to be generated
-    while (NRF_RNG->EVENTS_VALRDY == 0);
+    /* clients get the level when it changes instead of polling it */
+    if (conn->bas_enabled) {
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(&level, sizeof(level));
+        if (om != NULL) {
+            ble_gatts_notify_custom(conn->handle, gatt_bas_val_handle, om);
+        }
+    }
+}
 
-    // Read a byte from the RNG
-    uint8_t random_byte = NRF_RNG->VALUE;
+static void _workout_event(const workout_evt_t *evt) {
+    const conn_t *conn = conn_current();
+    printf("[WORKOUT] event %u, set %u, rep %u, t %lu us\n", evt->type, evt->set, evt->rep,
+           (unsigned long)evt->t_us);
 
-    // Clear the value ready event
-    NRF_RNG->EVENTS_VALRDY = 0;
+    /* a running workout keeps the full rate, connected or not */
+    if (evt->state != WORKOUT_IDLE) {
+        power_hold(POWER_HOLD_WORKOUT);
+    }
+    else {
+        power_release(POWER_HOLD_WORKOUT);
+    }
 
-    // Return the random byte
-    return random_byte;
+    /* the client only renders the cues, the timing is ours */
+    if (conn->workout_enabled) {
+        struct os_mbuf *om = ble_hs_mbuf_from_flat(evt, sizeof(*evt));
+        if (om != NULL) {
+            ble_gatts_notify_custom(conn->handle, gatt_workout_val_handle, om);
+        }
+    }
 }
 
-static void _temp_update(event_t *e) {
-    (void)e;
-    struct os_mbuf *om;
+/* Returns the unfiltered load of the frame [0.01 kg] */
+static int32_t _process_frame(const int16_t *raw, uint32_t now_us) {
+    /* one read for the whole frame, the host thread may close it meanwhile */
+    conn_t *conn = conn_current();
+
+    /* turn the raw counts of every channel into weight */
+    int32_t frame[SENSOR_CHANNELS];
+    int16_t filtered[SENSOR_CHANNELS];
+    int32_t load = 0;
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        frame[ch] = calib_apply(ch, raw[ch]);
+        load += frame[ch];
+    }
+    _weight = pipeline_push(frame, filtered);
+    _sample_cnt++;
 
+    /* the workout cues follow the samples, unfiltered so they aren't delayed */
+    workout_push(load >> CALIB_FRAC_BITS, now_us);
 
-    /* Calculate the new random Temperature value */
-    int16_t temperature = (int16_t)read_rng() * 10; // values from 0 to 25.5 degC
+    broadcast_state_t state = (_weight > HANG_THRESHOLD) ? BROADCAST_STATE_HANG
+                                                         : BROADCAST_STATE_IDLE;
+    if (state == BROADCAST_STATE_HANG && _state == BROADCAST_STATE_IDLE) {
+        adv_sched_load_detected();
+    }
+    _state = state;
 
-    printf("[NOTIFY] Temperature Characteistic: measurement %i\n", (int)temperature);
+    /* high rate consumers get every sample, unfiltered */
+    if (conn->stream_enabled) {
+        stream_push(frame, now_us);
+        _stream_notify(conn);
+    }
 
-    /* send heart rate data notification to GATT client */
-    om = ble_hs_mbuf_from_flat(&temperature, sizeof(temperature));
-    assert(om != NULL);
-    int res = ble_gatts_notify_custom(_conn_handle, _temp_val_handle, om);
-    assert(res == 0);
-    (void)res;
+    /* scanners follow the board through the advertising data, connected or not */
+    if (_sample_cnt % BROADCAST_DECIMATION == 0) {
+        broadcast_update(_weight, state);
+    }
 
-    /* schedule next update event */
-    event_timeout_set(&_update_timeout_evt, UPDATE_INTERVAL);
-}
+    /* generic scale apps get the filtered weight at a low rate */
+    if (conn->wss_enabled && !conn->wss_pending &&
+        _sample_cnt % (WSS_INTERVAL / SAMPLE_INTERVAL) == 0) {
+        _wss_indicate(conn, now_us - PIPELINE_DELAY_US);
+    }
 
-static void _start_updating(void) {
-    event_timeout_set(&_update_timeout_evt, UPDATE_INTERVAL);
-    puts("[NOTIFY_ENABLED] Temperature sensing service");
+    return load >> CALIB_FRAC_BITS;
 }
 
-static void _stop_updating(void) {
-    event_timeout_clear(&_update_timeout_evt);
-    puts("[NOTIFY_DISABLED] Temperature sensing service");
+static void _process_block(const int16_t *block, unsigned frames, uint32_t t_us) {
+    int32_t peak = INT32_MIN;
+    for (unsigned i = 0; i < frames; i++) {
+        int32_t load = _process_frame(&block[i * SENSOR_FRAME_LEN], t_us + i * SENSOR_PERIOD_US);
+        if (load > peak) {
+            peak = load;
+        }
+    }
+
+    /* the supply changes slowly, one conversion per block is plenty */
+    battery_push(block[SENSOR_VDD]);
+
+    /* last, the rate change drops the block in progress */
+    power_block(peak, t_us);
 }
 
 static int gap_event_cb(struct ble_gap_event *event, void *arg) {
     (void)arg;
+    conn_t *conn;
 
     switch (event->type) {
     case BLE_GAP_EVENT_CONNECT:
         if (event->connect.status) {
-            _stop_updating();
-            nimble_autoadv_start(NULL);
+            adv_sched_start();
+            return 0;
+        }
+        conn = conn_open(event->connect.conn_handle);
+        if (conn == NULL) {
+            ble_gap_terminate(event->connect.conn_handle, BLE_ERR_CONN_LIMIT);
             return 0;
         }
-        _conn_handle = event->connect.conn_handle;
+        adv_sched_connected();
+        broadcast_connected();
+        bond_connected(conn->handle);
+        timesync_reset();
+        break;
+
+    case BLE_GAP_EVENT_ADV_COMPLETE:
+        adv_sched_adv_complete();
         break;
 
+    case BLE_GAP_EVENT_ENC_CHANGE:
+        if (event->enc_change.status == 0) {
+            bond_encrypted(event->enc_change.conn_handle);
+        }
+        break;
+
+    case BLE_GAP_EVENT_REPEAT_PAIRING: {
+        /* the central lost its keys, forget ours and pair again */
+        struct ble_gap_conn_desc desc;
+        if (ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc) == 0) {
+            ble_store_util_delete_peer(&desc.peer_id_addr);
+        }
+        return BLE_GAP_REPEAT_PAIRING_RETRY;
+    }
+
     case BLE_GAP_EVENT_DISCONNECT:
-        _stop_updating();
-        nimble_autoadv_start(NULL);
+        if (!conn_close(event->disconnect.conn.conn_handle)) {
+            /* refused at CONNECT, nothing was started for it. Its connection
+             * stopped the advertising: resumed, unless another one is served */
+            if (!conn_active()) {
+                adv_sched_start();
+            }
+            break;
+        }
+        broadcast_disconnected();
+        adv_sched_start();
         break;
 
     case BLE_GAP_EVENT_SUBSCRIBE:
-        if (event->subscribe.attr_handle == _temp_val_handle) {
-            if (event->subscribe.cur_notify == 1) {
-                _start_updating();
-            } else {
-                _stop_updating();
+        conn = conn_find(event->subscribe.conn_handle);
+        if (conn == NULL) {
+            break;
+        }
+        if (event->subscribe.attr_handle == gatt_wss_val_handle) {
+            conn->wss_enabled = event->subscribe.cur_indicate;
+            conn->wss_pending = 0;
+            printf("[INDICATE_%s] Weight Scale service\n",
+                   conn->wss_enabled ? "ENABLED" : "DISABLED");
+        }
+        else if (event->subscribe.attr_handle == gatt_stream_val_handle) {
+            conn->stream_enabled = event->subscribe.cur_notify;
+            stream_reset();
+            printf("[NOTIFY_%s] Hangboard stream\n",
+                   conn->stream_enabled ? "ENABLED" : "DISABLED");
+        }
+        else if (event->subscribe.attr_handle == gatt_bas_val_handle) {
+            conn->bas_enabled = event->subscribe.cur_notify;
+            printf("[NOTIFY_%s] Battery level\n", conn->bas_enabled ? "ENABLED" : "DISABLED");
+        }
+        else if (event->subscribe.attr_handle == gatt_workout_val_handle) {
+            conn->workout_enabled = event->subscribe.cur_notify;
+            printf("[NOTIFY_%s] Workout events\n",
+                   conn->workout_enabled ? "ENABLED" : "DISABLED");
+        }
+        break;
+
+    case BLE_GAP_EVENT_MTU:
+        /* bigger notifications, more samples per packet */
+        stream_set_payload(event->mtu.value - 3);
+        break;
+
+    case BLE_GAP_EVENT_NOTIFY_TX:
+        if (event->notify_tx.attr_handle == gatt_stream_val_handle) {
+            LATENCY_TX(LATENCY_STREAM, event->notify_tx.status == 0);
+        }
+        /* an indication is done once the client confirmed it (or it failed) */
+        if (event->notify_tx.indication && event->notify_tx.status != 0) {
+            conn = conn_find(event->notify_tx.conn_handle);
+            if (conn != NULL) {
+                conn->wss_pending = 0;
+            }
+            if (event->notify_tx.attr_handle == gatt_wss_val_handle) {
+                LATENCY_TX(LATENCY_WSS, event->notify_tx.status == BLE_HS_EDONE);
             }
         }
         break;
@@ -356,58 +468,253 @@ static int gap_event_cb(struct ble_gap_event *event, void *arg) {
     return 0;
 }
 
+/* ----------------------  Startup  --------------------- */
+
+/* Init that isn't needed to advertise, run from the event loop once advertising is up */
+static void _deferred_init(event_t *e) {
+    (void)e;
+
+    // Calibration table, from flash, before the first sample
+    calib_init(tasks_eq(), tasks_io_eq());
+    boot_mark("calib");
+
+    // Initialize the load cells
+    sensor_init(tasks_sensor_block, NULL);
+    battery_init(_battery_changed);
+    boot_mark("sensor");
+
+    /* add the weight broadcast on top of the connectable advertising */
+    broadcast_init();
+    boot_mark("broadcast");
+
+    /* start sampling, at the full rate until the board is left alone */
+    power_init();
+    sensor_start();
+    boot_mark("sampling");
+}
+
+/* ----------------------  Shell  --------------------- */
+
+static int _cmd_boot(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    boot_print();
+
+    return 0;
+}
+
+static int _cmd_adv(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    static const char *names[ADV_SCHED_NUMOF] = { "fast", "slow", "directed" };
+
+    puts("phase     count  last [ms]  min [ms]  max [ms]  avg [ms]");
+    for (unsigned i = 0; i < ADV_SCHED_NUMOF; i++) {
+        const adv_sched_stats_t *stats = adv_sched_stats(i);
+        if (stats->count == 0) {
+            printf("%-8s  %5u\n", names[i], 0);
+            continue;
+        }
+        printf("%-8s  %5lu  %9lu  %8lu  %8lu  %8lu\n", names[i], (unsigned long)stats->count,
+               (unsigned long)stats->last_ms, (unsigned long)stats->min_ms,
+               (unsigned long)stats->max_ms, (unsigned long)(stats->total_ms / stats->count));
+    }
+
+    return 0;
+}
+
+static int _cmd_stream(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    const stream_stats_t *stats = stream_stats();
+    stream_cfg_t cfg;
+    stream_config(&cfg);
+
+    printf("deadband %u, packets %lu, frames sent %lu, suppressed %lu, heartbeats %lu\n",
+           cfg.deadband, (unsigned long)stats->packets, (unsigned long)stats->frames,
+           (unsigned long)stats->suppressed, (unsigned long)stats->heartbeats);
+    printf("frames dropped %lu, packets failed %lu\n", (unsigned long)stats->dropped,
+           (unsigned long)stats->failed);
+
+    return 0;
+}
+
+static int _cmd_workout(int argc, char **argv) {
+    if (argc >= 4) {
+        /* seconds, like the protocols are usually written */
+        workout_protocol_t protocol = {
+            .on_ms = atol(argv[1]) * 1000,
+            .off_ms = atol(argv[2]) * 1000,
+            .reps = atoi(argv[3]),
+            .sets = (argc >= 5) ? atoi(argv[4]) : 1,
+            .rest_ms = (argc >= 6) ? atol(argv[5]) * 1000 : 0,
+        };
+        return workout_command(WORKOUT_OP_LOAD, &protocol);
+    }
+    if (argc >= 2 && strcmp(argv[1], "abort") == 0) {
+        return workout_command(WORKOUT_OP_ABORT, NULL);
+    }
+    if (argc == 1) {
+        workout_status_t status;
+        workout_status(&status);
+        printf("%lu s on / %lu s off x %u, %u sets, rest %lu s: state %u, set %u, rep %u\n",
+               (unsigned long)status.protocol.on_ms / 1000,
+               (unsigned long)status.protocol.off_ms / 1000, status.protocol.reps,
+               status.protocol.sets, (unsigned long)status.protocol.rest_ms / 1000,
+               status.state, status.set, status.rep);
+        return 0;
+    }
+
+    printf("usage: %s [<on [s]> <off [s]> <reps> [sets] [rest [s]]|abort]\n", argv[0]);
+    return 1;
+}
+
+static int _cmd_mem(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    pool_print();
+
+    return 0;
+}
+
+static int _cmd_bond(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "clear") == 0) {
+        bond_clear();
+        return 0;
+    }
+
+    printf("usage: %s clear\n", argv[0]);
+    return 1;
+}
+
+static int _cmd_power(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    power_print();
+
+    return 0;
+}
+
+static int _cmd_tare(int argc, char **argv) {
+    (void)argc;
+    (void)argv;
+
+    return calib_command(CALIB_OP_TARE, 0);
+}
+
+static int _cmd_cal(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "begin") == 0) {
+        return calib_command(CALIB_OP_BEGIN, (argc >= 3) ? atol(argv[2]) : 0);
+    }
+    if (argc >= 3 && strcmp(argv[1], "point") == 0) {
+        return calib_command(CALIB_OP_POINT, atol(argv[2]));
+    }
+    if (argc >= 2 && strcmp(argv[1], "commit") == 0) {
+        return calib_command(CALIB_OP_COMMIT, 0);
+    }
+    if (argc >= 2 && strcmp(argv[1], "abort") == 0) {
+        return calib_command(CALIB_OP_ABORT, 0);
+    }
+    if (argc >= 2 && strcmp(argv[1], "show") == 0) {
+        calib_print();
+        return 0;
+    }
+
+    printf("usage: %s begin [channel]|point <weight [0.01 kg]>|commit|abort|show\n", argv[0]);
+    return 1;
+}
+
+static void *_shell_thread(void *arg) {
+    (void)arg;
+
+    // Shell commands
+    const shell_command_t commands[] = {
+        {"boot", "print the boot timeline", _cmd_boot},
+        {"adv", "print the time-to-connect per advertising phase", _cmd_adv},
+        {"stream", "print the stream traffic counters", _cmd_stream},
+        {"power", "print the wakeups and the time per power state", _cmd_power},
+        {"mem", "print the use and the high-water mark of the pools", _cmd_mem},
+#if LATENCY_ENABLE
+        {"latency", "print the acquisition to air latency percentiles [reset]", latency_print},
+#endif
+#if PROF_ENABLE
+        {"top", "print the run time of the events and callbacks [reset]", prof_print},
+#endif
+        {"tare", "zero the scale with the current load", _cmd_tare},
+        {"cal", "multi-point calibration", _cmd_cal},
+        {"workout", "interval workout: status, load or abort", _cmd_workout},
+        {"bond", "forget the bonded centrals: bond clear", _cmd_bond},
+        {NULL, NULL, NULL}};                    // This NULL termination is important
+
+    char line_buf[SHELL_DEFAULT_BUFSIZE];
+    shell_run(commands, line_buf, SHELL_DEFAULT_BUFSIZE);
+
+    return NULL;
+}
+
 /* ----------------------  Main  --------------------- */
 
 int main(void)
 {
+    boot_mark("main");
     puts("NimBLE GATT Server Example");
 
-    // Initialize random number generator
-    init_rng();
-
     int rc = 0;
     (void)rc;
 
-    // Create the event Callbacks to periodically update the Temperature update.
-    event_queue_init(&_eq);
-    _update_evt.handler = _temp_update;
-    event_timeout_ztimer_init(&_update_timeout_evt, ZTIMER_MSEC, &_eq, &_update_evt);
+    // Create the event queues, the sensor blocks are processed in the sampling one
+    tasks_init(_process_block);
+    _deferred_init_evt.handler = _deferred_init;
+    PROF_EVENT_NAME(&_deferred_init_evt, "deferred init");
 
     /* verify and add our custom services */
-    rc = ble_gatts_count_cfg(gatt_svr_svcs);
+    rc = ble_gatts_count_cfg(gatt_svcs);
     assert(rc == 0);
-    rc = ble_gatts_add_svcs(gatt_svr_svcs);
+    rc = ble_gatts_add_svcs(gatt_svcs);
     assert(rc == 0);
 
     /* set the device name */
     ble_svc_gap_device_name_set(CONFIG_NIMBLE_AUTOADV_DEVICE_NAME);
     /* reload the GATT server to link our added services */
     ble_gatts_start();
+    boot_mark("gatt");
+
+    // Runtime buffers, from fixed pools sized in the Makefile
+    conn_init(tasks_eq());
+    stream_init();
 
-    // Configure the notification and ble connectiong advertissment
-    nimble_autoadv_cfg_t cfg = {
-        .adv_duration_ms = BLE_HS_FOREVER,
-        .adv_itvl_ms = BLE_GAP_ADV_ITVL_MS(100),
-        .flags = NIMBLE_AUTOADV_FLAG_CONNECTABLE | NIMBLE_AUTOADV_FLAG_LEGACY |
-                 NIMBLE_AUTOADV_FLAG_SCANNABLE,
-        .channel_map = 0,
-        .filter_policy = 0,
-        .own_addr_type = nimble_riot_own_addr_type,
-        .phy = NIMBLE_PHY_1M,
-        .tx_power = 0,
-    };
-    /* set advertise params */
-    nimble_autoadv_cfg_update(&cfg);
+    // Restore the bonds and subscriptions of known centrals from flash.
+    // Needed before advertising, for the directed reconnect to the last central.
+    bond_init(tasks_io_eq());
+    boot_mark("bond");
+
+    // Interval workouts, timed by the sampling
+    workout_init(_workout_event);
+
+    // Configure the ble connection advertisement, fast after boot then slow
+    adv_sched_init(PROF_GAP(gap_event_cb));
     /* configure and set the advertising data */
-    uint16_t temp_uuid = BLE_GATT_SVC_ESS;
-    nimble_autoadv_add_field(BLE_GAP_AD_UUID16_INCOMP, &temp_uuid, sizeof(temp_uuid));
-    nimble_autoadv_set_gap_cb(&gap_event_cb, NULL);
+    uint16_t wss_uuid = BLE_GATT_SVC_WSS;
+    nimble_autoadv_add_field(BLE_GAP_AD_UUID16_INCOMP, &wss_uuid, sizeof(wss_uuid));
 
     /* start to advertise this node */
-    nimble_autoadv_start(NULL);
+    adv_sched_start();
+    boot_mark("advertising");
+
+    /* everything else can happen while the first advertising packets go out */
+    event_post(tasks_eq(), &_deferred_init_evt);
+
+    tasks_start();
+    thread_create(_shell_stack, sizeof(_shell_stack), THREAD_PRIORITY_MAIN + 1,
+                  THREAD_CREATE_STACKTEST, _shell_thread, NULL, "shell");
 
-    /* run an event loop for handling the temperature rate update events */
-    event_loop(&_eq);
+    /* run an event loop for handling the sampling events */
+    tasks_run();
 
     return 0;
 }
@@ -0,0 +1,76 @@
+/**
+ * @file
+ * @brief       Sample pipeline: history ring buffer and low-pass filter
+ */
+
+#include <string.h>
+
+#include "calib.h"
+#include "pipeline.h"
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#include "cpu.h"                // CMSIS, for __SMLAD
+#define PIPELINE_SIMD   (1)
+#endif
+
+#if (PIPELINE_RING_SIZE & (PIPELINE_RING_SIZE - 1)) || (PIPELINE_FILTER_TAPS > PIPELINE_RING_SIZE)
+#error "PIPELINE_RING_SIZE must be a power of 2, at least PIPELINE_FILTER_TAPS"
+#endif
+
+/* ----------------------  Variables --------------------- */
+
+/* Q15 low-pass, symmetric, the taps add up to 1.0 (32768) */
+static const int16_t _coef[PIPELINE_FILTER_TAPS] __attribute__((aligned(4))) = {
+    1024, 2560, 4864, 7936, 7936, 4864, 2560, 1024,
+};
+
+static int16_t _ring[SENSOR_CHANNELS][2 * PIPELINE_RING_SIZE];
+static unsigned _head;          // Position of the latest sample
+
+/* ----------------------  Private  --------------------- */
+
+static int16_t _fir(const int16_t *win) {
+    int32_t acc = 0;
+
+#ifdef PIPELINE_SIMD
+    /* two taps per SMLAD, the window may be only 2 byte aligned (unaligned LDR is fine) */
+    for (unsigned i = 0; i < PIPELINE_FILTER_TAPS; i += 2) {
+        uint32_t x, c;
+        memcpy(&x, &win[i], sizeof(x));
+        memcpy(&c, &_coef[i], sizeof(c));
+        acc = (int32_t)__SMLAD(x, c, (uint32_t)acc);
+    }
+#else
+    for (unsigned i = 0; i < PIPELINE_FILTER_TAPS; i++) {
+        acc += (int32_t)win[i] * _coef[i];
+    }
+#endif
+
+    return (int16_t)(acc >> 15);
+}
+
+/* ----------------------  Public  --------------------- */
+
+int32_t pipeline_push(const int32_t frame[SENSOR_CHANNELS], int16_t filtered[SENSOR_CHANNELS]) {
+    int32_t total = 0;
+
+    _head = (_head + 1) & (PIPELINE_RING_SIZE - 1);
+
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        int16_t *ring = _ring[ch];
+        int16_t val = calib_coarse(frame[ch]);
+
+        ring[_head] = val;
+        ring[_head + PIPELINE_RING_SIZE] = val;
+
+        /* the last PIPELINE_FILTER_TAPS samples, contiguous thanks to the copy */
+        filtered[ch] = _fir(&ring[_head + PIPELINE_RING_SIZE + 1 - PIPELINE_FILTER_TAPS]);
+        total += filtered[ch];
+    }
+
+    return total;
+}
+
+int16_t pipeline_history(unsigned channel, unsigned age) {
+    return _ring[channel][(_head - age) & (PIPELINE_RING_SIZE - 1)];
+}
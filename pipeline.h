@@ -0,0 +1,41 @@
+/**
+ * @file
+ * @brief       Sample pipeline: history ring buffer and low-pass filter
+ *
+ * Every calibrated frame goes through here once. The pipeline keeps the
+ * latest samples of every channel in a ring buffer and runs a low-pass FIR
+ * filter over them, to take the noise off the values sent to the low rate
+ * consumers (Weight Scale Service, broadcast).
+ *
+ * The history is stored channel-planar, int16 in 0.01 kg: the window of one
+ * channel is contiguous, so the FIR runs two taps per instruction with the
+ * Cortex-M4 dual 16-bit MAC (SMLAD). Every sample is written twice, at i and
+ * i + PIPELINE_RING_SIZE, so the window never wraps around.
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#include "sensor.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef PIPELINE_RING_SIZE
+#define PIPELINE_RING_SIZE      (32U)   // Samples of history per channel, power of 2
+#endif
+#define PIPELINE_FILTER_TAPS    (8U)    // FIR length, even
+/* Delay of the filtered values behind the samples, the FIR is symmetric */
+#define PIPELINE_DELAY_US       ((PIPELINE_FILTER_TAPS - 1) * SENSOR_PERIOD_US / 2)
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Add a frame (fine units, see calib.h). The filtered value of every channel
+ * goes to filtered (0.01 kg), the sum of the channels is returned */
+int32_t pipeline_push(const int32_t frame[SENSOR_CHANNELS], int16_t filtered[SENSOR_CHANNELS]);
+
+/* Sample of a channel pushed age frames ago (0 is the latest), in 0.01 kg,
+ * age < PIPELINE_RING_SIZE */
+int16_t pipeline_history(unsigned channel, unsigned age);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,75 @@
+/**
+ * @file
+ * @brief       Fixed block pools for the runtime buffers
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "irq.h"
+
+#include "pool.h"
+
+/* ----------------------  Variables --------------------- */
+
+static pool_t *_pools;
+
+/* ----------------------  Public  --------------------- */
+
+void pool_init(pool_t *pool) {
+    pool->free = NULL;
+    for (unsigned i = pool->numof; i > 0; i--) {
+        void **block = (void **)(pool->storage + (i - 1) * pool->block_size);
+        *block = pool->free;
+        pool->free = block;
+    }
+    pool->used = 0;
+
+    unsigned state = irq_disable();
+    pool->next = _pools;
+    _pools = pool;
+    irq_restore(state);
+}
+
+void *pool_alloc(pool_t *pool) {
+    unsigned state = irq_disable();
+    void **block = pool->free;
+    if (block == NULL) {
+        pool->failures++;
+    }
+    else {
+        pool->free = *block;
+        if (++pool->used > pool->high_water) {
+            pool->high_water = pool->used;
+        }
+    }
+    irq_restore(state);
+
+    return block;
+}
+
+void pool_free(pool_t *pool, void *block) {
+    if (block == NULL) {
+        return;
+    }
+    assert((uint8_t *)block >= pool->storage &&
+           (uint8_t *)block < pool->storage + pool->numof * pool->block_size);
+
+    unsigned state = irq_disable();
+    *(void **)block = pool->free;
+    pool->free = block;
+    pool->used--;
+    irq_restore(state);
+}
+
+void pool_print(void) {
+    unsigned total = 0;
+
+    puts("pool        block  blocks  used  high  failures");
+    for (const pool_t *pool = _pools; pool != NULL; pool = pool->next) {
+        printf("%-10s  %5u  %6u  %4u  %4u  %8lu\n", pool->name, pool->block_size, pool->numof,
+               pool->used, pool->high_water, (unsigned long)pool->failures);
+        total += pool->block_size * pool->numof;
+    }
+    printf("%u bytes\n", total);
+}
@@ -0,0 +1,63 @@
+/**
+ * @file
+ * @brief       Fixed block pools for the runtime buffers
+ *
+ * Everything the firmware holds for a variable time (staged packets,
+ * connection state) comes from a pool of fixed size blocks, defined with
+ * POOL_DEFINE() by the module that owns it. The number of blocks is set in the
+ * Makefile (MEM_*), so the RAM taken is known at link time, in the bss of that
+ * module, and nothing else can grow.
+ *
+ * An exhausted pool returns NULL: the caller drops or refuses the work and
+ * the refusal is counted. The "mem" shell command prints every pool with its
+ * high-water mark, to size the MEM_* values from real use.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+
+typedef struct pool {
+    const char *name;
+    uint8_t *storage;
+    uint16_t block_size;    // Bytes, multiple of the pointer size
+    uint16_t numof;         // Blocks
+    void *free;             // Free list, linked through the free blocks
+    uint16_t used;
+    uint16_t high_water;    // Most blocks used at once
+    uint32_t failures;      // Allocations refused, pool exhausted
+    struct pool *next;      // All the pools, for the report
+} pool_t;
+
+/* Blocks hold the free list link and stay aligned for it */
+#define POOL_BLOCK_SIZE(size)   (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+/* Static pool of count blocks of size bytes, in the bss of the module */
+#define POOL_DEFINE(var, label, size, count) \
+    static void *var##_storage[(count) * POOL_BLOCK_SIZE(size) / sizeof(void *)]; \
+    static pool_t var = { \
+        .name = label, \
+        .storage = (uint8_t *)var##_storage, \
+        .block_size = POOL_BLOCK_SIZE(size), \
+        .numof = (count), \
+    }
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Link the free blocks and add the pool to the report. Call once */
+void pool_init(pool_t *pool);
+
+/* A block, NULL if the pool is exhausted. Any thread, interrupts included */
+void *pool_alloc(pool_t *pool);
+
+/* Return a block, NULL is ignored */
+void pool_free(pool_t *pool, void *block);
+
+/* Print every pool: size, use, high-water mark and refusals */
+void pool_print(void);
+
+#endif /* POOL_H */
@@ -0,0 +1,94 @@
+/**
+ * @file
+ * @brief       Power states of the acquisition
+ */
+
+#include <stdio.h>
+
+#include "irq.h"
+#include "sensor.h"
+
+#include "power.h"
+
+/* ----------------------  Variables --------------------- */
+
+static power_state_t _state;
+static power_stats_t _stats[POWER_NUMOF];
+static volatile uint8_t _holds;     // power_hold_t mask
+static uint32_t _last_us;           // Time of the previous block
+static uint32_t _quiet_us;          // Last time the full rate was needed
+static uint8_t _started;
+
+/* ----------------------  Private  --------------------- */
+
+static void _enter(power_state_t state) {
+    _state = state;
+    _stats[state].entries++;
+    sensor_set_rate((state == POWER_ACTIVE) ? SENSOR_RATE_FULL : SENSOR_RATE_IDLE);
+    printf("[POWER] %s\n", (state == POWER_ACTIVE) ? "active" : "idle");
+}
+
+/* ----------------------  Public  --------------------- */
+
+void power_init(void) {
+    _state = POWER_ACTIVE;
+    _stats[POWER_ACTIVE].entries = 1;
+    _started = 0;
+}
+
+void power_hold(power_hold_t reason) {
+    unsigned state = irq_disable();
+    _holds |= reason;
+    irq_restore(state);
+}
+
+void power_release(power_hold_t reason) {
+    unsigned state = irq_disable();
+    _holds &= ~reason;
+    irq_restore(state);
+}
+
+void power_block(int32_t load, uint32_t t_us) {
+    /* the time since the previous block belongs to the state it was taken in */
+    if (_started) {
+        _stats[_state].time_us += t_us - _last_us;
+    }
+    else {
+        _started = 1;
+        _quiet_us = t_us;
+    }
+    _last_us = t_us;
+    _stats[_state].wakeups++;
+
+    if (load > POWER_WAKE_THRESHOLD || _holds) {
+        _quiet_us = t_us;
+        if (_state == POWER_IDLE) {
+            _enter(POWER_ACTIVE);
+        }
+    }
+    else if (_state == POWER_ACTIVE && t_us - _quiet_us >= POWER_IDLE_MS * 1000UL) {
+        _enter(POWER_IDLE);
+    }
+}
+
+power_state_t power_state(void) {
+    return _state;
+}
+
+const power_stats_t *power_stats(power_state_t state) {
+    return &_stats[state];
+}
+
+void power_print(void) {
+    static const char *names[POWER_NUMOF] = { "active", "idle" };
+
+    puts("state    entries   wakeups    time [s]  wakeups/s");
+    for (unsigned i = 0; i < POWER_NUMOF; i++) {
+        const power_stats_t *stats = &_stats[i];
+        uint32_t time_ms = stats->time_us / 1000;
+        printf("%-7s%c %7lu  %8lu  %10lu.%03lu  %9lu\n", names[i], (i == _state) ? '*' : ' ',
+               (unsigned long)stats->entries, (unsigned long)stats->wakeups,
+               (unsigned long)(time_ms / 1000), (unsigned long)(time_ms % 1000),
+               (unsigned long)(time_ms ? (uint64_t)stats->wakeups * 1000 / time_ms : 0));
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * @file
+ * @brief       Power states of the acquisition
+ *
+ * Sampling at the full rate only matters while somebody uses the samples.
+ * With no central connected, no workout running and no load for
+ * POWER_IDLE_MS, the sensor drops to its idle rate: one frame per wakeup, on
+ * the low frequency clock. The first idle frame with load on the board brings
+ * the full rate back, its first frame follows within one sample period.
+ *
+ * Every wakeup for a block and the time spent in each state are counted, from
+ * the block timestamps, so the same counters come out of the native
+ * simulation and of the board.
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+#ifndef POWER_IDLE_MS
+#define POWER_IDLE_MS       (30000U)    // Time without load before the idle rate
+#endif
+#define POWER_WAKE_THRESHOLD (200)      // Load that counts as somebody on the board [0.01 kg]
+
+typedef enum {
+    POWER_ACTIVE = 0,           // Full rate
+    POWER_IDLE = 1,             // Idle rate, watching for load
+    POWER_NUMOF,
+} power_state_t;
+
+/* Reasons to keep the full rate, load aside */
+typedef enum {
+    POWER_HOLD_CONNECTED = 0x01,
+    POWER_HOLD_WORKOUT = 0x02,
+} power_hold_t;
+
+typedef struct {
+    uint32_t entries;       // Times the state was entered
+    uint32_t wakeups;       // Blocks processed in the state
+    uint64_t time_us;       // Time spent in the state
+} power_stats_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+void power_init(void);
+
+/* Keep the full rate for a reason, until it is released. Any thread, the
+ * rate goes up with the next block */
+void power_hold(power_hold_t reason);
+void power_release(power_hold_t reason);
+
+/* A block was processed: the highest load of its frames [0.01 kg] and the
+ * time of its first frame. Switches the sensor rate when needed, only call
+ * from the thread processing the blocks */
+void power_block(int32_t load, uint32_t t_us);
+
+power_state_t power_state(void);
+
+const power_stats_t *power_stats(power_state_t state);
+
+/* Print the counters */
+void power_print(void);
+
+#endif /* POWER_H */
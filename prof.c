@@ -0,0 +1,234 @@
+/**
+ * @file
+ * @brief       Profiler of the event queue and of the GATT and GAP callbacks
+ *
+ * The table is filled on first sight of every event, attribute or GAP event
+ * type, and never shrinks. Once full, the newcomers are just not accounted.
+ * Times are ZTIMER_USEC, the totals wrap after ~71 minutes of run time: reset
+ * the table with "top reset" for long measurements.
+ */
+
+#if PROF_ENABLE
+
+#include <stdio.h>
+#include <string.h>
+
+#include "irq.h"
+#include "ztimer.h"
+
+#include "prof.h"
+
+/* ----------------------  Defines --------------------- */
+
+typedef struct {
+    const char *name;
+    const void *key;            // Event, or name of the wrapped callback
+    uint16_t sub;               // Attribute handle, GAP event type
+    uint8_t kind;               // prof_kind_t
+    uint8_t posted;             // Event waiting in the queue, since posted_us
+    uint32_t posted_us;
+    uint32_t count;
+    uint32_t waited;            // Dispatches with a known post time
+    uint32_t wait_total_us;
+    uint32_t wait_max_us;
+    uint32_t run_total_us;
+    uint32_t run_max_us;
+} prof_entry_t;
+
+/* ----------------------  Variables --------------------- */
+
+static prof_entry_t _entries[PROF_ENTRIES_MAX];
+static unsigned _numof;
+static event_queue_t *_queues[PROF_QUEUES_MAX];    // Dispatched by prof_event_loop()
+static unsigned _queues_numof;
+static uint32_t _since_us;      // Start of the accounting
+
+static const char *_kinds[] = { "event", "gatt", "gap" };
+
+/* ----------------------  Private  --------------------- */
+
+void __real_event_post(event_queue_t *queue, event_t *event);
+
+static prof_entry_t *_find(prof_kind_t kind, const void *key, unsigned sub) {
+    prof_entry_t *entry = NULL;
+
+    /* posts come from interrupts too */
+    unsigned state = irq_disable();
+    for (unsigned i = 0; i < _numof; i++) {
+        if (_entries[i].key == key && _entries[i].sub == sub && _entries[i].kind == kind) {
+            entry = &_entries[i];
+            break;
+        }
+    }
+    if (entry == NULL && _numof < PROF_ENTRIES_MAX) {
+        entry = &_entries[_numof++];
+        entry->kind = kind;
+        entry->key = key;
+        entry->sub = sub;
+    }
+    irq_restore(state);
+
+    return entry;
+}
+
+/* Posts to the other queues would take an entry that is never dispatched */
+static int _profiled(const event_queue_t *queue) {
+    for (unsigned i = 0; i < _queues_numof; i++) {
+        if (_queues[i] == queue) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void _account(prof_entry_t *entry, int waited, uint32_t wait_us, uint32_t run_us) {
+    entry->count++;
+    entry->run_total_us += run_us;
+    if (run_us > entry->run_max_us) {
+        entry->run_max_us = run_us;
+    }
+    if (waited) {
+        entry->waited++;
+        entry->wait_total_us += wait_us;
+        if (wait_us > entry->wait_max_us) {
+            entry->wait_max_us = wait_us;
+        }
+    }
+}
+
+/* ----------------------  Public  --------------------- */
+
+void __wrap_event_post(event_queue_t *queue, event_t *event) {
+    if (!_profiled(queue)) {
+        __real_event_post(queue, event);
+        return;
+    }
+
+    uint32_t now_us = ztimer_now(ZTIMER_USEC);
+    prof_entry_t *entry = _find(PROF_KIND_EVENT, event, 0);
+
+    if (entry != NULL) {
+        /* posting a queued event again doesn't queue it twice */
+        unsigned state = irq_disable();
+        if (!entry->posted) {
+            entry->posted = 1;
+            entry->posted_us = now_us;
+        }
+        irq_restore(state);
+    }
+    __real_event_post(queue, event);
+}
+
+void prof_event_name(event_t *ev, const char *name) {
+    prof_entry_t *entry = _find(PROF_KIND_EVENT, ev, 0);
+
+    if (entry != NULL) {
+        entry->name = name;
+    }
+}
+
+void prof_event_loop(event_queue_t *eq) {
+    unsigned state = irq_disable();
+    if (_queues_numof < PROF_QUEUES_MAX) {
+        _queues[_queues_numof++] = eq;
+    }
+    irq_restore(state);
+    if (!_profiled(eq)) {
+        printf("[PROF] queue %p not accounted, raise PROF_QUEUES_MAX\n", (void *)eq);
+    }
+    _since_us = ztimer_now(ZTIMER_USEC);
+
+    while (1) {
+        event_t *event = event_wait(eq);
+        uint32_t start = ztimer_now(ZTIMER_USEC);
+        prof_entry_t *entry = _find(PROF_KIND_EVENT, event, 0);
+
+        int waited = 0;
+        uint32_t wait_us = 0;
+        if (entry != NULL) {
+            unsigned state = irq_disable();
+            waited = entry->posted;
+            wait_us = start - entry->posted_us;
+            entry->posted = 0;
+            irq_restore(state);
+        }
+
+        event->handler(event);
+
+        if (entry != NULL) {
+            _account(entry, waited, wait_us, ztimer_now(ZTIMER_USEC) - start);
+        }
+    }
+}
+
+uint32_t prof_start(void) {
+    return ztimer_now(ZTIMER_USEC);
+}
+
+void prof_stop(prof_kind_t kind, const char *name, unsigned sub, uint32_t start) {
+    uint32_t run_us = ztimer_now(ZTIMER_USEC) - start;
+    prof_entry_t *entry = _find(kind, name, sub);
+
+    if (entry != NULL) {
+        entry->name = name;
+        _account(entry, 0, 0, run_us);
+    }
+}
+
+int prof_print(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "reset") == 0) {
+        unsigned state = irq_disable();
+        for (unsigned i = 0; i < _numof; i++) {
+            prof_entry_t *entry = &_entries[i];
+            entry->count = entry->waited = 0;
+            entry->wait_total_us = entry->wait_max_us = 0;
+            entry->run_total_us = entry->run_max_us = 0;
+        }
+        _since_us = ztimer_now(ZTIMER_USEC);
+        irq_restore(state);
+        return 0;
+    }
+
+    /* heaviest first, insertion sort of the indexes */
+    uint8_t order[PROF_ENTRIES_MAX];
+    unsigned numof = _numof;
+    for (unsigned i = 0; i < numof; i++) {
+        unsigned j = i;
+        for (; j > 0 && _entries[order[j - 1]].run_total_us < _entries[i].run_total_us; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = i;
+    }
+
+    uint32_t elapsed_us = ztimer_now(ZTIMER_USEC) - _since_us;
+    printf("%lu ms, %u/%u entries\n", (unsigned long)(elapsed_us / 1000), numof,
+           PROF_ENTRIES_MAX);
+    puts("kind   name                  sub    count  wait avg/max [us]  run avg/max [us]  cpu [%]");
+    for (unsigned i = 0; i < numof; i++) {
+        const prof_entry_t *entry = &_entries[order[i]];
+        if (entry->count == 0) {
+            continue;
+        }
+
+        char name[22];
+        if (entry->name != NULL) {
+            snprintf(name, sizeof(name), "%s", entry->name);
+        }
+        else {
+            snprintf(name, sizeof(name), "%p", (void *)((const event_t *)entry->key)->handler);
+        }
+        unsigned long permille = elapsed_us ?
+            (unsigned long)((uint64_t)entry->run_total_us * 1000 / elapsed_us) : 0;
+
+        printf("%-6s %-21s %3u %8lu  %8lu %8lu  %7lu %8lu  %3lu.%lu\n",
+               _kinds[entry->kind], name, entry->sub, (unsigned long)entry->count,
+               entry->waited ? (unsigned long)(entry->wait_total_us / entry->waited) : 0UL,
+               (unsigned long)entry->wait_max_us,
+               (unsigned long)(entry->run_total_us / entry->count),
+               (unsigned long)entry->run_max_us, permille / 10, permille % 10);
+    }
+
+    return 0;
+}
+
+#endif /* PROF_ENABLE */
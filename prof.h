@@ -0,0 +1,97 @@
+/**
+ * @file
+ * @brief       Profiler of the event queue and of the GATT and GAP callbacks
+ *
+ * Opt-in (make PROF=1, PROF_ENABLE=1): without it every macro below expands
+ * to the plain call, and nothing is compiled in.
+ *
+ * - Events: every event_post() is wrapped at link time (--wrap=event_post),
+ *   so the post time is known without touching the modules, and
+ *   PROF_EVENT_LOOP() dispatches the queue. Queue wait (post to dispatch) and
+ *   run time are accounted per event. Events posted by an event_timeout are
+ *   wrapped as well. Only the queues dispatched by PROF_EVENT_LOOP() are
+ *   accounted: the NimBLE port posts its own events through event_post() to
+ *   queues the profiler never sees dispatched.
+ * - GATT: PROF_GATT() wraps an access callback, accounted per attribute.
+ * - GAP: PROF_GAP() wraps the GAP callback, accounted per GAP event type.
+ *
+ * The "top" shell command prints the table, heaviest first.
+ */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+#include "event.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef PROF_ENTRIES_MAX
+#define PROF_ENTRIES_MAX    (32U)   // Events, attributes and GAP event types tracked
+#endif
+#ifndef PROF_QUEUES_MAX
+#define PROF_QUEUES_MAX     (4U)    // Queues dispatched by PROF_EVENT_LOOP()
+#endif
+
+#if PROF_ENABLE
+
+#include "host/ble_gap.h"
+#include "host/ble_gatt.h"
+
+typedef enum {
+    PROF_KIND_EVENT,
+    PROF_KIND_GATT,
+    PROF_KIND_GAP,
+} prof_kind_t;
+
+/* Name an event in the table, instead of its address */
+#define PROF_EVENT_NAME(ev, name)   prof_event_name(ev, name)
+
+/* Dispatch the queue, forever */
+#define PROF_EVENT_LOOP(eq)         prof_event_loop(eq)
+
+/* Profiled access callback, define it with PROF_GATT_WRAP() */
+#define PROF_GATT(fn)               _prof_##fn
+#define PROF_GATT_WRAP(fn) \
+    static int _prof_##fn(uint16_t conn_handle, uint16_t attr_handle, \
+                          struct ble_gatt_access_ctxt *ctxt, void *arg) { \
+        uint32_t start = prof_start(); \
+        int res = fn(conn_handle, attr_handle, ctxt, arg); \
+        prof_stop(PROF_KIND_GATT, #fn, attr_handle, start); \
+        return res; \
+    }
+
+/* Profiled GAP callback, define it with PROF_GAP_WRAP() */
+#define PROF_GAP(fn)                _prof_##fn
+#define PROF_GAP_WRAP(fn) \
+    static int _prof_##fn(struct ble_gap_event *event, void *arg) { \
+        uint32_t start = prof_start(); \
+        uint8_t type = event->type;     /* the handler may change the event */ \
+        int res = fn(event, arg); \
+        prof_stop(PROF_KIND_GAP, #fn, type, start); \
+        return res; \
+    }
+
+/* ----------------------  Prototypes --------------------- */
+
+void prof_event_name(event_t *ev, const char *name);
+void prof_event_loop(event_queue_t *eq);
+
+uint32_t prof_start(void);
+void prof_stop(prof_kind_t kind, const char *name, unsigned sub, uint32_t start);
+
+/* Print the table, the shell "top" command */
+int prof_print(int argc, char **argv);
+
+#else
+
+#define PROF_EVENT_NAME(ev, name)   (void)(ev)
+#define PROF_EVENT_LOOP(eq)         event_loop(eq)
+#define PROF_GATT(fn)               fn
+#define PROF_GATT_WRAP(fn)
+#define PROF_GAP(fn)                fn
+#define PROF_GAP_WRAP(fn)
+
+#endif /* PROF_ENABLE */
+
+#endif /* PROF_H */
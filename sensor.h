@@ -0,0 +1,77 @@
+/**
+ * @file
+ * @brief       Load cell acquisition
+ *
+ * All channels (one load cell per hand) are sampled in lockstep at
+ * SENSOR_RATE_HZ. The samples aren't read one by one: the backend collects
+ * SENSOR_BLOCK_FRAMES frames (one raw value per channel) in the background and
+ * hands over the whole block, so the CPU only wakes once per block.
+ *
+ * When nobody needs the full rate, the idle rate only watches for load:
+ * SENSOR_IDLE_RATE_HZ, one frame per block, from a low frequency clock.
+ *
+ * Every frame also carries the supply voltage, after the load cells, for the
+ * battery level.
+ *
+ * Backends:
+ * - sensor_saadc.c: nRF52 SAADC, triggered by a hardware timer through PPI,
+ *   EasyDMA fills two buffers in turn.
+ * - sensor_sim.c (SENSOR_SIM=1, BOARD=native): simulated hangs, delivered in
+ *   the same blocks, to run the pipeline without hardware.
+ */
+
+#ifndef SENSOR_H
+#define SENSOR_H
+
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+#ifndef SENSOR_CHANNELS
+#define SENSOR_CHANNELS     (2U)    // Load cells sampled together
+#endif
+#ifndef SENSOR_RATE_HZ
+#define SENSOR_RATE_HZ      (50U)   // Frames per second
+#endif
+#ifndef SENSOR_BLOCK_FRAMES
+#define SENSOR_BLOCK_FRAMES (5U)    // Frames per block, the CPU wakes at SENSOR_RATE_HZ / SENSOR_BLOCK_FRAMES
+#endif
+#ifndef SENSOR_IDLE_RATE_HZ
+#define SENSOR_IDLE_RATE_HZ (5U)    // Frames per second of the idle rate, one per block
+#endif
+#define SENSOR_PERIOD_US    (1000000UL / SENSOR_RATE_HZ)
+#define SENSOR_IDLE_PERIOD_US (1000000UL / SENSOR_IDLE_RATE_HZ)
+
+#define SENSOR_VDD          (SENSOR_CHANNELS)       // Index of the supply voltage in a frame
+#define SENSOR_FRAME_LEN    (SENSOR_CHANNELS + 1U)  // Values per frame
+
+/* Supply voltage [mV] from its raw counts: 12 bits, 3.6 V full scale */
+#define SENSOR_VDD_MV(raw)  ((uint16_t)(((raw) < 0 ? 0 : (int32_t)(raw)) * 3600L / 4096))
+
+typedef enum {
+    SENSOR_RATE_FULL = 0,       // SENSOR_RATE_HZ, blocks of SENSOR_BLOCK_FRAMES
+    SENSOR_RATE_IDLE = 1,       // SENSOR_IDLE_RATE_HZ, blocks of one frame
+} sensor_rate_t;
+
+/* Called in interrupt context for every full block: frames frames of
+ * SENSOR_FRAME_LEN interleaved raw counts, the first frame sampled at t_us
+ * (ZTIMER_USEC). The block stays valid until the next call, one block period */
+typedef void (*sensor_block_cb_t)(const int16_t *block, unsigned frames, uint32_t t_us,
+                                  void *arg);
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Set up the acquisition, blocks go to cb */
+void sensor_init(sensor_block_cb_t cb, void *arg);
+
+/* Start sampling */
+void sensor_start(void);
+
+/* Stop sampling, the block in progress is dropped */
+void sensor_stop(void);
+
+/* Switch the sampling rate, SENSOR_RATE_FULL after init. When sampling, the
+ * block in progress is dropped and the first frame at the new rate follows
+ * within one period of it. Only call from the thread processing the blocks */
+void sensor_set_rate(sensor_rate_t rate);
+
+#endif /* SENSOR_H */
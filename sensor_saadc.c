@@ -0,0 +1,197 @@
+/**
+ * @file
+ * @brief       Load cells on the nRF52 SAADC
+ *
+ * The CPU isn't involved in the sampling:
+ * - SENSOR_TIMER compare 0 triggers the SAADC SAMPLE task through PPI, which
+ *   converts every channel and VDD in one scan.
+ * - EasyDMA writes the results to one of two buffers. When it is full, the
+ *   END event restarts the SAADC on the other one through a second PPI
+ *   channel, no sample is lost while the CPU wakes up.
+ * - The RESULT.PTR register is double buffered: once the STARTED event says
+ *   the current pointer is latched, the interrupt queues the next buffer.
+ *
+ * At the idle rate, SENSOR_RTC (32768 Hz, on the LFCLK that runs anyway for
+ * BLE) triggers the SAMPLE task instead of the timer, and clears itself
+ * through the fork of the same PPI channel. SENSOR_TIMER is stopped, but
+ * the frames are still stamped with ZTIMER_USEC, whose TIMER keeps running
+ * at the idle rate: the stream timestamps stay on one clock across the rate
+ * changes, at the cost of the HFCLK between two frames.
+ */
+
+#if !SENSOR_SIM
+
+#include <nrf.h>
+
+#include "cpu.h"
+#include "ztimer.h"
+
+#include "sensor.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef SENSOR_TIMER
+#define SENSOR_TIMER        NRF_TIMER3  // Not used by RIOT nor by the NimBLE controller
+#endif
+#ifndef SENSOR_RTC
+#define SENSOR_RTC          NRF_RTC2    // RTC0 is the NimBLE controller's, RTC1 RIOT's
+#endif
+#ifndef SENSOR_PPI_CH
+#define SENSOR_PPI_CH       (10U)       // Uses this PPI channel and the next one
+#endif
+#ifndef SENSOR_AIN_FIRST
+#define SENSOR_AIN_FIRST    (0U)        // Channel n is on AIN(SENSOR_AIN_FIRST + n)
+#endif
+
+#define SENSOR_BLOCK_LEN    (SENSOR_BLOCK_FRAMES * SENSOR_FRAME_LEN)
+#define SENSOR_PPI_MASK     ((1UL << SENSOR_PPI_CH) | (1UL << (SENSOR_PPI_CH + 1)))
+#define SENSOR_RTC_TICKS    (32768UL / SENSOR_IDLE_RATE_HZ)
+
+/* ----------------------  Variables --------------------- */
+
+static int16_t _buf[2][SENSOR_BLOCK_LEN];
+static uint8_t _next;           // Buffer latched by the next START
+static uint8_t _done;           // Buffer completed by the next END
+static sensor_rate_t _rate;
+static uint8_t _running;
+
+static sensor_block_cb_t _cb;
+static void *_arg;
+
+/* ----------------------  Interrupt  --------------------- */
+
+void isr_saadc(void) {
+    /* END first: both events are pending together when the PPI restarted the SAADC */
+    if (NRF_SAADC->EVENTS_END) {
+        NRF_SAADC->EVENTS_END = 0;
+
+        /* the last frame was just converted */
+        unsigned frames = (_rate == SENSOR_RATE_FULL) ? SENSOR_BLOCK_FRAMES : 1;
+        uint32_t t_us = ztimer_now(ZTIMER_USEC) - (frames - 1) * SENSOR_PERIOD_US;
+        _cb(_buf[_done], frames, t_us, _arg);
+        _done ^= 1;
+    }
+    if (NRF_SAADC->EVENTS_STARTED) {
+        NRF_SAADC->EVENTS_STARTED = 0;
+        _next ^= 1;
+        NRF_SAADC->RESULT.PTR = (uint32_t)_buf[_next];
+    }
+
+    cortexm_isr_end();
+}
+
+/* ----------------------  Public  --------------------- */
+
+void sensor_init(sensor_block_cb_t cb, void *arg) {
+    _cb = cb;
+    _arg = arg;
+
+    /* one single ended input per load cell, 0 to 3.6 V */
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        NRF_SAADC->CH[ch].PSELP = SAADC_CH_PSELP_PSELP_AnalogInput0 + SENSOR_AIN_FIRST + ch;
+        NRF_SAADC->CH[ch].PSELN = SAADC_CH_PSELN_PSELN_NC;
+        NRF_SAADC->CH[ch].CONFIG = (SAADC_CH_CONFIG_GAIN_Gain1_6 << SAADC_CH_CONFIG_GAIN_Pos) |
+                                   (SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) |
+                                   (SAADC_CH_CONFIG_TACQ_10us << SAADC_CH_CONFIG_TACQ_Pos);
+    }
+    /* the supply, low impedance, the shortest acquisition time does */
+    NRF_SAADC->CH[SENSOR_VDD].PSELP = SAADC_CH_PSELP_PSELP_VDD;
+    NRF_SAADC->CH[SENSOR_VDD].PSELN = SAADC_CH_PSELN_PSELN_NC;
+    NRF_SAADC->CH[SENSOR_VDD].CONFIG = (SAADC_CH_CONFIG_GAIN_Gain1_6 << SAADC_CH_CONFIG_GAIN_Pos) |
+                                       (SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) |
+                                       (SAADC_CH_CONFIG_TACQ_3us << SAADC_CH_CONFIG_TACQ_Pos);
+    NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;
+    NRF_SAADC->OVERSAMPLE = SAADC_OVERSAMPLE_OVERSAMPLE_Bypass;  // no oversampling in scan mode
+    NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled;
+
+    // Offset calibration, then stop the SAADC before the first START (erratum)
+    NRF_SAADC->EVENTS_CALIBRATEDONE = 0;
+    NRF_SAADC->TASKS_CALIBRATEOFFSET = 1;
+    while (NRF_SAADC->EVENTS_CALIBRATEDONE == 0) {}
+    NRF_SAADC->EVENTS_CALIBRATEDONE = 0;
+    NRF_SAADC->EVENTS_STOPPED = 0;
+    NRF_SAADC->TASKS_STOP = 1;
+    while (NRF_SAADC->EVENTS_STOPPED == 0) {}
+    NRF_SAADC->EVENTS_STOPPED = 0;
+
+    // Sample clock: 1 MHz, compare 0 restarts the timer
+    SENSOR_TIMER->MODE = TIMER_MODE_MODE_Timer;
+    SENSOR_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+    SENSOR_TIMER->PRESCALER = 4;
+    SENSOR_TIMER->CC[0] = SENSOR_PERIOD_US;
+    SENSOR_TIMER->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+
+    // Idle sample clock: 32768 Hz, compare 0 is routed to PPI
+    SENSOR_RTC->PRESCALER = 0;
+    SENSOR_RTC->CC[0] = SENSOR_RTC_TICKS;
+    SENSOR_RTC->EVTENSET = RTC_EVTEN_COMPARE0_Msk;
+
+    // timer (or RTC) -> SAMPLE, END -> START. The event is set by sensor_start()
+    NRF_PPI->CH[SENSOR_PPI_CH].TEP = (uint32_t)&NRF_SAADC->TASKS_SAMPLE;
+    NRF_PPI->CH[SENSOR_PPI_CH + 1].EEP = (uint32_t)&NRF_SAADC->EVENTS_END;
+    NRF_PPI->CH[SENSOR_PPI_CH + 1].TEP = (uint32_t)&NRF_SAADC->TASKS_START;
+
+    NVIC_EnableIRQ(SAADC_IRQn);
+}
+
+void sensor_start(void) {
+    _next = 0;
+    _done = 0;
+    _running = 1;
+    NRF_SAADC->RESULT.MAXCNT = (_rate == SENSOR_RATE_FULL) ? SENSOR_BLOCK_LEN : SENSOR_FRAME_LEN;
+    NRF_SAADC->RESULT.PTR = (uint32_t)_buf[0];
+    NRF_SAADC->EVENTS_END = 0;
+    NRF_SAADC->EVENTS_STARTED = 0;
+    NRF_SAADC->INTENSET = SAADC_INTENSET_END_Msk | SAADC_INTENSET_STARTED_Msk;
+
+    if (_rate == SENSOR_RATE_FULL) {
+        NRF_PPI->CH[SENSOR_PPI_CH].EEP = (uint32_t)&SENSOR_TIMER->EVENTS_COMPARE[0];
+        NRF_PPI->FORK[SENSOR_PPI_CH].TEP = 0;
+    }
+    else {
+        NRF_PPI->CH[SENSOR_PPI_CH].EEP = (uint32_t)&SENSOR_RTC->EVENTS_COMPARE[0];
+        NRF_PPI->FORK[SENSOR_PPI_CH].TEP = (uint32_t)&SENSOR_RTC->TASKS_CLEAR;
+    }
+    NRF_PPI->CHENSET = SENSOR_PPI_MASK;
+    NRF_SAADC->TASKS_START = 1;
+    if (_rate == SENSOR_RATE_FULL) {
+        SENSOR_TIMER->TASKS_CLEAR = 1;
+        SENSOR_TIMER->TASKS_START = 1;
+    }
+    else {
+        SENSOR_RTC->TASKS_CLEAR = 1;
+        SENSOR_RTC->TASKS_START = 1;
+    }
+}
+
+void sensor_stop(void) {
+    _running = 0;
+    SENSOR_TIMER->TASKS_STOP = 1;
+    SENSOR_RTC->TASKS_STOP = 1;
+    NRF_PPI->CHENCLR = SENSOR_PPI_MASK;
+
+    /* no callback for the partial block */
+    NRF_SAADC->INTENCLR = SAADC_INTENCLR_END_Msk | SAADC_INTENCLR_STARTED_Msk;
+    NRF_SAADC->EVENTS_STOPPED = 0;
+    NRF_SAADC->TASKS_STOP = 1;
+    while (NRF_SAADC->EVENTS_STOPPED == 0) {}
+    NRF_SAADC->EVENTS_STOPPED = 0;
+    NRF_SAADC->EVENTS_END = 0;
+    NRF_SAADC->EVENTS_STARTED = 0;
+    NVIC_ClearPendingIRQ(SAADC_IRQn);
+}
+
+void sensor_set_rate(sensor_rate_t rate) {
+    if (rate == _rate) {
+        return;
+    }
+    unsigned running = _running;
+    if (running) {
+        sensor_stop();
+    }
+    _rate = rate;
+    if (running) {
+        sensor_start();
+    }
+}
+
+#endif /* !SENSOR_SIM */
@@ -0,0 +1,155 @@
+/**
+ * @file
+ * @brief       Simulated load cells, for the native board
+ *
+ * Repeats a hang cycle on every channel: idle, a ramp up to the hang load,
+ * a hold, and a ramp down. Each channel is a bit out of phase and carries a
+ * little noise, like two hands that don't load the board exactly together.
+ * The noise comes from a fixed seed LCG, so runs are reproducible. The supply
+ * voltage discharges linearly from SIM_VDD_FULL_MV, to see the battery level
+ * move.
+ *
+ * A ztimer stands for the hardware sample clock and fills the same two
+ * buffers as the SAADC backend, and the blocks are handed over from the timer
+ * callback (interrupt context), like the SAADC END interrupt. At the idle
+ * rate, the hang cycle moves on by the frames the full rate would have taken.
+ */
+
+#if SENSOR_SIM
+
+#include "ztimer.h"
+
+#include "sensor.h"
+
+/* ----------------------  Defines --------------------- */
+#define SIM_IDLE            (150U)      // Samples of each phase
+#define SIM_RAMP            (15U)
+#define SIM_HOLD            (350U)
+#define SIM_PERIOD          (SIM_IDLE + 2 * SIM_RAMP + SIM_HOLD)
+#define SIM_LOAD            (3500)      // Raw counts per hand while hanging
+#define SIM_PHASE           (3U)        // Delay between channels, samples
+#define SIM_NOISE_MASK      (0x1f)      // Noise amplitude, raw counts
+
+#define SIM_VDD_FULL_MV     (3000U)     // Supply of a new battery
+#define SIM_VDD_DROP        (50U)       // Frames per mV of discharge, ~1 mV/s
+#define SIM_VDD_EMPTY_MV    (1900U)
+
+#define SENSOR_BLOCK_LEN    (SENSOR_BLOCK_FRAMES * SENSOR_FRAME_LEN)
+
+/* ----------------------  Variables --------------------- */
+
+static uint32_t _tick;
+static uint32_t _lcg = 1;
+
+static int16_t _buf[2][SENSOR_BLOCK_LEN];
+static uint8_t _cur;            // Buffer being filled
+static unsigned _frames;        // Frames in the current buffer
+static uint32_t _block_us;      // Time of the first frame of the current buffer
+static uint32_t _next_us;       // Time of the next frame
+static sensor_rate_t _rate;
+static uint8_t _running;
+
+static ztimer_t _timer;
+static sensor_block_cb_t _on_block;
+static void *_on_block_arg;
+
+/* ----------------------  Private  --------------------- */
+
+static int32_t _noise(void) {
+    _lcg = _lcg * 1664525UL + 1013904223UL;
+    return (int32_t)((_lcg >> 24) & SIM_NOISE_MASK) - (SIM_NOISE_MASK / 2);
+}
+
+static int16_t _vdd(void) {
+    uint32_t drop = _tick / SIM_VDD_DROP;
+    uint32_t mv = (drop < SIM_VDD_FULL_MV - SIM_VDD_EMPTY_MV) ? SIM_VDD_FULL_MV - drop
+                                                               : SIM_VDD_EMPTY_MV;
+
+    /* back to raw counts, see SENSOR_VDD_MV */
+    return (int16_t)(mv * 4096 / 3600) + (_noise() >> 2);
+}
+
+static int32_t _profile(uint32_t t) {
+    t %= SIM_PERIOD;
+
+    if (t < SIM_IDLE) {
+        return 0;
+    }
+    t -= SIM_IDLE;
+    if (t < SIM_RAMP) {
+        return SIM_LOAD * (int32_t)t / SIM_RAMP;
+    }
+    t -= SIM_RAMP;
+    if (t < SIM_HOLD) {
+        return SIM_LOAD;
+    }
+    t -= SIM_HOLD;
+    return SIM_LOAD - SIM_LOAD * (int32_t)t / SIM_RAMP;
+}
+
+static void _sample(void *arg) {
+    (void)arg;
+
+    /* rearm against the ideal time, the callback latency doesn't add up */
+    uint32_t now_us = ztimer_now(ZTIMER_USEC);
+    uint32_t period_us = (_rate == SENSOR_RATE_FULL) ? SENSOR_PERIOD_US : SENSOR_IDLE_PERIOD_US;
+    unsigned block_frames = (_rate == SENSOR_RATE_FULL) ? SENSOR_BLOCK_FRAMES : 1;
+    _next_us += period_us;
+    ztimer_set(ZTIMER_USEC, &_timer, ((int32_t)(_next_us - now_us) > 0) ? _next_us - now_us : 0);
+
+    if (_frames == 0) {
+        _block_us = now_us;
+    }
+    int16_t *frame = &_buf[_cur][_frames * SENSOR_FRAME_LEN];
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        frame[ch] = _profile(_tick + ch * SIM_PHASE) + _noise();
+    }
+    frame[SENSOR_VDD] = _vdd();
+    _tick += period_us / SENSOR_PERIOD_US;
+
+    if (++_frames == block_frames) {
+        _frames = 0;
+        _on_block(_buf[_cur], block_frames, _block_us, _on_block_arg);
+        _cur ^= 1;
+    }
+}
+
+/* ----------------------  Public  --------------------- */
+
+void sensor_init(sensor_block_cb_t cb, void *arg) {
+    _on_block = cb;
+    _on_block_arg = arg;
+    _timer.callback = _sample;
+    _tick = 0;
+}
+
+void sensor_start(void) {
+    uint32_t period_us = (_rate == SENSOR_RATE_FULL) ? SENSOR_PERIOD_US : SENSOR_IDLE_PERIOD_US;
+
+    _cur = 0;
+    _frames = 0;
+    _running = 1;
+    _next_us = ztimer_now(ZTIMER_USEC) + period_us;
+    ztimer_set(ZTIMER_USEC, &_timer, period_us);
+}
+
+void sensor_stop(void) {
+    _running = 0;
+    ztimer_remove(ZTIMER_USEC, &_timer);
+}
+
+void sensor_set_rate(sensor_rate_t rate) {
+    if (rate == _rate) {
+        return;
+    }
+    unsigned running = _running;
+    if (running) {
+        sensor_stop();
+    }
+    _rate = rate;
+    if (running) {
+        sensor_start();
+    }
+}
+
+#endif /* SENSOR_SIM */
@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @brief       Persistent records in the last flash pages
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "checksum/fletcher16.h"
+#include "periph/flashpage.h"
+#if STORAGE_ERASE_US
+#include "ztimer.h"
+#endif
+
+#include "storage.h"
+
+/* ----------------------  Defines --------------------- */
+#define STORAGE_MAGIC       (0x48424431UL)  // "HBD1"
+#ifndef STORAGE_ERASE_US
+#define STORAGE_ERASE_US    (0U)    // Erase time to simulate, the native flash takes none
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint16_t len;
+    uint16_t checksum;
+} storage_hdr_t;
+
+/* ----------------------  Private  --------------------- */
+
+static unsigned _page(storage_slot_t slot) {
+    return FLASHPAGE_NUMOF - 1 - (unsigned)slot;
+}
+
+/* ----------------------  Public  --------------------- */
+
+int storage_load(storage_slot_t slot, void *data, size_t len) {
+    const uint8_t *addr = flashpage_addr(_page(slot));
+    storage_hdr_t hdr;
+
+    memcpy(&hdr, addr, sizeof(hdr));
+    if (hdr.magic != STORAGE_MAGIC || hdr.len != len ||
+        hdr.checksum != fletcher16(addr + sizeof(hdr), len)) {
+        return -ENOENT;
+    }
+
+    memcpy(data, addr + sizeof(hdr), len);
+    return 0;
+}
+
+int storage_save(storage_slot_t slot, const void *data, size_t len) {
+    uint8_t *addr = flashpage_addr(_page(slot));
+    size_t aligned = len & ~(FLASHPAGE_WRITE_BLOCK_SIZE - 1);
+    storage_hdr_t hdr = {
+        .magic = STORAGE_MAGIC,
+        .len = len,
+        .checksum = fletcher16(data, len),
+    };
+
+    if (sizeof(hdr) + len > FLASHPAGE_SIZE) {
+        return -EFBIG;
+    }
+
+    flashpage_erase(_page(slot));
+#if STORAGE_ERASE_US
+    /* as long as a page erase of the nRF52, busy like the CPU during it */
+    ztimer_spin(ZTIMER_USEC, STORAGE_ERASE_US);
+#endif
+    flashpage_write(addr, &hdr, sizeof(hdr));
+    flashpage_write(addr + sizeof(hdr), data, aligned);
+
+    /* the last bytes are padded up to a full write block */
+    if (aligned < len) {
+        uint32_t tail[FLASHPAGE_WRITE_BLOCK_SIZE / sizeof(uint32_t)];
+        memset(tail, 0xff, sizeof(tail));
+        memcpy(tail, (const uint8_t *)data + aligned, len - aligned);
+        flashpage_write(addr + sizeof(hdr) + aligned, tail, sizeof(tail));
+    }
+
+    return 0;
+}
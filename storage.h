@@ -0,0 +1,32 @@
+/**
+ * @file
+ * @brief       Persistent records in the last flash pages
+ *
+ * Every slot owns a full flash page, counted backwards from the end of the
+ * flash. A record is a small header (magic, length, checksum) followed by the
+ * raw data, so a blank or half written page is detected and ignored.
+ */
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stddef.h>
+
+/* One flash page per slot */
+typedef enum {
+    STORAGE_SLOT_BOND = 0,      // Bonds and CCCDs of known centrals
+    STORAGE_SLOT_CALIB = 1,     // Tare and calibration table
+    STORAGE_SLOT_NUMOF,
+} storage_slot_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Copy the record of a slot into data. Returns 0, or -ENOENT if the slot holds
+ * no valid record of exactly len bytes */
+int storage_load(storage_slot_t slot, void *data, size_t len);
+
+/* Erase the page of the slot and write a new record. data must be 4 byte aligned.
+ * Returns 0, or -EFBIG if the record doesn't fit in a page */
+int storage_save(storage_slot_t slot, const void *data, size_t len);
+
+#endif /* STORAGE_H */
@@ -0,0 +1,352 @@
+/**
+ * @file
+ * @brief       Packetizer of the high rate vendor stream
+ *
+ * The format characteristic and the MTU exchange are handled by the NimBLE
+ * host thread. They only leave a pending configuration, which the sampling
+ * thread picks up at the start of the next packet, so a packet never mixes
+ * two formats. The staged packets are only touched by the sampling thread.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+
+#include "irq.h"
+
+#include "calib.h"
+#include "pool.h"
+#include "stream.h"
+
+/* ----------------------  Defines --------------------- */
+
+/* Writes one frame at dst, returns the position of the next one */
+typedef uint8_t *(*stream_put_fn)(uint8_t *dst, const int32_t *frame);
+
+typedef struct {
+    uint8_t first_size;         // Bytes of a channel in the first frame of a packet
+    uint8_t size;               // Bytes of a channel in the following frames
+    stream_put_fn put_first;
+    stream_put_fn put;
+} stream_encoder_t;
+
+#define STREAM_SAMPLE_MAX   (3U)    // Bytes of a channel in the first frame, FIXED24
+
+static_assert(STREAM_PAYLOAD_MIN >= sizeof(stream_hdr_t) + STREAM_SAMPLE_MAX * SENSOR_CHANNELS,
+              "a frame of every format must fit in the default ATT MTU");
+
+/* ----------------------  Variables --------------------- */
+
+static int16_t _prev[SENSOR_CHANNELS];  // Last values sent by the delta encoder
+
+static stream_cfg_t _cfg = {
+    .format = STREAM_FMT_INT16,
+    .divider = 1,
+    .flags = STREAM_FLAG_TIMESTAMP,
+    .deadband = 0,
+};
+static unsigned _payload = STREAM_PAYLOAD_MIN;
+
+// Configuration waiting for the next packet
+static stream_cfg_t _pending_cfg;
+static unsigned _pending_payload = STREAM_PAYLOAD_MIN;
+static volatile uint8_t _pending;
+static volatile uint8_t _reset_pending;
+
+// Packet in progress, and the staged ones, oldest first
+POOL_DEFINE(_pkt_pool, "tx packet", sizeof(stream_pkt_t), MEM_TX_PACKETS);
+static stream_pkt_t *_pkt;
+static stream_pkt_t *_staged[MEM_TX_PACKETS];
+static uint8_t _staged_first;
+static uint8_t _staged_numof;
+static uint8_t *_pos;
+static uint8_t _seq;
+static uint8_t _count;
+static uint8_t _capacity;
+static uint8_t _div_cnt;
+static stream_put_fn _put;
+static stream_put_fn _put_next;
+
+// Deadband
+static int16_t _ref[SENSOR_CHANNELS];   // Last frame out of the deadband [0.01 kg]
+static uint8_t _active;                 // Full rate, until the load settles
+static uint8_t _quiet_cnt;              // Frames within the deadband
+static uint32_t _sent_us;               // Time of the last frame sent
+
+static stream_stats_t _stats;
+
+/* ----------------------  Encoders --------------------- */
+
+/* The channel loops have a constant trip count, the compiler unrolls them */
+
+static uint8_t *_put_int16(uint8_t *dst, const int32_t *frame) {
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        int16_t val = calib_coarse(frame[ch]);
+
+        dst[0] = (uint16_t)val & 0xff;
+        dst[1] = (uint16_t)val >> 8;
+        dst += 2;
+    }
+    return dst;
+}
+
+static uint8_t *_put_fixed24(uint8_t *dst, const int32_t *frame) {
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        int32_t sample = frame[ch];
+
+        if (sample > 0x7fffff) {
+            sample = 0x7fffff;
+        }
+        else if (sample < -0x800000) {
+            sample = -0x800000;
+        }
+
+        dst[0] = (uint32_t)sample & 0xff;
+        dst[1] = ((uint32_t)sample >> 8) & 0xff;
+        dst[2] = ((uint32_t)sample >> 16) & 0xff;
+        dst += 3;
+    }
+    return dst;
+}
+
+static uint8_t *_put_delta8_first(uint8_t *dst, const int32_t *frame) {
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        _prev[ch] = calib_coarse(frame[ch]);
+
+        dst[0] = (uint16_t)_prev[ch] & 0xff;
+        dst[1] = (uint16_t)_prev[ch] >> 8;
+        dst += 2;
+    }
+    return dst;
+}
+
+static uint8_t *_put_delta8(uint8_t *dst, const int32_t *frame) {
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        int32_t delta = calib_coarse(frame[ch]) - _prev[ch];
+
+        /* a saturated delta is caught up by the next samples */
+        if (delta > INT8_MAX) {
+            delta = INT8_MAX;
+        }
+        else if (delta < INT8_MIN) {
+            delta = INT8_MIN;
+        }
+        _prev[ch] += delta;
+
+        *dst++ = (uint8_t)(int8_t)delta;
+    }
+    return dst;
+}
+
+static const stream_encoder_t _encoders[STREAM_FMT_NUMOF] = {
+    [STREAM_FMT_DELTA8] = { 2, 1, _put_delta8_first, _put_delta8 },
+    [STREAM_FMT_INT16] = { 2, 2, _put_int16, _put_int16 },
+    [STREAM_FMT_FIXED24] = { 3, 3, _put_fixed24, _put_fixed24 },
+};
+
+/* ----------------------  Private  --------------------- */
+
+static void _apply_pending(void) {
+    unsigned state = irq_disable();
+    _cfg = _pending_cfg;
+    _payload = _pending_payload;
+    _pending = 0;
+    irq_restore(state);
+}
+
+static void _unstage(void) {
+    pool_free(&_pkt_pool, _staged[_staged_first]);
+    _staged_first = (_staged_first + 1) % MEM_TX_PACKETS;
+    _staged_numof--;
+}
+
+static void _reset(void) {
+    _reset_pending = 0;
+    pool_free(&_pkt_pool, _pkt);
+    _pkt = NULL;
+    while (_staged_numof > 0) {
+        _unstage();
+    }
+    _count = 0;
+    _div_cnt = 0;
+    _active = 1;        // a new subscriber gets the current load at once
+    _quiet_cnt = 0;
+}
+
+static int _start_packet(uint32_t now_us) {
+    _pkt = pool_alloc(&_pkt_pool);
+    if (_pkt == NULL) {
+        return -ENOMEM;
+    }
+    if (_pending) {
+        _apply_pending();
+    }
+
+    const stream_encoder_t *enc = &_encoders[_cfg.format];
+    unsigned room = _payload - sizeof(stream_hdr_t) - enc->first_size * SENSOR_CHANNELS;
+    unsigned capacity = 1 + room / (enc->size * SENSOR_CHANNELS);
+    _capacity = (capacity > UINT8_MAX) ? UINT8_MAX : capacity;
+
+    stream_hdr_t *hdr = (stream_hdr_t *)_pkt->data;
+    hdr->seq = _seq;
+    hdr->format = _cfg.format | STREAM_FLAG_TIMESTAMP;
+    hdr->channels = SENSOR_CHANNELS;
+    hdr->t_us = now_us;
+    hdr->divider = _cfg.divider;
+    _pos = _pkt->data + sizeof(*hdr);
+    _put = enc->put_first;
+    _put_next = enc->put;
+    return 0;
+}
+
+/* Within the deadband of the reference, on every channel */
+static int _quiet(const int32_t *frame) {
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        int32_t diff = calib_coarse(frame[ch]) - _ref[ch];
+        if (diff > _cfg.deadband || diff < -(int32_t)_cfg.deadband) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void _set_ref(const int32_t *frame) {
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        _ref[ch] = calib_coarse(frame[ch]);
+    }
+}
+
+/* Whether to send the frame. Sets *flush when the packet must go out with it */
+static int _deadband(const int32_t *frame, uint32_t now_us, int *flush) {
+    if (_quiet(frame)) {
+        if (_active) {
+            /* the tail of a change is sent, then the stream stops */
+            if (++_quiet_cnt >= STREAM_QUIET_FRAMES) {
+                _active = 0;
+                *flush = 1;
+            }
+            return 1;
+        }
+        if (now_us - _sent_us < STREAM_HEARTBEAT_MS * 1000UL) {
+            _stats.suppressed++;
+            return 0;
+        }
+        _stats.heartbeats++;
+        _set_ref(frame);
+        *flush = 1;
+        return 1;
+    }
+
+    _active = 1;
+    _quiet_cnt = 0;
+    _set_ref(frame);
+    return 1;
+}
+
+/* ----------------------  Public  --------------------- */
+
+void stream_init(void) {
+    pool_init(&_pkt_pool);
+}
+
+void stream_reset(void) {
+    _reset_pending = 1;
+}
+
+int stream_configure(const stream_cfg_t *cfg) {
+    if (cfg->format >= STREAM_FMT_NUMOF || cfg->divider == 0 ||
+        (cfg->flags & ~STREAM_FLAG_TIMESTAMP)) {
+        return -EINVAL;
+    }
+
+    unsigned state = irq_disable();
+    _pending_cfg = *cfg;
+    _pending_cfg.flags = STREAM_FLAG_TIMESTAMP;     // always on
+    _pending = 1;
+    irq_restore(state);
+    return 0;
+}
+
+void stream_config(stream_cfg_t *cfg) {
+    unsigned state = irq_disable();
+    *cfg = _pending ? _pending_cfg : _cfg;
+    irq_restore(state);
+}
+
+const stream_stats_t *stream_stats(void) {
+    return &_stats;
+}
+
+void stream_set_payload(unsigned len) {
+    if (len > STREAM_PAYLOAD_MAX) {
+        len = STREAM_PAYLOAD_MAX;
+    }
+    if (len < STREAM_PAYLOAD_MIN) {
+        len = STREAM_PAYLOAD_MIN;
+    }
+
+    unsigned state = irq_disable();
+    if (!_pending) {
+        _pending_cfg = _cfg;
+    }
+    _pending_payload = len;
+    _pending = 1;
+    irq_restore(state);
+}
+
+int stream_push(const int32_t frame[SENSOR_CHANNELS], uint32_t now_us) {
+    if (_reset_pending) {
+        _reset();
+    }
+    if (++_div_cnt < _cfg.divider) {
+        return 0;
+    }
+    _div_cnt = 0;
+
+    int flush = 0;
+    if (_cfg.deadband != 0 && !_deadband(frame, now_us, &flush)) {
+        return 0;
+    }
+    _sent_us = now_us;
+
+    /* nowhere to build the packet: the frame is lost, try again with the next one */
+    if (_count == 0 && _start_packet(now_us) != 0) {
+        _stats.dropped++;
+        return 0;
+    }
+
+    /* the first frame of a packet may have its own encoding (delta base) */
+    _pos = _put(_pos, frame);
+    _put = _put_next;
+    _pkt->last_us = now_us;
+
+    if (++_count < _capacity && !flush) {
+        return 0;
+    }
+
+    _stats.packets++;
+    _stats.frames += _count;
+    ((stream_hdr_t *)_pkt->data)->count = _count;
+    _pkt->len = _pos - _pkt->data;
+    _count = 0;
+    _seq++;
+
+    /* the staging ring has a slot for every block of the pool */
+    _staged[(_staged_first + _staged_numof++) % MEM_TX_PACKETS] = _pkt;
+    _pkt = NULL;
+    return 1;
+}
+
+const stream_pkt_t *stream_peek(void) {
+    return (_staged_numof > 0) ? _staged[_staged_first] : NULL;
+}
+
+void stream_pop(int sent) {
+    if (_staged_numof == 0) {
+        return;
+    }
+    if (!sent) {
+        _stats.failed++;
+    }
+    _unstage();
+}
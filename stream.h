@@ -0,0 +1,134 @@
+/**
+ * @file
+ * @brief       Packetizer of the high rate vendor stream
+ *
+ * Frames (one sample per channel) are batched, so one notification carries as
+ * many of them as fit in the ATT payload. The channels of a frame are
+ * interleaved. Every packet carries the device time of its first frame
+ * (ZTIMER_USEC), see timesync.h to map it to the client clock. The client
+ * negotiates the sample format and the rate through the format characteristic:
+ *
+ * - STREAM_FMT_DELTA8: first frame as int16, then int8 deltas, in 0.01 kg.
+ *   Deltas saturate, and the error is carried over to the next sample.
+ * - STREAM_FMT_INT16: int16 samples, in 0.01 kg.
+ * - STREAM_FMT_FIXED24: int24 samples, in 0.01 kg with CALIB_FRAC_BITS
+ *   fractional bits.
+ *
+ * Every format has its own encoder, selected when the format changes, so the
+ * per sample path doesn't branch on the format.
+ *
+ * With a deadband, the stream only runs while the load changes. Once all
+ * channels stayed within the deadband for STREAM_QUIET_FRAMES frames, the
+ * packet in progress is sent and the following frames are dropped, but for a
+ * heartbeat frame every STREAM_HEARTBEAT_MS. The first frame out of the
+ * deadband (around the last frame sent) restarts the full rate stream.
+ *
+ * Packets are built in blocks of a pool of MEM_TX_PACKETS and stay staged
+ * until they are handed to the host (stream_peek, stream_pop). When the host
+ * runs out of buffers, they wait there; when the pool runs out too, the
+ * frames are dropped and the sequence counter shows the gap to the client.
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+
+#include "sensor.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef STREAM_PAYLOAD_MAX
+#define STREAM_PAYLOAD_MAX  (244U)  // Largest notification, with the largest ATT MTU
+#endif
+#define STREAM_PAYLOAD_MIN  (20U)   // Notification payload with the default ATT MTU
+#ifndef MEM_TX_PACKETS
+#define MEM_TX_PACKETS      (4U)    // Packets staged for transmission
+#endif
+
+#ifndef STREAM_QUIET_FRAMES
+#define STREAM_QUIET_FRAMES (25U)   // Frames within the deadband before the stream stops
+#endif
+#ifndef STREAM_HEARTBEAT_MS
+#define STREAM_HEARTBEAT_MS (2000U) // Keepalive while the stream is stopped
+#endif
+
+#define STREAM_FLAG_TIMESTAMP   (0x80)  // The header has the time of the first sample, always set
+#define STREAM_FMT_MASK         (0x03)
+
+typedef enum {
+    STREAM_FMT_DELTA8 = 0,
+    STREAM_FMT_INT16 = 1,
+    STREAM_FMT_FIXED24 = 2,
+    STREAM_FMT_NUMOF,
+} stream_fmt_t;
+
+/* Content of the format characteristic */
+typedef struct __attribute__((packed)) {
+    uint8_t format;         // One of stream_fmt_t
+    uint8_t divider;        // Send one frame out of divider, 1 for the full rate
+    uint8_t flags;          // STREAM_FLAG_TIMESTAMP
+    uint8_t deadband;       // Change that restarts the stream [0.01 kg], 0 streams all the time
+} stream_cfg_t;
+
+/* Traffic counters, since boot */
+typedef struct {
+    uint32_t packets;       // Notifications
+    uint32_t frames;        // Frames sent
+    uint32_t suppressed;    // Frames dropped by the deadband
+    uint32_t heartbeats;    // Keepalive packets
+    uint32_t dropped;       // Frames dropped, no room to stage them
+    uint32_t failed;        // Packets the host refused to send
+} stream_stats_t;
+
+/* Packet staged for transmission */
+typedef struct {
+    uint32_t last_us;       // Acquisition of the newest frame, for the latency probe
+    uint16_t len;
+    uint8_t data[STREAM_PAYLOAD_MAX];
+} stream_pkt_t;
+
+/* Packet header (little endian), followed by the frames. The frames of a
+ * packet are every divider-th sample period apart */
+typedef struct __attribute__((packed)) {
+    uint8_t seq;            // Packet counter, shows lost notifications
+    uint8_t format;         // stream_fmt_t | flags
+    uint8_t channels;       // Samples per frame
+    uint8_t count;          // Frames in the packet
+    uint32_t t_us;          // Device time of the first frame
+    uint8_t divider;        // Rate divider of the frames
+} stream_hdr_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Set up the staging pool */
+void stream_init(void);
+
+/* Drop the samples of the batch in progress and the staged packets, e.g. when
+ * a client subscribes. Applied with the next frame */
+void stream_reset(void);
+
+/* Request a new format, applied from the next packet on. Returns 0, or
+ * -EINVAL if the configuration is not supported */
+int stream_configure(const stream_cfg_t *cfg);
+
+/* Current format */
+void stream_config(stream_cfg_t *cfg);
+
+/* Largest notification payload, from the negotiated ATT MTU */
+void stream_set_payload(unsigned len);
+
+/* Traffic counters */
+const stream_stats_t *stream_stats(void);
+
+/* Add a frame (fine units, see calib.h), sampled at time now_us. Returns 1
+ * once a packet is full and staged, 0 otherwise */
+int stream_push(const int32_t frame[SENSOR_CHANNELS], uint32_t now_us);
+
+/* Oldest staged packet, NULL if there is none */
+const stream_pkt_t *stream_peek(void);
+
+/* Release the oldest staged packet, once handed to the host (sent is 0 if the
+ * host refused it) */
+void stream_pop(int sent);
+
+#endif /* STREAM_H */
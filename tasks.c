@@ -0,0 +1,107 @@
+/**
+ * @file
+ * @brief       Threads and event queues of the firmware
+ */
+
+#include <stdio.h>
+
+#include "irq.h"
+#include "thread.h"
+
+#include "prof.h"
+
+#include "tasks.h"
+
+/* ----------------------  Defines --------------------- */
+#define TASKS_IO_PRIO       (THREAD_PRIORITY_MAIN + 1)  // Below the sampling
+
+/* ----------------------  Variables --------------------- */
+
+static event_queue_t _sampling_eq;
+static event_queue_t _housekeeping_eq;
+static char _housekeeping_stack[THREAD_STACKSIZE_DEFAULT];
+
+// Blocks of samples, handed over by the sensor interrupt
+static tasks_block_cb_t _block_handler;
+static event_t _block_evt;
+static const int16_t *_pending;     // Block waiting to be processed
+static uint32_t _pending_us;        // Time of its first frame
+static unsigned _pending_frames;    // Frames in it, one at the idle rate
+static uint8_t _pending_lost;       // A block was overwritten before being processed
+static unsigned _lost_numof;        // Overwritten blocks, since boot
+
+/* ----------------------  Private  --------------------- */
+
+static void _handle_block(event_t *e) {
+    (void)e;
+
+    unsigned state = irq_disable();
+    const int16_t *block = _pending;
+    unsigned frames = _pending_frames;
+    uint32_t t_us = _pending_us;
+    uint8_t lost = _pending_lost;
+    _pending = NULL;
+    _pending_lost = 0;
+    irq_restore(state);
+
+    if (lost) {
+        _lost_numof++;
+        puts("[SENSOR] block lost, processing too slow");
+    }
+    if (block != NULL) {
+        _block_handler(block, frames, t_us);
+    }
+}
+
+static void *_housekeeping_thread(void *arg) {
+    (void)arg;
+
+    event_queue_claim(&_housekeeping_eq);
+    PROF_EVENT_LOOP(&_housekeeping_eq);
+
+    return NULL;
+}
+
+/* ----------------------  Public  --------------------- */
+
+void tasks_init(tasks_block_cb_t cb) {
+    /* the housekeeping queue is claimed by its thread, events posted before wait there */
+    event_queue_init(&_sampling_eq);
+    event_queue_init_detached(&_housekeeping_eq);
+    _block_handler = cb;
+    _block_evt.handler = _handle_block;
+    PROF_EVENT_NAME(&_block_evt, "sensor block");
+}
+
+void tasks_start(void) {
+    thread_create(_housekeeping_stack, sizeof(_housekeeping_stack), TASKS_IO_PRIO,
+                  THREAD_CREATE_STACKTEST, _housekeeping_thread, NULL, "housekeeping");
+}
+
+void tasks_run(void) {
+    PROF_EVENT_LOOP(&_sampling_eq);
+}
+
+event_queue_t *tasks_eq(void) {
+    return &_sampling_eq;
+}
+
+event_queue_t *tasks_io_eq(void) {
+    return &_housekeeping_eq;
+}
+
+void tasks_sensor_block(const int16_t *block, unsigned frames, uint32_t t_us, void *arg) {
+    (void)arg;
+
+    if (_pending != NULL) {
+        _pending_lost = 1;
+    }
+    _pending = block;
+    _pending_frames = frames;
+    _pending_us = t_us;
+    event_post(&_sampling_eq, &_block_evt);
+}
+
+unsigned tasks_lost(void) {
+    return _lost_numof;
+}
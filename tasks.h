@@ -0,0 +1,44 @@
+/**
+ * @file
+ * @brief       Threads and event queues of the firmware
+ *
+ * Two queues: the sampling one, run by the main thread, takes the sensor
+ * blocks and everything that touches the samples. The housekeeping one, run
+ * by a thread one priority below, takes the slow jobs (flash writes,
+ * advertising phases): the main thread preempts them as soon as a block is
+ * ready, so they never delay the sampling.
+ */
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <stdint.h>
+
+#include "event.h"
+
+/* A block of frames, in the sampling thread */
+typedef void (*tasks_block_cb_t)(const int16_t *block, unsigned frames, uint32_t t_us);
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Create the queues, from the main thread before anything is posted. The
+ * blocks handed over by tasks_sensor_block() go to cb */
+void tasks_init(tasks_block_cb_t cb);
+
+/* Start the housekeeping thread, the events posted before wait in its queue */
+void tasks_start(void);
+
+/* Run the sampling queue in the calling thread, forever */
+void tasks_run(void);
+
+event_queue_t *tasks_eq(void);
+event_queue_t *tasks_io_eq(void);
+
+/* Sensor callback, see sensor_init(). Interrupt context: only hands the block
+ * over to the sampling queue */
+void tasks_sensor_block(const int16_t *block, unsigned frames, uint32_t t_us, void *arg);
+
+/* Blocks overwritten before the sampling queue got to them, since boot */
+unsigned tasks_lost(void);
+
+#endif /* TASKS_H */
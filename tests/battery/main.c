@@ -0,0 +1,146 @@
+/**
+ * @file
+ * @brief       Native test of the battery level
+ *
+ * The VDD conversions of the simulated load cells, which discharge the cell
+ * from full to empty, go through battery_push() one per block, like in the
+ * firmware. Constant voltages check the hysteresis of the reported level.
+ */
+
+#include <string.h>
+
+#include "embUnit.h"
+
+/* the modules under test, statics included */
+#include "battery.c"
+#include "sensor_sim.c"
+
+/* ----------------------  Defines --------------------- */
+#define LEVELS_MAX          (128U)
+
+/* ----------------------  Variables --------------------- */
+
+static uint8_t _levels[LEVELS_MAX];     // Reported by the callback, in order
+static unsigned _levels_numof;
+
+/* ----------------------  Private  --------------------- */
+
+static void _changed(uint8_t level) {
+    if (_levels_numof < LEVELS_MAX) {
+        _levels[_levels_numof] = level;
+    }
+    _levels_numof++;
+}
+
+/* Raw counts of a supply voltage, the inverse of SENSOR_VDD_MV() */
+static int16_t _raw(unsigned mv) {
+    return (int16_t)((mv * 4096 + 3599) / 3600);
+}
+
+/* A full average at a constant voltage */
+static void _hold(unsigned mv) {
+    for (unsigned i = 0; i < BATTERY_AVG_NUMOF; i++) {
+        battery_push(_raw(mv));
+    }
+}
+
+/* Lowest voltage above mv whose level is at least rise above it */
+static unsigned _above(unsigned mv, unsigned rise) {
+    unsigned level = _percent(mv);
+    while (_percent(mv) < level + rise) {
+        mv++;
+    }
+    return mv;
+}
+
+/* A new cell, nothing measured yet */
+static void _setup(void) {
+    _sum = 0;
+    _cnt = 0;
+    _mv = 0;
+    _level = 0;
+    _valid = 0;
+    _levels_numof = 0;
+    _tick = 0;
+    battery_init(_changed);
+}
+
+/* ----------------------  Tests --------------------- */
+
+static void test_battery_lut(void) {
+    TEST_ASSERT_EQUAL_INT(0, _percent(BATTERY_MV_MIN - 100));
+    TEST_ASSERT_EQUAL_INT(0, _lut[0]);
+    TEST_ASSERT_EQUAL_INT(100, _percent(3100));
+    for (unsigned i = 1; i < BATTERY_LUT_NUMOF; i++) {
+        TEST_ASSERT(_lut[i] >= _lut[i - 1]);
+    }
+    for (unsigned mv = BATTERY_MV_MIN - 100; mv < 3100; mv++) {
+        TEST_ASSERT(_percent(mv + 1) >= _percent(mv));
+    }
+}
+
+static void test_battery_discharge(void) {
+    /* one VDD conversion per block, until the simulated cell is empty */
+    while (_tick < (SIM_VDD_FULL_MV - SIM_VDD_EMPTY_MV + 100) * SIM_VDD_DROP) {
+        _tick += SENSOR_BLOCK_FRAMES;
+        battery_push(_vdd());
+    }
+
+    /* full at once, then only down, reported on every change and only then */
+    TEST_ASSERT(_levels_numof > 10 && _levels_numof < LEVELS_MAX);
+    TEST_ASSERT(_levels[0] >= 95);
+    for (unsigned i = 1; i < _levels_numof; i++) {
+        TEST_ASSERT(_levels[i] < _levels[i - 1]);
+    }
+    TEST_ASSERT_EQUAL_INT(0, battery_level());
+    TEST_ASSERT_EQUAL_INT(_levels[_levels_numof - 1], battery_level());
+}
+
+static void test_battery_hysteresis(void) {
+    /* low on the curve, a step of the table is a single percent */
+    const unsigned base = 2250;
+    unsigned small = _above(base, 1);
+    unsigned big = _above(base, BATTERY_HYST_PCT);
+    TEST_ASSERT(_percent(small) < _percent(base) + BATTERY_HYST_PCT);
+
+    _hold(base);
+    TEST_ASSERT_EQUAL_INT(_percent(base), battery_level());
+    TEST_ASSERT_EQUAL_INT(1, _levels_numof);
+
+    /* the same level again, or a rise within the hysteresis: not reported */
+    _hold(base);
+    _hold(small);
+    TEST_ASSERT_EQUAL_INT(1, _levels_numof);
+    TEST_ASSERT_EQUAL_INT(_percent(base), battery_level());
+
+    /* a rise of the hysteresis (new cell) */
+    _hold(big);
+    TEST_ASSERT_EQUAL_INT(2, _levels_numof);
+    TEST_ASSERT_EQUAL_INT(_percent(big), battery_level());
+
+    /* down, by any step, at once */
+    _hold(small);
+    TEST_ASSERT_EQUAL_INT(3, _levels_numof);
+    TEST_ASSERT_EQUAL_INT(_percent(small), battery_level());
+}
+
+static Test *tests_battery(void) {
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_battery_lut),
+        new_TestFixture(test_battery_discharge),
+        new_TestFixture(test_battery_hysteresis),
+    };
+
+    EMB_UNIT_TESTCALLER(battery_tests, _setup, NULL, fixtures);
+    return (Test *)&battery_tests;
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(void) {
+    TESTS_START();
+    TESTS_RUN(tests_battery());
+    TESTS_END();
+
+    return 0;
+}
@@ -0,0 +1,8 @@
+#!/usr/bin/env python3
+
+import sys
+from testrunner import run_check_unittests
+
+
+if __name__ == "__main__":
+    sys.exit(run_check_unittests())
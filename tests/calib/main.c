@@ -0,0 +1,196 @@
+/**
+ * @file
+ * @brief       Native test of the tare and calibration engine
+ *
+ * Raw traces of one load cell are replayed through calib_apply(), the way
+ * the sampling does, and the commands are handled from their event queues.
+ * The table is saved to and loaded from the flash emulation of native.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "embUnit.h"
+#include "event.h"
+#include "periph/flashpage.h"
+
+/* the modules under test, statics included */
+#include "calib.c"
+#include "storage.c"
+
+#include "traces.h"
+
+/* ----------------------  Defines --------------------- */
+#define FINE                (1L << CALIB_FRAC_BITS)
+#define NOISE               (3)     // Mean of a replayed trace, 0.01 kg
+
+/* ----------------------  Variables --------------------- */
+
+static event_queue_t _sampling_eq;
+static event_queue_t _housekeeping_eq;
+
+/* ----------------------  Private  --------------------- */
+
+/* Handle what was posted, like the sampling and the housekeeping threads */
+static void _run(event_queue_t *queue) {
+    event_t *ev;
+
+    while ((ev = event_get(queue)) != NULL) {
+        ev->handler(ev);
+    }
+}
+
+/* Replay a trace on a channel. Returns the mean weight [0.01 kg] */
+static int32_t _replay(unsigned channel, const int16_t *trace) {
+    int64_t sum = 0;
+
+    for (unsigned i = 0; i < TRACE_LEN; i++) {
+        sum += calib_apply(channel, trace[i]);
+    }
+    return sum / TRACE_LEN / FINE;
+}
+
+/* Replay a trace, then run a command on the load it leaves */
+static int _command(const int16_t *trace, calib_op_t op, int32_t arg) {
+    if (trace != NULL) {
+        _replay(0, trace);
+    }
+    int res = calib_command(op, arg);
+    _run(&_sampling_eq);
+    _run(&_housekeeping_eq);
+    return res;
+}
+
+static int _near(int32_t expected, int32_t actual) {
+    return actual >= expected - NOISE && actual <= expected + NOISE;
+}
+
+/* Two points on channel 0: empty board and 20 kg */
+static void _calibrate(void) {
+    _command(NULL, CALIB_OP_BEGIN, 0);
+    _command(_trace_empty, CALIB_OP_POINT, 0);
+    _command(_trace_20kg, CALIB_OP_POINT, 2000);
+    _command(NULL, CALIB_OP_COMMIT, 0);
+}
+
+/* A board fresh out of the factory: blank flash, nothing in RAM */
+static void _setup(void) {
+    flashpage_erase(_page(STORAGE_SLOT_CALIB));
+    memset(_raw_avg, 0, sizeof(_raw_avg));
+    _points_numof = 0;
+    _calibrating = 0;
+    _channel = 0;
+    _cmd_busy = 0;
+    _cmd_result = 0;
+    calib_init(&_sampling_eq, &_housekeeping_eq);
+}
+
+/* ----------------------  Tests --------------------- */
+
+static void test_calib_identity(void) {
+    TEST_ASSERT_EQUAL_INT(1, _tables[0].segments);
+    TEST_ASSERT_EQUAL_INT(1234 * FINE, calib_apply(0, 1234));
+}
+
+static void test_calib_tare(void) {
+    TEST_ASSERT_EQUAL_INT(0, _command(_trace_empty, CALIB_OP_TARE, 0));
+
+    /* the empty board reads zero, a load reads its raw counts above it */
+    TEST_ASSERT(_near(0, _replay(0, _trace_empty)));
+    TEST_ASSERT(_near(1200, _replay(0, _trace_20kg)));
+}
+
+static void test_calib_span(void) {
+    _calibrate();
+    TEST_ASSERT_EQUAL_INT(0, _cmd_result);
+    TEST_ASSERT_EQUAL_INT(1, _tables[0].segments);
+
+    /* a load that wasn't a calibration point */
+    TEST_ASSERT(_near(0, _replay(0, _trace_empty)));
+    TEST_ASSERT(_near(2000, _replay(0, _trace_20kg)));
+    TEST_ASSERT(_near(5000, _replay(0, _trace_50kg)));
+
+    /* the other channel isn't touched */
+    TEST_ASSERT_EQUAL_INT(812 * FINE, calib_apply(1, 812));
+}
+
+static void test_calib_commit_keeps_tare(void) {
+    _calibrate();
+    _command(_trace_20kg, CALIB_OP_TARE, 0);
+    TEST_ASSERT(_near(0, _replay(0, _trace_20kg)));
+
+    /* calibrated again, with an extra point: 20 kg still reads zero */
+    _command(NULL, CALIB_OP_BEGIN, 0);
+    _command(_trace_empty, CALIB_OP_POINT, 0);
+    _command(_trace_20kg, CALIB_OP_POINT, 2000);
+    _command(_trace_50kg, CALIB_OP_POINT, 5000);
+    _command(NULL, CALIB_OP_COMMIT, 0);
+    TEST_ASSERT_EQUAL_INT(0, _cmd_result);
+    TEST_ASSERT_EQUAL_INT(2, _tables[0].segments);
+    TEST_ASSERT(_near(0, _replay(0, _trace_20kg)));
+    TEST_ASSERT(_near(3000, _replay(0, _trace_50kg)));
+}
+
+static void test_calib_round_trip(void) {
+    _calibrate();
+    _command(_trace_empty, CALIB_OP_TARE, 0);
+    int32_t loaded = calib_apply(0, 3000);
+
+    /* reboot: the tables come back from flash */
+    memset(_tables, 0, sizeof(_tables));
+    calib_init(&_sampling_eq, &_housekeeping_eq);
+    TEST_ASSERT_EQUAL_INT(1, _tables[0].segments);
+    TEST_ASSERT_EQUAL_INT(loaded, calib_apply(0, 3000));
+    TEST_ASSERT(_near(5000, _replay(0, _trace_50kg)));
+}
+
+static void test_calib_refused(void) {
+    /* refused before they are queued */
+    TEST_ASSERT_EQUAL_INT(-EINVAL, calib_command((calib_op_t)0x7f, 0));
+    TEST_ASSERT_EQUAL_INT(-EINVAL, calib_command(CALIB_OP_BEGIN, SENSOR_CHANNELS));
+    TEST_ASSERT_EQUAL_INT(-EINVAL, calib_command(CALIB_OP_BEGIN, -1));
+
+    /* one command at a time */
+    TEST_ASSERT_EQUAL_INT(0, calib_command(CALIB_OP_ABORT, 0));
+    TEST_ASSERT_EQUAL_INT(-EBUSY, calib_command(CALIB_OP_TARE, 0));
+    _run(&_sampling_eq);
+
+    /* out of a calibration, or a single point: the status has the error */
+    TEST_ASSERT_EQUAL_INT(0, _command(_trace_empty, CALIB_OP_POINT, 0));
+    TEST_ASSERT_EQUAL_INT(-EINVAL, _cmd_result);
+    _command(NULL, CALIB_OP_BEGIN, 0);
+    _command(_trace_empty, CALIB_OP_POINT, 0);
+    _command(NULL, CALIB_OP_COMMIT, 0);
+
+    calib_status_t status;
+    calib_status(&status);
+    TEST_ASSERT_EQUAL_INT(-EINVAL, status.result);
+    TEST_ASSERT_EQUAL_INT(1, status.segments);
+}
+
+static Test *tests_calib(void) {
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_calib_identity),
+        new_TestFixture(test_calib_tare),
+        new_TestFixture(test_calib_span),
+        new_TestFixture(test_calib_commit_keeps_tare),
+        new_TestFixture(test_calib_round_trip),
+        new_TestFixture(test_calib_refused),
+    };
+
+    EMB_UNIT_TESTCALLER(calib_tests, _setup, NULL, fixtures);
+    return (Test *)&calib_tests;
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(void) {
+    event_queue_init(&_sampling_eq);
+    event_queue_init(&_housekeeping_eq);
+
+    TESTS_START();
+    TESTS_RUN(tests_calib());
+    TESTS_END();
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file
+ * @brief       Raw traces of a load cell, for the calibration test
+ *
+ * 64 frames (1.3 s at 50 Hz) of channel 0 at rest under three loads, in the
+ * range of the SAADC: an offset of 812 counts with the board empty, 0.6 counts
+ * per 0.01 kg, and up to +-6 counts of noise. Synthetic, from a fixed seed.
+ */
+
+#ifndef TRACES_H
+#define TRACES_H
+
+#include <stdint.h>
+
+#define TRACE_LEN           (64U)
+
+/* Empty board */
+static const int16_t _trace_empty[TRACE_LEN] = {
+    811, 810, 810, 807, 807, 809, 813, 812, 818, 808, 818, 810,
+    814, 807, 811, 817, 818, 808, 813, 814, 807, 809, 812, 818,
+    810, 816, 813, 818, 812, 813, 813, 817, 817, 810, 814, 814,
+    816, 809, 808, 807, 814, 815, 812, 809, 815, 810, 818, 806,
+    807, 813, 810, 818, 817, 815, 808, 808, 808, 807, 815, 816,
+    817, 807, 811, 811,
+};
+
+/* 20 kg */
+static const int16_t _trace_20kg[TRACE_LEN] = {
+    2009, 2010, 2010, 2017, 2017, 2013, 2012, 2008, 2018, 2008, 2014, 2008,
+    2008, 2012, 2009, 2015, 2007, 2008, 2010, 2011, 2015, 2014, 2012, 2016,
+    2009, 2016, 2013, 2016, 2013, 2009, 2006, 2012, 2008, 2013, 2007, 2017,
+    2010, 2010, 2017, 2018, 2011, 2016, 2016, 2011, 2014, 2013, 2010, 2011,
+    2013, 2009, 2010, 2017, 2011, 2010, 2011, 2013, 2009, 2008, 2017, 2013,
+    2010, 2016, 2016, 2011,
+};
+
+/* 50 kg */
+static const int16_t _trace_50kg[TRACE_LEN] = {
+    3818, 3808, 3808, 3806, 3818, 3815, 3816, 3814, 3815, 3813, 3812, 3810,
+    3818, 3808, 3814, 3811, 3816, 3808, 3810, 3812, 3813, 3818, 3809, 3808,
+    3815, 3816, 3814, 3807, 3808, 3814, 3808, 3809, 3809, 3807, 3812, 3814,
+    3811, 3808, 3806, 3807, 3812, 3811, 3807, 3817, 3815, 3808, 3816, 3808,
+    3813, 3817, 3807, 3814, 3811, 3815, 3814, 3808, 3817, 3809, 3808, 3806,
+    3818, 3818, 3818, 3810,
+};
+
+#endif /* TRACES_H */
@@ -0,0 +1,159 @@
+/**
+ * @file
+ * @brief       Native test of the deadband of the stream
+ *
+ * A trace of the board left idle, then hung on, then idle again, is replayed
+ * through stream_push() at the full rate, the packets being sent as soon as
+ * they are staged. The traffic counters show what the deadband kept.
+ */
+
+#include <string.h>
+
+#include "embUnit.h"
+
+/* the modules under test, statics included */
+#include "pool.c"
+#include "stream.c"
+
+/* ----------------------  Defines --------------------- */
+#define PERIOD_US           (1000000UL / SENSOR_RATE_HZ)
+#define IDLE_FRAMES         (10U * SENSOR_RATE_HZ)  // 10 s on an empty board
+#define HANG_FRAMES         (5U * SENSOR_RATE_HZ)   // 5 s hang
+#define HANG_LOAD           (2000)  // 20 kg per hand [0.01 kg]
+#define NOISE               (2)     // Noise of the trace, below the deadband [0.01 kg]
+#define DEADBAND            (5U)    // [0.01 kg]
+
+/* ----------------------  Variables --------------------- */
+
+static uint32_t _now_us;
+static uint32_t _rng;
+static unsigned _sent;      // Frames in the packets sent
+
+/* ----------------------  Private  --------------------- */
+
+/* Frame of the trace: a load with noise, on every channel */
+static void _frame(int32_t *frame, int32_t load) {
+    for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+        _rng = _rng * 1103515245U + 12345U;
+        int32_t noise = (int32_t)((_rng >> 16) % (2 * NOISE + 1)) - NOISE;
+        frame[ch] = (load + noise) * (1L << CALIB_FRAC_BITS);
+    }
+}
+
+/* Push frames of a load, sending the packets like the NimBLE host thread */
+static void _replay(unsigned frames, int32_t load) {
+    int32_t frame[SENSOR_CHANNELS];
+
+    for (unsigned i = 0; i < frames; i++) {
+        _frame(frame, load);
+        stream_push(frame, _now_us);
+        _now_us += PERIOD_US;
+
+        const stream_pkt_t *pkt;
+        while ((pkt = stream_peek()) != NULL) {
+            _sent += ((const stream_hdr_t *)pkt->data)->count;
+            stream_pop(1);
+        }
+    }
+}
+
+static void _configure(uint8_t deadband) {
+    stream_cfg_t cfg = {
+        .format = STREAM_FMT_INT16,
+        .divider = 1,
+        .flags = STREAM_FLAG_TIMESTAMP,
+        .deadband = deadband,
+    };
+    stream_configure(&cfg);
+}
+
+/* A new subscriber, with the largest notifications */
+static void _setup(void) {
+    memset(&_stats, 0, sizeof(_stats));
+    memset(_ref, 0, sizeof(_ref));
+    _sent_us = 0;
+    _now_us = 1000000;
+    _rng = 1;
+    _sent = 0;
+    stream_set_payload(STREAM_PAYLOAD_MAX);
+    stream_reset();
+}
+
+/* ----------------------  Tests --------------------- */
+
+static void test_deadband_off(void) {
+    _configure(0);
+    _replay(IDLE_FRAMES, 0);
+    _replay(HANG_FRAMES, HANG_LOAD);
+    _replay(IDLE_FRAMES, 0);
+
+    /* everything is sent, except what is left of the last packet */
+    const stream_stats_t *stats = stream_stats();
+    TEST_ASSERT_EQUAL_INT(0, stats->suppressed);
+    TEST_ASSERT_EQUAL_INT(0, stats->heartbeats);
+    TEST_ASSERT_EQUAL_INT(0, stats->dropped);
+    TEST_ASSERT_EQUAL_INT(stats->frames, _sent);
+    TEST_ASSERT(2 * IDLE_FRAMES + HANG_FRAMES - _sent < 64);
+}
+
+static void test_deadband_idle_hang_idle(void) {
+    /* applied from the second frame on, with the first packet */
+    _configure(DEADBAND);
+    _replay(IDLE_FRAMES, 0);
+    _replay(HANG_FRAMES, HANG_LOAD);
+    _replay(IDLE_FRAMES, 0);
+
+    /* three changes (subscription, hang, release), each sent with the
+     * STREAM_QUIET_FRAMES that follow it. Then a heartbeat every
+     * STREAM_HEARTBEAT_MS (100 frames): 4 in each idle phase, 2 in the hang */
+    const unsigned changes = 3;
+    const unsigned heartbeats = 4 + 2 + 4;
+    const stream_stats_t *stats = stream_stats();
+    TEST_ASSERT_EQUAL_INT(heartbeats, stats->heartbeats);
+    TEST_ASSERT_EQUAL_INT(changes + heartbeats, stats->packets);
+    TEST_ASSERT_EQUAL_INT(changes * (STREAM_QUIET_FRAMES + 1) + heartbeats, stats->frames);
+    TEST_ASSERT_EQUAL_INT(2 * IDLE_FRAMES + HANG_FRAMES - stats->frames, stats->suppressed);
+    TEST_ASSERT_EQUAL_INT(stats->frames, _sent);
+    TEST_ASSERT_EQUAL_INT(0, stats->dropped);
+
+    /* the stream is stopped, nothing waits in a packet */
+    TEST_ASSERT_EQUAL_INT(0, _count);
+    TEST_ASSERT_EQUAL_INT(0, _active);
+}
+
+static void test_deadband_restart(void) {
+    _configure(DEADBAND);
+    _replay(IDLE_FRAMES, 0);
+    unsigned packets = stream_stats()->packets;
+
+    /* a change beyond the deadband goes out with the next frame */
+    _replay(1, DEADBAND + NOISE + 1);
+    TEST_ASSERT_EQUAL_INT(1, _active);
+    TEST_ASSERT_EQUAL_INT(1, _count);
+    _replay(STREAM_QUIET_FRAMES, DEADBAND + NOISE + 1);
+    TEST_ASSERT_EQUAL_INT(packets + 1, stream_stats()->packets);
+    TEST_ASSERT_EQUAL_INT(0, _active);
+}
+
+static Test *tests_deadband(void) {
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_deadband_off),
+        new_TestFixture(test_deadband_idle_hang_idle),
+        new_TestFixture(test_deadband_restart),
+    };
+
+    EMB_UNIT_TESTCALLER(deadband_tests, _setup, NULL, fixtures);
+    return (Test *)&deadband_tests;
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(void) {
+    stream_init();
+
+    TESTS_START();
+    TESTS_RUN(tests_deadband());
+    TESTS_END();
+
+    return 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file
+ * @brief       Native test of the fixed block pools and of the stream staging
+ *
+ * Every pool is exhausted, then given a block back: the allocation fails
+ * without harm while it is empty, the refusals are counted, and it works
+ * again after the free. The connection states come back only once the
+ * sampling queue ran the free, and a refused connection takes no hold on the
+ * full rate.
+ */
+
+#include <string.h>
+
+#include "embUnit.h"
+#include "event.h"
+
+/* the modules under test, statics included */
+#include "conn.c"
+#include "pool.c"
+#include "stream.c"
+
+/* ----------------------  Defines --------------------- */
+#define BLOCKS              (3U)
+#define FRAMES_PER_PACKET   (2U)    // INT16, 2 channels, 20 byte notifications
+#define PERIOD_US           (1000000UL / SENSOR_RATE_HZ)
+
+/* ----------------------  Variables --------------------- */
+
+POOL_DEFINE(_test_pool, "test", 12, BLOCKS);
+static uint8_t *_blocks[BLOCKS];   // Taken from _test_pool by the test
+
+static uint32_t _now_us;
+
+// Sampling queue of the connection frees, run by hand
+static event_queue_t _sampling_eq;
+
+// Holds on the full rate, taken by conn.c
+static uint8_t _holds;
+static unsigned _releases;
+
+/* ----------------------  Private  --------------------- */
+
+/* The power states, only the holds matter here */
+void power_hold(power_hold_t reason) {
+    _holds |= reason;
+}
+
+void power_release(power_hold_t reason) {
+    _holds &= ~reason;
+    _releases++;
+}
+
+static void _run(event_queue_t *eq) {
+    event_t *ev;
+    while ((ev = event_get(eq)) != NULL) {
+        ev->handler(ev);
+    }
+}
+
+static int _push(void) {
+    int32_t frame[SENSOR_CHANNELS] = { 0 };
+
+    _now_us += PERIOD_US;
+    return stream_push(frame, _now_us);
+}
+
+/* A new subscriber with the default MTU, nothing sent yet */
+static void _setup(void) {
+    _test_pool.high_water = 0;
+    _test_pool.failures = 0;
+
+    stream_cfg_t cfg = { .format = STREAM_FMT_INT16, .divider = 1 };
+    stream_configure(&cfg);
+    stream_set_payload(STREAM_PAYLOAD_MIN);
+    stream_reset();
+    memset(&_stats, 0, sizeof(_stats));
+    _pkt_pool.failures = 0;
+    _seq = 0;
+    _now_us = 0;
+
+    _conn_pool.high_water = 0;
+    _conn_pool.failures = 0;
+    _holds = 0;
+    _releases = 0;
+}
+
+static void _teardown(void) {
+    for (unsigned i = 0; i < BLOCKS; i++) {
+        pool_free(&_test_pool, _blocks[i]);
+        _blocks[i] = NULL;
+    }
+    if (conn_active()) {
+        conn_close(conn_current()->handle);
+    }
+    _run(&_sampling_eq);
+}
+
+/* ----------------------  Tests --------------------- */
+
+static void test_pool_exhausted(void) {
+    for (unsigned i = 0; i < BLOCKS; i++) {
+        _blocks[i] = pool_alloc(&_test_pool);
+        TEST_ASSERT_NOT_NULL(_blocks[i]);
+    }
+    TEST_ASSERT_NULL(pool_alloc(&_test_pool));
+    TEST_ASSERT_NULL(pool_alloc(&_test_pool));
+    TEST_ASSERT_EQUAL_INT(2, _test_pool.failures);
+    TEST_ASSERT_EQUAL_INT(BLOCKS, _test_pool.used);
+    TEST_ASSERT_EQUAL_INT(BLOCKS, _test_pool.high_water);
+
+    /* the block given back is the next one out */
+    pool_free(&_test_pool, _blocks[1]);
+    TEST_ASSERT_EQUAL_INT(BLOCKS - 1, _test_pool.used);
+    TEST_ASSERT(pool_alloc(&_test_pool) == _blocks[1]);
+    TEST_ASSERT_NULL(pool_alloc(&_test_pool));
+    TEST_ASSERT_EQUAL_INT(3, _test_pool.failures);
+}
+
+static void test_pool_blocks(void) {
+    /* distinct, aligned blocks, all usable at once */
+    for (unsigned i = 0; i < BLOCKS; i++) {
+        _blocks[i] = pool_alloc(&_test_pool);
+        TEST_ASSERT_NOT_NULL(_blocks[i]);
+        TEST_ASSERT_EQUAL_INT(0, (uintptr_t)_blocks[i] % sizeof(void *));
+        memset(_blocks[i], i, 12);
+    }
+    for (unsigned i = 0; i < BLOCKS; i++) {
+        TEST_ASSERT_EQUAL_INT(i, _blocks[i][11]);
+    }
+    pool_free(&_test_pool, NULL);
+    TEST_ASSERT_EQUAL_INT(BLOCKS, _test_pool.used);
+}
+
+static void test_pool_stream_staging(void) {
+    /* nothing sent: every block of the pool ends up staged */
+    for (unsigned i = 0; i < MEM_TX_PACKETS * FRAMES_PER_PACKET; i++) {
+        _push();
+    }
+    TEST_ASSERT_EQUAL_INT(MEM_TX_PACKETS, stream_stats()->packets);
+    TEST_ASSERT_EQUAL_INT(MEM_TX_PACKETS, _pkt_pool.used);
+    TEST_ASSERT_EQUAL_INT(0, stream_stats()->dropped);
+
+    /* no block to start a packet: the frames are dropped and counted */
+    TEST_ASSERT_EQUAL_INT(0, _push());
+    TEST_ASSERT_EQUAL_INT(0, _push());
+    TEST_ASSERT_EQUAL_INT(2, stream_stats()->dropped);
+    TEST_ASSERT_EQUAL_INT(2, _pkt_pool.failures);
+
+    /* one packet sent, the next one fits again */
+    const stream_pkt_t *oldest = stream_peek();
+    TEST_ASSERT_EQUAL_INT(0, ((const stream_hdr_t *)oldest->data)->seq);
+    stream_pop(1);
+    TEST_ASSERT_EQUAL_INT(0, _push());
+    TEST_ASSERT_EQUAL_INT(1, _push());
+    TEST_ASSERT_EQUAL_INT(2, stream_stats()->dropped);
+    TEST_ASSERT_EQUAL_INT(MEM_TX_PACKETS + 1, stream_stats()->packets);
+
+    /* the packets keep their order, the last one after the gap */
+    for (unsigned seq = 1; seq <= MEM_TX_PACKETS; seq++) {
+        const stream_pkt_t *pkt = stream_peek();
+        TEST_ASSERT_NOT_NULL(pkt);
+        TEST_ASSERT_EQUAL_INT(seq, ((const stream_hdr_t *)pkt->data)->seq);
+        stream_pop(1);
+    }
+    TEST_ASSERT_NULL(stream_peek());
+    TEST_ASSERT_EQUAL_INT(0, _pkt_pool.used);
+}
+
+static void test_pool_conn_refused(void) {
+    /* the only state goes to the first connection */
+    conn_t *conn = conn_open(1);
+    TEST_ASSERT_NOT_NULL(conn);
+    TEST_ASSERT(conn_current() == conn);
+    TEST_ASSERT_EQUAL_INT(POWER_HOLD_CONNECTED, _holds);
+    TEST_ASSERT_EQUAL_INT(MEM_CONN_NUMOF, _conn_pool.used);
+
+    /* the second one finds none and is refused */
+    TEST_ASSERT_NULL(conn_open(2));
+    TEST_ASSERT_EQUAL_INT(1, _conn_pool.failures);
+    TEST_ASSERT(conn_current() == conn);
+    TEST_ASSERT_NULL(conn_find(2));
+
+    /* its disconnection leaves the served one alone, full rate held */
+    TEST_ASSERT_EQUAL_INT(0, conn_close(2));
+    TEST_ASSERT_EQUAL_INT(0, _releases);
+    TEST_ASSERT_EQUAL_INT(POWER_HOLD_CONNECTED, _holds);
+    TEST_ASSERT(conn_find(1) == conn);
+    TEST_ASSERT_NULL(event_get(&_sampling_eq));
+}
+
+static void test_pool_conn_deferred_free(void) {
+    conn_t *conn = conn_open(1);
+    TEST_ASSERT_NOT_NULL(conn);
+    conn->stream_enabled = 1;
+
+    /* closed: the sampling sees no subscription right away */
+    TEST_ASSERT_EQUAL_INT(1, conn_close(1));
+    TEST_ASSERT_EQUAL_INT(1, _releases);
+    TEST_ASSERT_EQUAL_INT(0, _holds);
+    TEST_ASSERT(!conn_active());
+    TEST_ASSERT_EQUAL_INT(0, conn_current()->stream_enabled);
+    TEST_ASSERT_NULL(conn_find(1));
+
+    /* the block stays taken until the sampling queue frees it */
+    TEST_ASSERT_EQUAL_INT(MEM_CONN_NUMOF, _conn_pool.used);
+    TEST_ASSERT_NULL(conn_open(2));
+    TEST_ASSERT_EQUAL_INT(1, _conn_pool.failures);
+    _run(&_sampling_eq);
+    TEST_ASSERT_EQUAL_INT(0, _conn_pool.used);
+
+    /* and then serves the next connection, with no subscription */
+    conn = conn_open(2);
+    TEST_ASSERT_NOT_NULL(conn);
+    TEST_ASSERT_EQUAL_INT(2, conn->handle);
+    TEST_ASSERT_EQUAL_INT(0, conn->stream_enabled);
+    TEST_ASSERT_EQUAL_INT(POWER_HOLD_CONNECTED, _holds);
+}
+
+static Test *tests_pool(void) {
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_pool_exhausted),
+        new_TestFixture(test_pool_blocks),
+        new_TestFixture(test_pool_stream_staging),
+        new_TestFixture(test_pool_conn_refused),
+        new_TestFixture(test_pool_conn_deferred_free),
+    };
+
+    EMB_UNIT_TESTCALLER(pool_tests, _setup, _teardown, fixtures);
+    return (Test *)&pool_tests;
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(void) {
+    event_queue_init(&_sampling_eq);
+    pool_init(&_test_pool);
+    conn_init(&_sampling_eq);
+    stream_init();
+
+    TESTS_START();
+    TESTS_RUN(tests_pool());
+    TESTS_END();
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * @file
+ * @brief       Native test of the power states of the acquisition
+ *
+ * The blocks of the sensor are replayed through power_block(), timed like
+ * the backend: blocks of SENSOR_BLOCK_FRAMES at the full rate, single frames
+ * at the idle rate, and a rate change restarts the sampling one period of
+ * the new rate after the last frame. The counters of each state, and the
+ * rate asked of the sensor, follow idle, load and connected sequences.
+ */
+
+#include <string.h>
+
+#include "embUnit.h"
+
+/* the module under test, statics included */
+#include "power.c"
+
+/* ----------------------  Defines --------------------- */
+#define BLOCK_US            (SENSOR_BLOCK_FRAMES * SENSOR_PERIOD_US)
+#define IDLE_BLOCKS         (POWER_IDLE_MS * 1000UL / BLOCK_US + 1)  // Full rate, until idle
+#define IDLE_FRAMES         (10U)
+#define HANG_BLOCKS         (50U)   // 5 s hang
+#define HANG_LOAD           (2000)  // 20 kg per hand [0.01 kg]
+
+/* ----------------------  Variables --------------------- */
+
+static sensor_rate_t _rate;
+static unsigned _switches;      // Rate changes asked by power.c
+static uint32_t _now_us;        // First frame of the next block
+static uint32_t _last_frame_us; // Last frame of the block being processed
+
+/* ----------------------  Private  --------------------- */
+
+static uint32_t _period_us(sensor_rate_t rate) {
+    return (rate == SENSOR_RATE_FULL) ? SENSOR_PERIOD_US : SENSOR_IDLE_PERIOD_US;
+}
+
+/* The sensor backend, only its timing */
+void sensor_set_rate(sensor_rate_t rate) {
+    _rate = rate;
+    _switches++;
+    _now_us = _last_frame_us + _period_us(rate);
+}
+
+/* Process blocks with a load, like the sampling thread */
+static void _blocks(unsigned numof, int32_t load) {
+    for (unsigned i = 0; i < numof; i++) {
+        unsigned frames = (_rate == SENSOR_RATE_FULL) ? SENSOR_BLOCK_FRAMES : 1;
+        uint32_t t_us = _now_us;
+        _last_frame_us = t_us + (frames - 1) * _period_us(_rate);
+        _now_us = _last_frame_us + _period_us(_rate);
+        power_block(load, t_us);
+    }
+}
+
+/* Booted, sampling at the full rate, nothing held */
+static void _setup(void) {
+    memset(_stats, 0, sizeof(_stats));
+    _holds = 0;
+    _rate = SENSOR_RATE_FULL;
+    _switches = 0;
+    _now_us = 1000000;
+    power_init();
+}
+
+/* ----------------------  Tests --------------------- */
+
+static void test_power_idle(void) {
+    /* the idle rate after POWER_IDLE_MS without load, not a block earlier */
+    _blocks(IDLE_BLOCKS - 1, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_ACTIVE, power_state());
+    _blocks(1, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_IDLE, power_state());
+    TEST_ASSERT_EQUAL_INT(SENSOR_RATE_IDLE, _rate);
+    TEST_ASSERT_EQUAL_INT(1, _switches);
+
+    const power_stats_t *active = power_stats(POWER_ACTIVE);
+    TEST_ASSERT_EQUAL_INT(1, active->entries);
+    TEST_ASSERT_EQUAL_INT(IDLE_BLOCKS, active->wakeups);
+    TEST_ASSERT_EQUAL_INT(POWER_IDLE_MS * 1000UL, active->time_us);
+
+    /* one wakeup per idle frame. The time from the last full rate block on
+     * is idle: its last frames, then one idle period per frame */
+    _blocks(IDLE_FRAMES, 0);
+    const power_stats_t *idle = power_stats(POWER_IDLE);
+    TEST_ASSERT_EQUAL_INT(1, idle->entries);
+    TEST_ASSERT_EQUAL_INT(IDLE_FRAMES, idle->wakeups);
+    TEST_ASSERT_EQUAL_INT((SENSOR_BLOCK_FRAMES - 1) * SENSOR_PERIOD_US +
+                          IDLE_FRAMES * SENSOR_IDLE_PERIOD_US, idle->time_us);
+    TEST_ASSERT_EQUAL_INT(IDLE_BLOCKS, active->wakeups);
+    TEST_ASSERT_EQUAL_INT(1, _switches);
+}
+
+static void test_power_wake(void) {
+    _blocks(IDLE_BLOCKS + IDLE_FRAMES, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_IDLE, power_state());
+
+    /* the first idle frame with load brings the full rate back, the next
+     * frame follows within one full rate period */
+    uint32_t loaded_us = _now_us;
+    _blocks(1, HANG_LOAD);
+    TEST_ASSERT_EQUAL_INT(POWER_ACTIVE, power_state());
+    TEST_ASSERT_EQUAL_INT(SENSOR_RATE_FULL, _rate);
+    TEST_ASSERT(_now_us - loaded_us <= SENSOR_PERIOD_US);
+
+    const power_stats_t *active = power_stats(POWER_ACTIVE);
+    const power_stats_t *idle = power_stats(POWER_IDLE);
+    TEST_ASSERT_EQUAL_INT(2, active->entries);
+    TEST_ASSERT_EQUAL_INT(IDLE_FRAMES + 1, idle->wakeups);
+
+    /* held by the load, then POWER_IDLE_MS from its last block */
+    _blocks(HANG_BLOCKS, HANG_LOAD);
+    _blocks(IDLE_BLOCKS - 2, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_ACTIVE, power_state());
+    _blocks(1, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_IDLE, power_state());
+    TEST_ASSERT_EQUAL_INT(2, idle->entries);
+    TEST_ASSERT_EQUAL_INT(2 * IDLE_BLOCKS + HANG_BLOCKS - 1, active->wakeups);
+    TEST_ASSERT_EQUAL_INT(3, _switches);
+}
+
+static void test_power_hold(void) {
+    /* connected: no idle rate, however long the board stays empty */
+    power_hold(POWER_HOLD_CONNECTED);
+    _blocks(2 * IDLE_BLOCKS, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_ACTIVE, power_state());
+
+    /* the holds add up: a workout keeps the full rate after the disconnection */
+    power_hold(POWER_HOLD_WORKOUT);
+    power_release(POWER_HOLD_CONNECTED);
+    _blocks(IDLE_BLOCKS, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_ACTIVE, power_state());
+    TEST_ASSERT_EQUAL_INT(0, _switches);
+
+    /* released: POWER_IDLE_MS from the last held block */
+    power_release(POWER_HOLD_WORKOUT);
+    _blocks(IDLE_BLOCKS - 2, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_ACTIVE, power_state());
+    _blocks(1, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_IDLE, power_state());
+
+    const power_stats_t *active = power_stats(POWER_ACTIVE);
+    TEST_ASSERT_EQUAL_INT(1, active->entries);
+    TEST_ASSERT_EQUAL_INT(4 * IDLE_BLOCKS - 1, active->wakeups);
+    TEST_ASSERT_EQUAL_INT((4 * IDLE_BLOCKS - 2) * BLOCK_US, active->time_us);
+
+    /* a connection from the idle rate: full rate with the next frame */
+    _blocks(IDLE_FRAMES, 0);
+    power_hold(POWER_HOLD_CONNECTED);
+    _blocks(1, 0);
+    TEST_ASSERT_EQUAL_INT(POWER_ACTIVE, power_state());
+    TEST_ASSERT_EQUAL_INT(2, active->entries);
+    TEST_ASSERT_EQUAL_INT(IDLE_FRAMES + 1, power_stats(POWER_IDLE)->wakeups);
+    TEST_ASSERT_EQUAL_INT(2, _switches);
+}
+
+static Test *tests_power(void) {
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_power_idle),
+        new_TestFixture(test_power_wake),
+        new_TestFixture(test_power_hold),
+    };
+
+    EMB_UNIT_TESTCALLER(power_tests, _setup, NULL, fixtures);
+    return (Test *)&power_tests;
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(void) {
+    TESTS_START();
+    TESTS_RUN(tests_power());
+    TESTS_END();
+
+    return 0;
+}
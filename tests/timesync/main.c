@@ -0,0 +1,161 @@
+/**
+ * @file
+ * @brief       Native test of the time-sync estimator
+ *
+ * A client clock with a known offset and drift writes its time once per
+ * second, received late by a random link latency. The estimate read back
+ * must map the device time onto the client clock within the shortest
+ * latency, also across a wrap of the 32-bit device time.
+ */
+
+#include <stdint.h>
+
+#include "embUnit.h"
+
+/* the module under test, statics included */
+#include "timesync.c"
+
+/* ----------------------  Defines --------------------- */
+#define WRITE_US            (1000000LL)         // Client write period
+#define LATENCY_US          (7500)              // Shortest latency, one connection interval
+#define LATENCY_SPAN_US     (2500)              // Random part of the latency
+#define CLIENT_START_US     (1700000000000000LL)
+#define WRAP_US             (1LL << 32)
+#define TOLERANCE_US        (LATENCY_US + LATENCY_SPAN_US)
+
+/* ----------------------  Variables --------------------- */
+
+static uint32_t _rng;
+
+/* ----------------------  Private  --------------------- */
+
+/* Client time of the device time t (unwrapped), with a drift in ppb */
+static int64_t _client_us(int64_t t, int32_t drift_ppb) {
+    return CLIENT_START_US + t + t * drift_ppb / 1000000000;
+}
+
+/* The client writes at device time t, received after the link latency */
+static void _write(int64_t t, int32_t drift_ppb) {
+    _rng = _rng * 1103515245U + 12345U;
+    int64_t latency = LATENCY_US + (_rng >> 16) % LATENCY_SPAN_US;
+    timesync_update(_client_us(t, drift_ppb), (uint32_t)(t + latency));
+}
+
+/* Mapping of the client, as in timesync.h */
+static int64_t _map(const timesync_t *ts, uint32_t t) {
+    int32_t dt = (int32_t)(t - ts->ref_us);
+    return (int64_t)ts->ref_us + ts->offset_us + dt + (int64_t)dt * ts->drift_ppb / 1000000000;
+}
+
+/* Error of the mapping of device time t (unwrapped), estimate just read */
+static int64_t _error(int64_t t, int32_t drift_ppb) {
+    timesync_t ts;
+    timesync_get(&ts);
+    return _map(&ts, (uint32_t)t) - _client_us(t, drift_ppb);
+}
+
+static int _within(int64_t error) {
+    /* late by the latency, never early */
+    return error <= 0 && error >= -TOLERANCE_US;
+}
+
+/* Writes from device time start on, returns the time after the last one */
+static int64_t _run(int64_t start, unsigned writes, int32_t drift_ppb) {
+    for (unsigned i = 0; i < writes; i++) {
+        _write(start + i * WRITE_US, drift_ppb);
+    }
+    return start + writes * WRITE_US;
+}
+
+static void _setup(void) {
+    timesync_reset();
+    _rng = 1;
+}
+
+/* ----------------------  Tests --------------------- */
+
+static void test_timesync_first_window(void) {
+    _run(1000000, 1, 0);
+
+    timesync_t ts;
+    timesync_get(&ts);
+    TEST_ASSERT_EQUAL_INT(1, ts.count);
+    TEST_ASSERT_EQUAL_INT(0, ts.drift_ppb);
+    TEST_ASSERT(_within(_error(2000000, 0)));
+}
+
+static void test_timesync_drift(void) {
+    int64_t t = _run(1000000, TIMESYNC_WINDOW * TIMESYNC_POINTS, 20000);
+
+    timesync_t ts;
+    timesync_get(&ts);
+    TEST_ASSERT(ts.drift_ppb > 15000 && ts.drift_ppb < 25000);
+    TEST_ASSERT(_within(_error(t, 20000)));
+    /* a minute later, the drift is followed */
+    TEST_ASSERT(_within(_error(t + 60 * WRITE_US, 20000)));
+}
+
+static void test_timesync_wrap(void) {
+    /* the windows in the fit straddle the wrap for a while */
+    int64_t t = WRAP_US - TIMESYNC_WINDOW * TIMESYNC_POINTS * WRITE_US / 2;
+    t = _run(t, TIMESYNC_WINDOW * TIMESYNC_POINTS / 2, 20000);
+
+    for (unsigned i = 0; i < TIMESYNC_POINTS; i++) {
+        t = _run(t, TIMESYNC_WINDOW, 20000);
+
+        timesync_t ts;
+        timesync_get(&ts);
+        TEST_ASSERT(ts.drift_ppb > 15000 && ts.drift_ppb < 25000);
+        TEST_ASSERT(_within(_error(t, 20000)));
+    }
+    TEST_ASSERT(t > WRAP_US);
+}
+
+static void test_timesync_drift_clamp(void) {
+    /* 2000 ppm, no crystal is that far off */
+    int64_t t = _run(1000000, TIMESYNC_WINDOW * TIMESYNC_POINTS, 2000000);
+
+    timesync_t ts;
+    timesync_get(&ts);
+    TEST_ASSERT_EQUAL_INT(TIMESYNC_DRIFT_MAX, ts.drift_ppb);
+
+    timesync_reset();
+    _run(t, TIMESYNC_WINDOW * TIMESYNC_POINTS, -2000000);
+    timesync_get(&ts);
+    TEST_ASSERT_EQUAL_INT(-TIMESYNC_DRIFT_MAX, ts.drift_ppb);
+}
+
+static void test_timesync_reset(void) {
+    _run(WRAP_US - 10 * WRITE_US, 20, 0);
+    timesync_reset();
+
+    /* a new client, the wraps of the previous one are forgotten */
+    timesync_t ts;
+    timesync_get(&ts);
+    TEST_ASSERT_EQUAL_INT(0, ts.count);
+    _run(1000000, 1, 0);
+    TEST_ASSERT(_within(_error(2000000, 0)));
+}
+
+static Test *tests_timesync(void) {
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_timesync_first_window),
+        new_TestFixture(test_timesync_drift),
+        new_TestFixture(test_timesync_wrap),
+        new_TestFixture(test_timesync_drift_clamp),
+        new_TestFixture(test_timesync_reset),
+    };
+
+    EMB_UNIT_TESTCALLER(timesync_tests, _setup, NULL, fixtures);
+    return (Test *)&timesync_tests;
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(void) {
+    TESTS_START();
+    TESTS_RUN(tests_timesync());
+    TESTS_END();
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file
+ * @brief       Native test of the sample timing under housekeeping load
+ *
+ * The threads and queues of the firmware, from tasks.c: the simulated load
+ * cells hand their blocks over to the sampling queue, run by the main thread,
+ * while every block tares the scale. Each tare saves the calibration table
+ * from the housekeeping thread, a page erase as long as the one of the board
+ * (STORAGE_ERASE_US) included. The blocks must keep their period and be
+ * handled within a frame period of their last frame, as if the housekeeping
+ * thread weren't there.
+ */
+
+#include <stdio.h>
+
+#include "embUnit.h"
+#include "event.h"
+#include "ztimer.h"
+
+/* the modules under test, statics included */
+#include "calib.c"
+#include "sensor_sim.c"
+#include "storage.c"
+#include "tasks.c"
+
+/* ----------------------  Defines --------------------- */
+#define BLOCKS              (30U)   // 3 s at the full rate
+#define BLOCK_PERIOD_US     (SENSOR_BLOCK_FRAMES * SENSOR_PERIOD_US)
+#define JITTER_US           (SENSOR_PERIOD_US / 4)  // Tolerance on the block period
+#define DELAY_MAX_US        (SENSOR_PERIOD_US)  // Last frame to its handler
+
+/* ----------------------  Variables --------------------- */
+
+// Measurements, per block
+static uint32_t _t_us[BLOCKS];
+static uint32_t _delay_us[BLOCKS];
+static unsigned _numof;
+static unsigned _tares;
+
+/* ----------------------  Private  --------------------- */
+
+/* In the sampling thread, like the block handler of the firmware */
+static void _process_block(const int16_t *block, unsigned frames, uint32_t t_us) {
+    uint32_t now_us = ztimer_now(ZTIMER_USEC);
+
+    for (unsigned i = 0; i < frames; i++) {
+        for (unsigned ch = 0; ch < SENSOR_CHANNELS; ch++) {
+            calib_apply(ch, block[i * SENSOR_FRAME_LEN + ch]);
+        }
+    }
+    if (_numof < BLOCKS) {
+        _t_us[_numof] = t_us;
+        _delay_us[_numof] = now_us - (t_us + (frames - 1) * SENSOR_PERIOD_US);
+        _numof++;
+    }
+
+    /* handled by the next event of the queue, saved by the housekeeping thread */
+    if (calib_command(CALIB_OP_TARE, 0) == 0) {
+        _tares++;
+    }
+}
+
+/* ----------------------  Tests --------------------- */
+
+static void test_timing_under_load(void) {
+    sensor_start();
+    while (_numof < BLOCKS) {
+        event_t *ev = event_wait(tasks_eq());
+        ev->handler(ev);
+    }
+    sensor_stop();
+
+    /* every block queued a save, each longer than most of a block period */
+    TEST_ASSERT_EQUAL_INT(BLOCKS, _tares);
+    TEST_ASSERT_EQUAL_INT(0, tasks_lost());
+
+    uint32_t jitter_max = 0, delay_max = 0;
+    for (unsigned i = 0; i < BLOCKS; i++) {
+        if (i > 0) {
+            int32_t jitter = (int32_t)(_t_us[i] - _t_us[i - 1] - BLOCK_PERIOD_US);
+            uint32_t abs_jitter = (jitter < 0) ? -jitter : jitter;
+            jitter_max = (abs_jitter > jitter_max) ? abs_jitter : jitter_max;
+        }
+        delay_max = (_delay_us[i] > delay_max) ? _delay_us[i] : delay_max;
+    }
+    printf("%u tares, block period jitter %lu us, delay %lu us at most\n", _tares,
+           (unsigned long)jitter_max, (unsigned long)delay_max);
+    TEST_ASSERT(jitter_max <= JITTER_US);
+    TEST_ASSERT(delay_max <= DELAY_MAX_US);
+
+    /* the saves did reach the flash */
+    calib_table_t tables[SENSOR_CHANNELS];
+    TEST_ASSERT_EQUAL_INT(0, storage_load(STORAGE_SLOT_CALIB, tables, sizeof(tables)));
+    TEST_ASSERT(tables[0].tared);
+}
+
+static Test *tests_timing(void) {
+    EMB_UNIT_TESTFIXTURES(fixtures) {
+        new_TestFixture(test_timing_under_load),
+    };
+
+    EMB_UNIT_TESTCALLER(timing_tests, NULL, NULL, fixtures);
+    return (Test *)&timing_tests;
+}
+
+/* ----------------------  Main  --------------------- */
+
+int main(void) {
+    /* the startup of the firmware, without the radio */
+    tasks_init(_process_block);
+    calib_init(tasks_eq(), tasks_io_eq());
+    sensor_init(tasks_sensor_block, NULL);
+    tasks_start();
+
+    TESTS_START();
+    TESTS_RUN(tests_timing());
+    TESTS_END();
+
+    return 0;
+}
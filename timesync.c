@@ -0,0 +1,137 @@
+/**
+ * @file
+ * @brief       Mapping of the device clock to the client clock
+ *
+ * The samples are grouped in windows of TIMESYNC_WINDOW writes. Latency only
+ * ever makes a sample late (lower offset), so the highest offset of a window
+ * is the one with the least latency. A line fitted through the best samples
+ * of the last TIMESYNC_POINTS windows gives the offset and the drift.
+ *
+ * The device time wraps every 71 min: it is unwrapped to 64 bits so the
+ * windows on both sides of a wrap stay on the same line, and only the
+ * estimate read back is relative to the 32-bit time.
+ */
+
+#include <string.h>
+
+#include "timesync.h"
+
+/* ----------------------  Defines --------------------- */
+#ifndef TIMESYNC_WINDOW
+#define TIMESYNC_WINDOW         (8U)        // Writes per window
+#endif
+#ifndef TIMESYNC_POINTS
+#define TIMESYNC_POINTS         (16U)       // Windows in the fit
+#endif
+#define TIMESYNC_DRIFT_MAX      (500000L)   // 500 ppm, well beyond any crystal
+
+typedef struct {
+    uint64_t device_us;     // Unwrapped device time
+    int64_t offset_us;      // Client time - unwrapped device time
+} timesync_point_t;
+
+/* ----------------------  Variables --------------------- */
+
+static timesync_t _ts;
+
+static timesync_point_t _points[TIMESYNC_POINTS];  // Best sample of the last windows
+static unsigned _points_numof;
+static unsigned _points_next;
+
+static timesync_point_t _best;      // Best sample of the window in progress
+static unsigned _window_cnt;
+
+static uint64_t _epoch_us;          // Wraps of the device time so far, times 2^32
+static uint32_t _last_us;           // Device time of the last sample
+
+/* ----------------------  Private  --------------------- */
+
+/* Publish the offset at an unwrapped device time, relative to its 32-bit value */
+static void _publish(uint64_t device_us, int64_t offset_us) {
+    _ts.ref_us = (uint32_t)device_us;
+    _ts.offset_us = offset_us + (int64_t)(device_us - _ts.ref_us);
+}
+
+static void _fit(void) {
+    const timesync_point_t *ref = &_points[(_points_next + TIMESYNC_POINTS - 1) % TIMESYNC_POINTS];
+
+    /* least squares, relative to the newest point so single precision is enough:
+     * x in seconds, y in us, the slope is in ppm */
+    float mx = 0, my = 0;
+    for (unsigned i = 0; i < _points_numof; i++) {
+        mx += (float)(int64_t)(_points[i].device_us - ref->device_us) / 1e6f;
+        my += (float)(_points[i].offset_us - ref->offset_us);
+    }
+    mx /= _points_numof;
+    my /= _points_numof;
+
+    float sxx = 0, sxy = 0;
+    for (unsigned i = 0; i < _points_numof; i++) {
+        float dx = (float)(int64_t)(_points[i].device_us - ref->device_us) / 1e6f - mx;
+        float dy = (float)(_points[i].offset_us - ref->offset_us) - my;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+
+    float slope = (sxx > 0) ? sxy / sxx : 0;
+    float drift = slope * 1000;
+    if (drift > TIMESYNC_DRIFT_MAX) {
+        drift = TIMESYNC_DRIFT_MAX;
+    }
+    else if (drift < -TIMESYNC_DRIFT_MAX) {
+        drift = -TIMESYNC_DRIFT_MAX;
+    }
+
+    _publish(ref->device_us, ref->offset_us + (int64_t)(my - slope * mx));
+    _ts.drift_ppb = (int32_t)drift;
+}
+
+/* ----------------------  Public  --------------------- */
+
+void timesync_reset(void) {
+    memset(&_ts, 0, sizeof(_ts));
+    _points_numof = 0;
+    _points_next = 0;
+    _window_cnt = 0;
+    _epoch_us = 0;
+    _last_us = 0;
+}
+
+void timesync_update(int64_t client_us, uint32_t device_us) {
+    /* the writes come every few seconds, going backwards is a wrap */
+    if (_ts.count > 0 && device_us < _last_us) {
+        _epoch_us += 1ULL << 32;
+    }
+    _last_us = device_us;
+    uint64_t unwrapped_us = _epoch_us + device_us;
+    int64_t offset_us = client_us - (int64_t)unwrapped_us;
+
+    /* the drift within a window is negligible, compare the offsets directly */
+    if (_window_cnt == 0 || offset_us > _best.offset_us) {
+        _best.device_us = unwrapped_us;
+        _best.offset_us = offset_us;
+    }
+    if (_ts.count < UINT16_MAX) {
+        _ts.count++;
+    }
+
+    if (++_window_cnt < TIMESYNC_WINDOW) {
+        /* first window: the best sample so far, no drift yet */
+        if (_points_numof == 0) {
+            _publish(_best.device_us, _best.offset_us);
+        }
+        return;
+    }
+
+    _window_cnt = 0;
+    _points[_points_next] = _best;
+    _points_next = (_points_next + 1) % TIMESYNC_POINTS;
+    if (_points_numof < TIMESYNC_POINTS) {
+        _points_numof++;
+    }
+    _fit();
+}
+
+void timesync_get(timesync_t *ts) {
+    *ts = _ts;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief       Mapping of the device clock to the client clock
+ *
+ * The stream timestamps are device microseconds (ZTIMER_USEC). To put them on
+ * its own time line, the client writes its clock to the time-sync
+ * characteristic every few seconds. Every write gives one offset sample,
+ * client time - device time, seen late by the BLE latency (one connection
+ * interval or more).
+ *
+ * The estimator follows the offset and the drift between both clocks from
+ * the samples with the lowest latency, so the offset stays late by about the
+ * shortest latency of the link. With one write per second, the drift settles
+ * within a few minutes.
+ *
+ * The client maps a device time t with the estimate read back:
+ *   client_us = t + offset_us + (t - ref_us) * drift_ppb / 1e9
+ * with t - ref_us computed modulo 2^32, the device time wraps every 71 min.
+ */
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdint.h>
+
+/* Estimate, as read from the time-sync characteristic (little endian) */
+typedef struct __attribute__((packed)) {
+    uint32_t ref_us;        // Device time of the estimate
+    int64_t offset_us;      // Client time - device time, at ref_us
+    int32_t drift_ppb;      // Client clock rate - device clock rate [1e-9]
+    uint16_t count;         // Writes since the connection
+} timesync_t;
+
+/* ----------------------  Prototypes --------------------- */
+
+/* Forget the estimate, e.g. for a new client */
+void timesync_reset(void);
+
+/* Add a sample: the client clock client_us, received at device time device_us.
+ * Only call from the NimBLE host thread */
+void timesync_update(int64_t client_us, uint32_t device_us);
+
+/* Current estimate */
+void timesync_get(timesync_t *ts);
+
+#endif /* TIMESYNC_H */
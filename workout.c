@@ -0,0 +1,263 @@
+/**
+ * @file
+ * @brief       Interval workouts (repeaters) timed on the board
+ *
+ * Commands come from the NimBLE host thread and the shell. Like the stream
+ * configuration, they are only copied under irq_disable() and picked up by the
+ * next frame, so the engine only runs in the sampling event queue.
+ *
+ * The phase ends are kept on the ideal schedule, the end of a phase is the
+ * start of the next one: rounding to the frames doesn't add up over a set.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+
+#include "irq.h"
+#include "sensor.h"
+
+#include "workout.h"
+
+/* ----------------------  Defines --------------------- */
+#define WORKOUT_ON_MAX_MS   (60000U)        // held_ms fits in 16 bits
+#define WORKOUT_PAUSE_MAX_MS (30U * 60000U) // Phase ends stay within half the us wrap
+
+/* ----------------------  Variables --------------------- */
+
+static workout_cb_t _cb;
+
+// Protocol and progress
+static workout_protocol_t _protocol;
+static workout_state_t _state;
+static uint8_t _set;
+static uint8_t _rep;
+static uint8_t _prepared;       // PREPARE sent for the current pause
+static uint8_t _loaded;         // Load above the threshold, with hysteresis
+static uint32_t _phase_end_us;
+
+// Current rep
+static uint32_t _cue_us;        // Time of the HANG cue
+static uint32_t _load_us;       // First loaded frame
+static uint8_t _load_seen;
+static uint32_t _frames;        // Loaded frames
+static int32_t _peak;
+static int32_t _sum;
+
+// Pending command
+static workout_protocol_t _pending_protocol;
+static workout_op_t _pending_op;
+static volatile uint8_t _pending;
+
+/* ----------------------  Private  --------------------- */
+
+static int _due(uint32_t t_us, uint32_t end_us) {
+    return (int32_t)(t_us - end_us) >= 0;
+}
+
+static int16_t _sat16(int32_t val) {
+    return (val > INT16_MAX) ? INT16_MAX : (val < INT16_MIN) ? INT16_MIN : val;
+}
+
+static void _emit(workout_evt_type_t type, uint32_t t_us) {
+    workout_evt_t evt = {
+        .type = type,
+        .set = _set,
+        .rep = _rep,
+        .state = _state,
+        .t_us = t_us,
+    };
+
+    if (type == WORKOUT_EVT_RESULT) {
+        uint32_t held_ms = _frames * SENSOR_PERIOD_US / 1000U;
+        evt.held_ms = (held_ms > UINT16_MAX) ? UINT16_MAX : held_ms;
+        evt.delay_ms = _load_seen ? (_load_us - _cue_us) / 1000U : WORKOUT_NO_LOAD;
+        evt.peak = _sat16(_peak);
+        evt.mean = _frames ? _sat16(_sum / (int32_t)_frames) : 0;
+    }
+    if (_cb != NULL) {
+        _cb(&evt);
+    }
+}
+
+static void _rep_start(uint32_t t_us, uint32_t start_us) {
+    _state = WORKOUT_ON;
+    _rep++;
+    _phase_end_us = start_us + _protocol.on_ms * 1000U;
+    _cue_us = start_us;
+    _load_seen = 0;
+    _frames = 0;
+    _peak = 0;
+    _sum = 0;
+    _emit(WORKOUT_EVT_HANG, t_us);
+}
+
+static void _rep_sample(int32_t load, uint32_t t_us) {
+    if (!_loaded) {
+        return;
+    }
+    if (!_load_seen) {
+        _load_seen = 1;
+        _load_us = t_us;
+    }
+    _frames++;
+    _sum += load;
+    if (load > _peak) {
+        _peak = load;
+    }
+}
+
+static void _rep_end(uint32_t t_us) {
+    uint32_t end_us = _phase_end_us;
+
+    if (_rep < _protocol.reps) {
+        _state = WORKOUT_OFF;
+        _phase_end_us = end_us + _protocol.off_ms * 1000U;
+        _prepared = _protocol.off_ms <= WORKOUT_PREPARE_MS;
+    }
+    else if (_set < _protocol.sets) {
+        _state = WORKOUT_REST;
+        _phase_end_us = end_us + _protocol.rest_ms * 1000U;
+        _prepared = _protocol.rest_ms <= WORKOUT_PREPARE_MS;
+    }
+    else {
+        _state = WORKOUT_IDLE;
+    }
+
+    _emit(WORKOUT_EVT_RELEASE, t_us);
+    _emit(WORKOUT_EVT_RESULT, t_us);
+    if (_state == WORKOUT_REST) {
+        _emit(WORKOUT_EVT_SET_DONE, t_us);
+    }
+    else if (_state == WORKOUT_IDLE) {
+        _emit(WORKOUT_EVT_DONE, t_us);
+    }
+}
+
+static void _arm(uint32_t t_us) {
+    _state = WORKOUT_ARMED;
+    _set++;
+    _rep = 0;
+    _emit(WORKOUT_EVT_ARMED, t_us);
+}
+
+static void _apply_pending(uint32_t t_us) {
+    unsigned state = irq_disable();
+    workout_op_t op = _pending_op;
+    workout_protocol_t protocol = _pending_protocol;
+    _pending = 0;
+    irq_restore(state);
+
+    if (_state != WORKOUT_IDLE) {
+        _state = WORKOUT_IDLE;
+        _emit(WORKOUT_EVT_ABORTED, t_us);
+    }
+    if (op == WORKOUT_OP_LOAD) {
+        _protocol = protocol;
+        _set = 0;
+        _loaded = 0;
+        _arm(t_us);
+    }
+}
+
+/* ----------------------  Public  --------------------- */
+
+void workout_init(workout_cb_t cb) {
+    _cb = cb;
+}
+
+int workout_command(workout_op_t op, const workout_protocol_t *protocol) {
+    workout_protocol_t p = { 0 };
+
+    if (op == WORKOUT_OP_LOAD) {
+        p = *protocol;
+        if (p.reps == 0 || p.sets == 0 ||
+            p.on_ms < SENSOR_PERIOD_US / 1000U || p.on_ms > WORKOUT_ON_MAX_MS ||
+            p.off_ms > WORKOUT_PAUSE_MAX_MS || p.rest_ms > WORKOUT_PAUSE_MAX_MS ||
+            (p.threshold != 0 && p.threshold <= WORKOUT_HYSTERESIS)) {
+            return -EINVAL;
+        }
+        if (p.threshold == 0) {
+            p.threshold = WORKOUT_THRESHOLD;
+        }
+    }
+    else if (op != WORKOUT_OP_ABORT) {
+        return -EINVAL;
+    }
+
+    unsigned state = irq_disable();
+    if (_pending) {
+        irq_restore(state);
+        return -EBUSY;
+    }
+    _pending_op = op;
+    _pending_protocol = p;
+    _pending = 1;
+    irq_restore(state);
+
+    return 0;
+}
+
+void workout_push(int32_t load, uint32_t t_us) {
+    if (_pending) {
+        _apply_pending(t_us);
+    }
+    if (_state == WORKOUT_IDLE) {
+        return;
+    }
+
+    if (load > _protocol.threshold) {
+        _loaded = 1;
+    }
+    else if (load < _protocol.threshold - WORKOUT_HYSTERESIS) {
+        _loaded = 0;
+    }
+
+    switch (_state) {
+    case WORKOUT_ARMED:
+        /* the first hang of a set starts the clock */
+        if (_loaded) {
+            _rep_start(t_us, t_us);
+            _rep_sample(load, t_us);
+        }
+        break;
+
+    case WORKOUT_ON:
+        if (_due(t_us, _phase_end_us)) {
+            _rep_end(t_us);
+        }
+        else {
+            _rep_sample(load, t_us);
+        }
+        break;
+
+    case WORKOUT_OFF:
+    case WORKOUT_REST:
+        if (_due(t_us, _phase_end_us)) {
+            if (_state == WORKOUT_OFF) {
+                _rep_start(t_us, _phase_end_us);
+                _rep_sample(load, t_us);
+            }
+            else {
+                _arm(t_us);
+            }
+        }
+        else if (!_prepared && _due(t_us + WORKOUT_PREPARE_MS * 1000U, _phase_end_us)) {
+            _prepared = 1;
+            _emit(WORKOUT_EVT_PREPARE, t_us);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void workout_status(workout_status_t *status) {
+    unsigned state = irq_disable();
+    status->protocol = _protocol;
+    status->state = _state;
+    status->set = _set;
+    status->rep = _rep;
+    status->busy = _pending;
+    irq_restore(state);
+}
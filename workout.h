@@ -0,0 +1,106 @@
+/**
+ * @file
+ * @brief       Interval workouts (repeaters) timed on the board
+ *
+ * A protocol, e.g. 7 s on / 3 s off x 6 reps x 3 sets, is uploaded through the
+ * workout characteristic and runs against the sampling clock: every frame
+ * moves the engine forward, so cues are placed on the frame where they are
+ * due, with the device time of that frame. The client only renders the events
+ * it is notified, BLE latency and jitter don't shift the transitions.
+ *
+ * A set starts when the load goes above the threshold (the first hang of the
+ * set), the following reps are timed from that frame. Every rep ends with a
+ * result: the time spent above the threshold, the delay between the cue and
+ * the load, the peak and mean load.
+ *
+ * Loads are the unfiltered sum of the channels, in 0.01 kg: the filter of the
+ * pipeline delays the weight by a few frames.
+ */
+
+#ifndef WORKOUT_H
+#define WORKOUT_H
+
+#include <stdint.h>
+
+/* ----------------------  Defines --------------------- */
+#define WORKOUT_THRESHOLD   (500)       // Default load of a hang [0.01 kg]
+#define WORKOUT_HYSTERESIS  (100)       // Load drop before a hang counts as released [0.01 kg]
+#define WORKOUT_PREPARE_MS  (3000U)     // Warning before a hang after a pause
+#define WORKOUT_NO_LOAD     (0xffff)    // Delay of a rep without any load
+
+/* Commands of the workout characteristic: the opcode, then the protocol for
+ * WORKOUT_OP_LOAD */
+typedef enum {
+    WORKOUT_OP_LOAD = 0x01,     // Arm the protocol, the first hang starts it
+    WORKOUT_OP_ABORT = 0x02,    // Stop the running protocol
+} workout_op_t;
+
+typedef enum {
+    WORKOUT_IDLE = 0,
+    WORKOUT_ARMED = 1,          // Waiting for the first hang of a set
+    WORKOUT_ON = 2,             // Hang
+    WORKOUT_OFF = 3,            // Pause between reps
+    WORKOUT_REST = 4,           // Rest between sets
+} workout_state_t;
+
+typedef enum {
+    WORKOUT_EVT_ARMED = 1,      // Set armed, waiting for the load
+    WORKOUT_EVT_HANG = 2,       // Cue: hang
+    WORKOUT_EVT_RELEASE = 3,    // Cue: let go
+    WORKOUT_EVT_PREPARE = 4,    // Cue: hang in WORKOUT_PREPARE_MS
+    WORKOUT_EVT_RESULT = 5,     // Result of the rep that just ended
+    WORKOUT_EVT_SET_DONE = 6,   // Last rep of a set, rest
+    WORKOUT_EVT_DONE = 7,       // Last rep of the last set
+    WORKOUT_EVT_ABORTED = 8,
+} workout_evt_type_t;
+
+/* Protocol, as written to the workout characteristic (little endian) */
+typedef struct __attribute__((packed)) {
+    uint32_t on_ms;         // Hang per rep
+    uint32_t off_ms;        // Pause between reps
+    uint32_t rest_ms;       // Rest between sets
+    uint8_t reps;           // Reps per set
+    uint8_t sets;
+    uint16_t threshold;     // Load of a hang [0.01 kg], 0 for WORKOUT_THRESHOLD
+} workout_protocol_t;
+
+/* Status, as read from the workout characteristic */
+typedef struct __attribute__((packed)) {
+    workout_protocol_t protocol;
+    uint8_t state;          // workout_state_t
+    uint8_t set;            // Current set, from 1
+    uint8_t rep;            // Current rep, from 1, 0 while armed
+    uint8_t busy;           // A command is waiting to be handled
+} workout_status_t;
+
+/* Event, as notified by the workout characteristic */
+typedef struct __attribute__((packed)) {
+    uint8_t type;           // workout_evt_type_t
+    uint8_t set;
+    uint8_t rep;
+    uint8_t state;          // workout_state_t, after the event
+    uint32_t t_us;          // Device time of the frame of the event
+    uint16_t held_ms;       // Result: time above the threshold
+    uint16_t delay_ms;      // Result: cue to load, WORKOUT_NO_LOAD if none
+    int16_t peak;           // Result: peak load [0.01 kg]
+    int16_t mean;           // Result: mean load while hanging [0.01 kg]
+} workout_evt_t;
+
+/* Called from the sampling event queue, keep it short */
+typedef void (*workout_cb_t)(const workout_evt_t *evt);
+
+/* ----------------------  Prototypes --------------------- */
+
+void workout_init(workout_cb_t cb);
+
+/* Queue a command, protocol is only used by WORKOUT_OP_LOAD. Returns 0,
+ * -EINVAL for a bad protocol, -EBUSY while the previous one is pending */
+int workout_command(workout_op_t op, const workout_protocol_t *protocol);
+
+/* Move the engine forward by one frame: the load and the device time of the
+ * frame. Only call from the sampling event queue */
+void workout_push(int32_t load, uint32_t t_us);
+
+void workout_status(workout_status_t *status);
+
+#endif /* WORKOUT_H */